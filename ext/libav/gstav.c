@@ -155,6 +155,9 @@ plugin_init (GstPlugin * plugin)
   /* build global ffmpeg param/property info */
   gst_ffmpeg_cfg_init ();
 
+  gst_allocator_register (GST_FFMPEG_PADDED_ALLOCATOR_NAME,
+      gst_object_ref (gst_ffmpeg_padded_allocator_get ()));
+
   gst_ffmpegaudenc_register (plugin);
   gst_ffmpegvidenc_register (plugin);
   gst_ffmpegauddec_register (plugin);
@@ -162,6 +165,7 @@ plugin_init (GstPlugin * plugin)
   gst_ffmpegdemux_register (plugin);
   gst_ffmpegmux_register (plugin);
   gst_ffmpegdeinterlace_register (plugin);
+  gst_ffmpegladder_register (plugin);
 
   /* Now we can return the pointer to the newly created Plugin object. */
   return TRUE;
@@ -38,11 +38,26 @@
 
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_PERFORMANCE);
 
+#define DEFAULT_MIN_OUTPUT_DURATION 0
+#define DEFAULT_PARALLEL_CONTEXTS 1
+#define MAX_PARALLEL_CONTEXTS 64
+
+enum
+{
+  PROP_0,
+  PROP_MIN_OUTPUT_DURATION,
+  PROP_PARALLEL_CONTEXTS,
+};
+
 /* A number of function prototypes are given so we can refer to them later. */
 static void gst_ffmpegauddec_base_init (GstFFMpegAudDecClass * klass);
 static void gst_ffmpegauddec_class_init (GstFFMpegAudDecClass * klass);
 static void gst_ffmpegauddec_init (GstFFMpegAudDec * ffmpegdec);
 static void gst_ffmpegauddec_finalize (GObject * object);
+static void gst_ffmpegauddec_set_property (GObject * object,
+    guint prop_id, const GValue * value, GParamSpec * pspec);
+static void gst_ffmpegauddec_get_property (GObject * object,
+    guint prop_id, GValue * value, GParamSpec * pspec);
 static gboolean gst_ffmpegauddec_propose_allocation (GstAudioDecoder * decoder,
     GstQuery * query);
 
@@ -57,10 +72,26 @@ static GstFlowReturn gst_ffmpegauddec_handle_frame (GstAudioDecoder * decoder,
 static gboolean gst_ffmpegauddec_negotiate (GstFFMpegAudDec * ffmpegdec,
     AVCodecContext * context, AVFrame * frame, gboolean force);
 
+static gboolean gst_ffmpegauddec_frame (GstFFMpegAudDec * ffmpegdec,
+    GstFlowReturn * ret);
 static GstFlowReturn gst_ffmpegauddec_drain (GstFFMpegAudDec * ffmpegdec);
+static GstFlowReturn gst_ffmpegauddec_push_pending (GstFFMpegAudDec *
+    ffmpegdec);
+static void gst_ffmpegauddec_clear_pending (GstFFMpegAudDec * ffmpegdec);
+static void gst_ffmpegauddec_update_latency (GstFFMpegAudDec * ffmpegdec);
+static GstFlowReturn gst_ffmpegauddec_finish_input (GstFFMpegAudDec *
+    ffmpegdec, gboolean consumed, GstFlowReturn ret);
+
+static void gst_ffmpegauddec_parallel_stop (GstFFMpegAudDec * ffmpegdec);
+static GstFlowReturn gst_ffmpegauddec_parallel_output (GstFFMpegAudDec *
+    ffmpegdec, guint max_jobs);
 
 #define GST_FFDEC_PARAMS_QDATA g_quark_from_static_string("avdec-params")
 
+/* size of the buffers of the pool offered upstream, enough for a packet of
+ * any of the common compressed audio formats */
+#define AUDIO_INPUT_POOL_BUFFER_SIZE (64 * 1024)
+
 static GstElementClass *parent_class = NULL;
 
 static void
@@ -126,6 +157,39 @@ gst_ffmpegauddec_class_init (GstFFMpegAudDecClass * klass)
   parent_class = g_type_class_peek_parent (klass);
 
   gobject_class->finalize = gst_ffmpegauddec_finalize;
+  gobject_class->set_property = gst_ffmpegauddec_set_property;
+  gobject_class->get_property = gst_ffmpegauddec_get_property;
+
+  /**
+   * GstFFMpegAudDec:min-output-duration:
+   *
+   * Coalesce consecutive decoded frames of the same format until they
+   * last at least this long before pushing them downstream, to reduce the
+   * per buffer overhead of codecs with small frames. The held back
+   * duration is added to the reported latency.
+   */
+  g_object_class_install_property (gobject_class, PROP_MIN_OUTPUT_DURATION,
+      g_param_spec_uint64 ("min-output-duration", "Minimum output duration",
+          "Minimum duration in nanoseconds of the output buffers, decoded "
+          "frames are merged until it is reached (0 = disabled)", 0,
+          GST_SECOND, DEFAULT_MIN_OUTPUT_DURATION,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstFFMpegAudDec:parallel-contexts:
+   *
+   * Decode on this many codec contexts on worker threads. Only used for
+   * codecs whose frames can be decoded independently of each other, like
+   * FLAC, ALAC, APE or ADPCM, and meant for offline processing: up to twice
+   * as many input buffers as contexts are held back to keep the workers
+   * busy. The output stays in input order.
+   */
+  g_object_class_install_property (gobject_class, PROP_PARALLEL_CONTEXTS,
+      g_param_spec_uint ("parallel-contexts", "Parallel contexts",
+          "Number of contexts decoding independent frames in parallel "
+          "(0 = number of processors, 1 = disabled)", 0,
+          MAX_PARALLEL_CONTEXTS, DEFAULT_PARALLEL_CONTEXTS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
   gstaudiodecoder_class->start = GST_DEBUG_FUNCPTR (gst_ffmpegauddec_start);
   gstaudiodecoder_class->stop = GST_DEBUG_FUNCPTR (gst_ffmpegauddec_stop);
@@ -152,6 +216,11 @@ gst_ffmpegauddec_init (GstFFMpegAudDec * ffmpegdec)
   ffmpegdec->opened = FALSE;
 
   ffmpegdec->frame = av_frame_alloc ();
+  ffmpegdec->min_output_duration = DEFAULT_MIN_OUTPUT_DURATION;
+  ffmpegdec->parallel_contexts = DEFAULT_PARALLEL_CONTEXTS;
+  g_mutex_init (&ffmpegdec->parallel_lock);
+  g_cond_init (&ffmpegdec->parallel_cond);
+  g_queue_init (&ffmpegdec->parallel_jobs);
 
   GST_PAD_SET_ACCEPT_TEMPLATE (GST_AUDIO_DECODER_SINK_PAD (ffmpegdec));
   gst_audio_decoder_set_use_default_pad_acceptcaps (GST_AUDIO_DECODER_CAST
@@ -174,6 +243,9 @@ gst_ffmpegauddec_finalize (GObject * object)
     ffmpegdec->context = NULL;
   }
 
+  g_mutex_clear (&ffmpegdec->parallel_lock);
+  g_cond_clear (&ffmpegdec->parallel_cond);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -189,6 +261,7 @@ gst_ffmpegauddec_close (GstFFMpegAudDec * ffmpegdec, gboolean reset)
 
   gst_caps_replace (&ffmpegdec->last_caps, NULL);
 
+  gst_ffmpegauddec_parallel_stop (ffmpegdec);
   gst_ffmpeg_avcodec_close (ffmpegdec->context);
   ffmpegdec->opened = FALSE;
 
@@ -227,9 +300,30 @@ gst_ffmpegauddec_start (GstAudioDecoder * decoder)
   ffmpegdec->context->opaque = ffmpegdec;
   GST_OBJECT_UNLOCK (ffmpegdec);
 
+  gst_ffmpegauddec_update_latency (ffmpegdec);
+
   return TRUE;
 }
 
+/* we hold back up to min-output-duration of output, posts a latency
+ * message when it changes */
+static void
+gst_ffmpegauddec_update_latency (GstFFMpegAudDec * ffmpegdec)
+{
+  GstClockTime min_latency, max_latency;
+  GstClockTime latency = ffmpegdec->min_output_duration;
+
+  gst_audio_decoder_get_latency (GST_AUDIO_DECODER (ffmpegdec), &min_latency,
+      &max_latency);
+  if (min_latency == latency && max_latency == latency)
+    return;
+
+  GST_DEBUG_OBJECT (ffmpegdec, "latency now %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (latency));
+  gst_audio_decoder_set_latency (GST_AUDIO_DECODER (ffmpegdec), latency,
+      latency);
+}
+
 static gboolean
 gst_ffmpegauddec_stop (GstAudioDecoder * decoder)
 {
@@ -241,6 +335,15 @@ gst_ffmpegauddec_stop (GstAudioDecoder * decoder)
   ffmpegdec->padded = NULL;
   ffmpegdec->padded_size = 0;
   GST_OBJECT_UNLOCK (ffmpegdec);
+  ffmpegdec->n_packets = 0;
+  ffmpegdec->n_padding_copies = 0;
+  gst_ffmpegauddec_clear_pending (ffmpegdec);
+  if (ffmpegdec->mixer) {
+    gst_audio_channel_mixer_free (ffmpegdec->mixer);
+    ffmpegdec->mixer = NULL;
+  }
+  ffmpegdec->frame_channels = 0;
+  ffmpegdec->downmix_channels = 0;
   gst_audio_info_init (&ffmpegdec->info);
   gst_caps_replace (&ffmpegdec->last_caps, NULL);
 
@@ -281,31 +384,465 @@ static gboolean
 gst_ffmpegauddec_propose_allocation (GstAudioDecoder * decoder,
     GstQuery * query)
 {
-  GstAllocationParams params;
-
-  gst_allocation_params_init (&params);
-  params.flags = GST_MEMORY_FLAG_ZERO_PADDED;
-  params.align = 15;
-  params.padding = AV_INPUT_BUFFER_PADDING_SIZE;
   /* we would like to have some padding so that we don't have to
-   * memcpy. We don't suggest an allocator. */
-  gst_query_add_allocation_param (query, NULL, &params);
+   * memcpy */
+  gst_ffmpeg_propose_padded_allocation (GST_ELEMENT_CAST (decoder), query,
+      AUDIO_INPUT_POOL_BUFFER_SIZE, 15);
 
   return GST_AUDIO_DECODER_CLASS (parent_class)->propose_allocation (decoder,
       query);
 }
 
+/* Parallel decoding: each input buffer becomes a job that is decoded on one
+ * of the idle contexts by the thread pool. The streaming thread outputs the
+ * decoded frames of the finished jobs in input order, as if they came from
+ * the main context */
+typedef struct _GstFFMpegAudDecJobFrame GstFFMpegAudDecJobFrame;
+
+struct _GstFFMpegAudDecJobFrame
+{
+  AVFrame *frame;
+  GstFFMpegAudDecJobFrame *next;
+};
+
+typedef struct
+{
+  GstBuffer *inbuf;
+  gboolean is_header;
+  gboolean padding_copy;
+  GstFFMpegAudDecJobFrame *frames, *last_frame;
+  gboolean done;
+} GstFFMpegAudDecJob;
+
+/* a parallel context with the padded input copy it reuses from job to job */
+typedef struct
+{
+  AVCodecContext *context;
+  guint8 *padded;
+  gsize padded_size;
+} GstFFMpegAudDecWorker;
+
+/* codecs without any state carried from one packet to the next */
+static gboolean
+gst_ffmpegauddec_frames_are_independent (enum AVCodecID codec_id)
+{
+  switch (codec_id) {
+    case AV_CODEC_ID_FLAC:
+    case AV_CODEC_ID_ALAC:
+    case AV_CODEC_ID_APE:
+    case AV_CODEC_ID_WAVPACK:
+    case AV_CODEC_ID_TTA:
+    case AV_CODEC_ID_ADPCM_IMA_WAV:
+    case AV_CODEC_ID_ADPCM_IMA_QT:
+    case AV_CODEC_ID_ADPCM_IMA_DK3:
+    case AV_CODEC_ID_ADPCM_IMA_DK4:
+    case AV_CODEC_ID_ADPCM_MS:
+    case AV_CODEC_ID_ADPCM_SWF:
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+static void
+gst_ffmpegauddec_job_frame_clear (gpointer data)
+{
+  GstFFMpegAudDecJobFrame *item = data;
+
+  av_frame_free (&item->frame);
+}
+
+static void
+gst_ffmpegauddec_job_release (GstFFMpegAudDecJob * job)
+{
+  GstFFMpegAudDecJobFrame *item;
+
+  while ((item = job->frames)) {
+    job->frames = item->next;
+    av_frame_unref (item->frame);
+    gst_ffmpeg_free_list_release (item);
+  }
+  gst_buffer_unref (job->inbuf);
+  gst_ffmpeg_free_list_release (job);
+}
+
+static void
+gst_ffmpegauddec_parallel_decode (gpointer data, gpointer user_data)
+{
+  GstFFMpegAudDecJob *job = data;
+  GstFFMpegAudDec *ffmpegdec = user_data;
+  GstFFMpegAudDecWorker *worker;
+  GstFFMpegAudDecJobFrame *item;
+  AVPacket packet;
+  GstMapInfo map;
+  guint8 *bdata;
+
+  /* the pool never runs more jobs than there are workers */
+  worker = g_async_queue_pop (ffmpegdec->idle_workers);
+
+  gst_buffer_map (job->inbuf, &map, GST_MAP_READ);
+  bdata = map.data;
+
+  if (!GST_MEMORY_IS_ZERO_PADDED (map.memory)
+      || (map.maxsize - map.size) < AV_INPUT_BUFFER_PADDING_SIZE) {
+    if (worker->padded_size < map.size + AV_INPUT_BUFFER_PADDING_SIZE) {
+      g_free (worker->padded);
+      worker->padded_size = map.size + AV_INPUT_BUFFER_PADDING_SIZE;
+      worker->padded = g_malloc (worker->padded_size);
+    }
+    memcpy (worker->padded, map.data, map.size);
+    memset (worker->padded + map.size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    job->padding_copy = TRUE;
+    bdata = worker->padded;
+  }
+
+  gst_avpacket_init (&packet, bdata, map.size);
+
+  if (avcodec_send_packet (worker->context, &packet) < 0) {
+    GST_WARNING_OBJECT (ffmpegdec, "decoding error");
+  } else {
+    while (TRUE) {
+      item = gst_ffmpeg_free_list_alloc (ffmpegdec->job_frame_list);
+      if (!item->frame)
+        item->frame = av_frame_alloc ();
+
+      if (!item->frame
+          || avcodec_receive_frame (worker->context, item->frame) < 0) {
+        gst_ffmpeg_free_list_release (item);
+        break;
+      }
+
+      item->next = NULL;
+      if (job->last_frame)
+        job->last_frame->next = item;
+      else
+        job->frames = item;
+      job->last_frame = item;
+    }
+  }
+
+  gst_buffer_unmap (job->inbuf, &map);
+
+  g_async_queue_push (ffmpegdec->idle_workers, worker);
+
+  g_mutex_lock (&ffmpegdec->parallel_lock);
+  job->done = TRUE;
+  g_cond_broadcast (&ffmpegdec->parallel_cond);
+  g_mutex_unlock (&ffmpegdec->parallel_lock);
+}
+
+/* with LOCK, after the main context was opened. Decoding stays on the
+ * streaming thread if the contexts can't be set up */
+static void
+gst_ffmpegauddec_parallel_start (GstFFMpegAudDec * ffmpegdec)
+{
+  GstFFMpegAudDecClass *oclass;
+  AVCodecParameters *par;
+  guint i, n_contexts = ffmpegdec->parallel_contexts;
+
+  oclass = (GstFFMpegAudDecClass *) (G_OBJECT_GET_CLASS (ffmpegdec));
+
+  if (n_contexts == 0)
+    n_contexts = MIN (g_get_num_processors (), MAX_PARALLEL_CONTEXTS);
+  if (n_contexts < 2)
+    return;
+
+  if (!gst_ffmpegauddec_frames_are_independent (oclass->in_plugin->id)) {
+    GST_INFO_OBJECT (ffmpegdec, "frames of %s depend on each other, "
+        "decoding them sequentially", oclass->in_plugin->name);
+    return;
+  }
+
+  par = avcodec_parameters_alloc ();
+  if (!par || avcodec_parameters_from_context (par, ffmpegdec->context) < 0)
+    goto failed;
+
+  ffmpegdec->idle_workers = g_async_queue_new ();
+  for (i = 0; i < n_contexts; i++) {
+    AVCodecContext *context = avcodec_alloc_context3 (oclass->in_plugin);
+    GstFFMpegAudDecWorker *worker;
+
+    if (!context)
+      goto failed;
+
+    if (avcodec_parameters_to_context (context, par) < 0) {
+      avcodec_free_context (&context);
+      goto failed;
+    }
+    context->opaque = ffmpegdec;
+    context->workaround_bugs = ffmpegdec->context->workaround_bugs;
+    context->err_recognition = ffmpegdec->context->err_recognition;
+    context->request_channel_layout =
+        ffmpegdec->context->request_channel_layout;
+    context->request_sample_fmt = ffmpegdec->context->request_sample_fmt;
+
+    if (gst_ffmpeg_avcodec_open (context, oclass->in_plugin) < 0) {
+      avcodec_free_context (&context);
+      goto failed;
+    }
+
+    worker = g_slice_new0 (GstFFMpegAudDecWorker);
+    worker->context = context;
+    g_async_queue_push (ffmpegdec->idle_workers, worker);
+  }
+  avcodec_parameters_free (&par);
+
+  ffmpegdec->job_list =
+      gst_ffmpeg_free_list_new (G_OBJECT_TYPE_NAME (ffmpegdec),
+      sizeof (GstFFMpegAudDecJob), NULL);
+  ffmpegdec->job_frame_list =
+      gst_ffmpeg_free_list_new (G_OBJECT_TYPE_NAME (ffmpegdec),
+      sizeof (GstFFMpegAudDecJobFrame), gst_ffmpegauddec_job_frame_clear);
+  ffmpegdec->parallel_pool =
+      g_thread_pool_new (gst_ffmpegauddec_parallel_decode, ffmpegdec,
+      n_contexts, FALSE, NULL);
+
+  GST_INFO_OBJECT (ffmpegdec, "decoding on %u contexts", n_contexts);
+
+  return;
+
+failed:
+  {
+    GST_WARNING_OBJECT (ffmpegdec, "failed to set up %u contexts, decoding "
+        "sequentially", n_contexts);
+    avcodec_parameters_free (&par);
+    gst_ffmpegauddec_parallel_stop (ffmpegdec);
+  }
+}
+
+/* waits for the running jobs and drops all of them */
+static void
+gst_ffmpegauddec_parallel_stop (GstFFMpegAudDec * ffmpegdec)
+{
+  GstFFMpegAudDecJob *job;
+  GstFFMpegAudDecWorker *worker;
+
+  if (ffmpegdec->parallel_pool) {
+    g_thread_pool_free (ffmpegdec->parallel_pool, FALSE, TRUE);
+    ffmpegdec->parallel_pool = NULL;
+  }
+
+  while ((job = g_queue_pop_head (&ffmpegdec->parallel_jobs)))
+    gst_ffmpegauddec_job_release (job);
+  ffmpegdec->current_job = NULL;
+
+  if (ffmpegdec->idle_workers) {
+    while ((worker = g_async_queue_try_pop (ffmpegdec->idle_workers))) {
+      gst_ffmpeg_avcodec_close (worker->context);
+      avcodec_free_context (&worker->context);
+      g_free (worker->padded);
+      g_slice_free (GstFFMpegAudDecWorker, worker);
+    }
+    g_async_queue_unref (ffmpegdec->idle_workers);
+    ffmpegdec->idle_workers = NULL;
+  }
+
+  /* objects still in use keep their list alive */
+  g_clear_pointer (&ffmpegdec->job_list, gst_ffmpeg_free_list_unref);
+  g_clear_pointer (&ffmpegdec->job_frame_list, gst_ffmpeg_free_list_unref);
+}
+
+/* waits for the queued jobs and drops them, the pool stays ready */
+static void
+gst_ffmpegauddec_parallel_discard (GstFFMpegAudDec * ffmpegdec)
+{
+  GstFFMpegAudDecJob *job;
+
+  g_mutex_lock (&ffmpegdec->parallel_lock);
+  while ((job = g_queue_pop_head (&ffmpegdec->parallel_jobs))) {
+    while (!job->done)
+      g_cond_wait (&ffmpegdec->parallel_cond, &ffmpegdec->parallel_lock);
+    gst_ffmpegauddec_job_release (job);
+  }
+  g_mutex_unlock (&ffmpegdec->parallel_lock);
+}
+
+static GstFlowReturn
+gst_ffmpegauddec_parallel_handle_frame (GstFFMpegAudDec * ffmpegdec,
+    GstBuffer * inbuf)
+{
+  GstFFMpegAudDecJob *job;
+
+  if (gst_buffer_get_size (inbuf) == 0)
+    return GST_FLOW_OK;
+
+  ffmpegdec->n_packets++;
+
+  job = gst_ffmpeg_free_list_alloc (ffmpegdec->job_list);
+  job->inbuf = gst_buffer_ref (inbuf);
+  job->is_header = GST_BUFFER_FLAG_IS_SET (inbuf, GST_BUFFER_FLAG_HEADER);
+  job->padding_copy = FALSE;
+  job->frames = job->last_frame = NULL;
+  job->done = FALSE;
+
+  g_mutex_lock (&ffmpegdec->parallel_lock);
+  g_queue_push_tail (&ffmpegdec->parallel_jobs, job);
+  g_mutex_unlock (&ffmpegdec->parallel_lock);
+
+  g_thread_pool_push (ffmpegdec->parallel_pool, job, NULL);
+
+  /* keep a second job per context queued while the first ones are output */
+  return gst_ffmpegauddec_parallel_output (ffmpegdec,
+      2 * g_thread_pool_get_max_threads (ffmpegdec->parallel_pool));
+}
+
+/* hands the decoded frames of a job to the regular output path */
+static int
+gst_ffmpegauddec_parallel_receive (GstFFMpegAudDec * ffmpegdec,
+    AVFrame * frame)
+{
+  GstFFMpegAudDecJob *job = ffmpegdec->current_job;
+  GstFFMpegAudDecJobFrame *item = job->frames;
+
+  if (!item)
+    return AVERROR (EAGAIN);
+
+  job->frames = item->next;
+  av_frame_move_ref (frame, item->frame);
+  gst_ffmpeg_free_list_release (item);
+
+  return 0;
+}
+
+/* Outputs the finished jobs at the head of the queue, waiting for them while
+ * more than max_jobs are queued. Waits for all with a max_jobs of 0 */
+static GstFlowReturn
+gst_ffmpegauddec_parallel_output (GstFFMpegAudDec * ffmpegdec, guint max_jobs)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstFFMpegAudDecJob *job;
+
+  g_mutex_lock (&ffmpegdec->parallel_lock);
+  while ((job = g_queue_peek_head (&ffmpegdec->parallel_jobs))) {
+    gboolean got_frame, got_any_frames = FALSE;
+
+    if (!job->done) {
+      if (max_jobs > 0
+          && g_queue_get_length (&ffmpegdec->parallel_jobs) <= max_jobs)
+        break;
+      g_cond_wait (&ffmpegdec->parallel_cond, &ffmpegdec->parallel_lock);
+      continue;
+    }
+    g_queue_pop_head (&ffmpegdec->parallel_jobs);
+    g_mutex_unlock (&ffmpegdec->parallel_lock);
+
+    if (job->padding_copy)
+      ffmpegdec->n_padding_copies++;
+
+    /* after an error the input is dropped with the next flush */
+    if (ret == GST_FLOW_OK) {
+      ffmpegdec->current_job = job;
+      do {
+        got_frame = gst_ffmpegauddec_frame (ffmpegdec, &ret);
+        if (got_frame)
+          got_any_frames = TRUE;
+      } while (got_frame && ret == GST_FLOW_OK);
+      ffmpegdec->current_job = NULL;
+
+      ret = gst_ffmpegauddec_finish_input (ffmpegdec,
+          job->is_header || got_any_frames, ret);
+    }
+    gst_ffmpegauddec_job_release (job);
+
+    g_mutex_lock (&ffmpegdec->parallel_lock);
+  }
+  g_mutex_unlock (&ffmpegdec->parallel_lock);
+
+  return ret;
+}
+
+/* Finds out the channel count and sample format downstream wants, if it
+ * is picky, so that the decoder can be asked to output that directly.
+ * AC-3, E-AC-3 and DTS can downmix much cheaper while decoding */
+static void
+gst_ffmpegauddec_get_downstream_request (GstFFMpegAudDec * ffmpegdec,
+    gint * channels, enum AVSampleFormat *sample_fmt)
+{
+  GstCaps *caps;
+  GstStructure *s;
+  const GValue *v;
+  const gchar *layout;
+  GstAudioFormat format;
+  gboolean interleaved;
+  guint i;
+
+  *channels = 0;
+  *sample_fmt = AV_SAMPLE_FMT_NONE;
+
+  caps = gst_pad_peer_query_caps (GST_AUDIO_DECODER_SRC_PAD (ffmpegdec), NULL);
+  if (!caps)
+    return;
+  if (gst_caps_is_empty (caps) || gst_caps_is_any (caps))
+    goto done;
+
+  /* only if all the structures agree on a fixed channel count */
+  for (i = 0; i < gst_caps_get_size (caps); i++) {
+    gint c;
+
+    s = gst_caps_get_structure (caps, i);
+    if (!gst_structure_get_int (s, "channels", &c)
+        || (*channels != 0 && c != *channels)) {
+      *channels = 0;
+      break;
+    }
+    *channels = c;
+  }
+  if (*channels > 2)
+    *channels = 0;
+
+  /* and the preferred format of the first one */
+  s = gst_caps_get_structure (caps, 0);
+  v = gst_structure_get_value (s, "format");
+  if (v && GST_VALUE_HOLDS_LIST (v) && gst_value_list_get_size (v) > 0)
+    v = gst_value_list_get_value (v, 0);
+  if (!v || !G_VALUE_HOLDS_STRING (v))
+    goto done;
+
+  format = gst_audio_format_from_string (g_value_get_string (v));
+  layout = gst_structure_get_string (s, "layout");
+  interleaved = g_strcmp0 (layout, "non-interleaved") != 0;
+
+  switch (format) {
+    case GST_AUDIO_FORMAT_U8:
+      *sample_fmt = interleaved ? AV_SAMPLE_FMT_U8 : AV_SAMPLE_FMT_U8P;
+      break;
+    case GST_AUDIO_FORMAT_S16:
+      *sample_fmt = interleaved ? AV_SAMPLE_FMT_S16 : AV_SAMPLE_FMT_S16P;
+      break;
+    case GST_AUDIO_FORMAT_S32:
+      *sample_fmt = interleaved ? AV_SAMPLE_FMT_S32 : AV_SAMPLE_FMT_S32P;
+      break;
+    case GST_AUDIO_FORMAT_F32:
+      *sample_fmt = interleaved ? AV_SAMPLE_FMT_FLT : AV_SAMPLE_FMT_FLTP;
+      break;
+    case GST_AUDIO_FORMAT_F64:
+      *sample_fmt = interleaved ? AV_SAMPLE_FMT_DBL : AV_SAMPLE_FMT_DBLP;
+      break;
+    default:
+      break;
+  }
+
+done:
+  GST_DEBUG_OBJECT (ffmpegdec, "downstream wants %d channels, format %s",
+      *channels, GST_STR_NULL (av_get_sample_fmt_name (*sample_fmt)));
+  gst_caps_unref (caps);
+}
+
 static gboolean
 gst_ffmpegauddec_set_format (GstAudioDecoder * decoder, GstCaps * caps)
 {
   GstFFMpegAudDec *ffmpegdec = (GstFFMpegAudDec *) decoder;
   GstFFMpegAudDecClass *oclass;
   gboolean ret = TRUE;
+  gint channels;
+  enum AVSampleFormat sample_fmt;
 
   oclass = (GstFFMpegAudDecClass *) (G_OBJECT_GET_CLASS (ffmpegdec));
 
   GST_DEBUG_OBJECT (ffmpegdec, "setcaps called");
 
+  gst_ffmpegauddec_get_downstream_request (ffmpegdec, &channels, &sample_fmt);
+
   GST_OBJECT_LOCK (ffmpegdec);
 
   if (ffmpegdec->last_caps && gst_caps_is_equal (ffmpegdec->last_caps, caps)) {
@@ -335,12 +872,22 @@ gst_ffmpegauddec_set_format (GstAudioDecoder * decoder, GstCaps * caps)
   ffmpegdec->context->workaround_bugs |= FF_BUG_AUTODETECT;
   ffmpegdec->context->err_recognition = 1;
 
+  /* let the decoder downmix and convert if it can, we downmix ourselves
+   * otherwise */
+  ffmpegdec->downmix_channels = channels;
+  if (channels > 0)
+    ffmpegdec->context->request_channel_layout =
+        av_get_default_channel_layout (channels);
+  ffmpegdec->context->request_sample_fmt = sample_fmt;
+
   /* open codec - we don't select an output pix_fmt yet,
    * simply because we don't know! We only get it
    * during playback... */
   if (!gst_ffmpegauddec_open (ffmpegdec))
     goto open_failed;
 
+  gst_ffmpegauddec_parallel_start (ffmpegdec);
+
 done:
   GST_OBJECT_UNLOCK (ffmpegdec);
 
@@ -362,14 +909,21 @@ settings_changed (GstFFMpegAudDec * ffmpegdec, AVFrame * frame)
   GstAudioLayout layout;
   gint channels = av_get_channel_layout_nb_channels (frame->channel_layout);
 
+  /* same fallbacks as when negotiating, without a layout the count would
+   * be 0 and every frame would renegotiate */
+  if (channels == 0)
+    channels = frame->channels;
+  if (channels == 0)
+    channels = ffmpegdec->context->channels;
+
   format = gst_ffmpeg_smpfmt_to_audioformat (frame->format, &layout);
   if (format == GST_AUDIO_FORMAT_UNKNOWN)
     return TRUE;
 
   return !(ffmpegdec->info.rate == frame->sample_rate &&
-      ffmpegdec->info.channels == channels &&
+      ffmpegdec->frame_channels == channels &&
       ffmpegdec->info.finfo->format == format &&
-      ffmpegdec->info.layout == layout);
+      ffmpegdec->frame_layout == layout);
 }
 
 static gboolean
@@ -390,6 +944,8 @@ gst_ffmpegauddec_negotiate (GstFFMpegAudDec * ffmpegdec,
   channels = av_get_channel_layout_nb_channels (frame->channel_layout);
   if (channels == 0)
     channels = frame->channels;
+  if (channels == 0)
+    channels = context->channels;
   if (channels == 0)
     goto no_caps;
 
@@ -408,11 +964,63 @@ gst_ffmpegauddec_negotiate (GstFFMpegAudDec * ffmpegdec,
   gst_ffmpeg_channel_layout_to_gst (frame->channel_layout, channels, pos);
   memcpy (ffmpegdec->ffmpeg_layout, pos,
       sizeof (GstAudioChannelPosition) * channels);
+  ffmpegdec->frame_channels = channels;
+  ffmpegdec->frame_layout = layout;
+
+  if (ffmpegdec->mixer) {
+    gst_audio_channel_mixer_free (ffmpegdec->mixer);
+    ffmpegdec->mixer = NULL;
+  }
+
+  /* the decoder ignored request_channel_layout */
+  if (ffmpegdec->downmix_channels > 0
+      && channels > ffmpegdec->downmix_channels
+      && pos[0] != GST_AUDIO_CHANNEL_POSITION_NONE
+      && (format == GST_AUDIO_FORMAT_S16 || format == GST_AUDIO_FORMAT_S32
+          || format == GST_AUDIO_FORMAT_F32
+          || format == GST_AUDIO_FORMAT_F64)) {
+    GstAudioChannelPosition out_pos[2] = {
+      GST_AUDIO_CHANNEL_POSITION_FRONT_LEFT,
+      GST_AUDIO_CHANNEL_POSITION_FRONT_RIGHT
+    };
+
+    if (ffmpegdec->downmix_channels == 1)
+      out_pos[0] = GST_AUDIO_CHANNEL_POSITION_MONO;
+
+    ffmpegdec->mixer =
+        gst_audio_channel_mixer_new (layout ==
+        GST_AUDIO_LAYOUT_NON_INTERLEAVED ?
+        GST_AUDIO_CHANNEL_MIXER_FLAGS_NON_INTERLEAVED_IN :
+        GST_AUDIO_CHANNEL_MIXER_FLAGS_NONE, format, channels,
+        ffmpegdec->ffmpeg_layout, ffmpegdec->downmix_channels, out_pos);
+
+    if (ffmpegdec->mixer) {
+      GST_INFO_OBJECT (ffmpegdec, "downmixing %d channels to %d", channels,
+          ffmpegdec->downmix_channels);
+      channels = ffmpegdec->downmix_channels;
+      memcpy (pos, out_pos, sizeof (pos[0]) * channels);
+      layout = GST_AUDIO_LAYOUT_INTERLEAVED;
+    }
+  }
 
   /* Get GStreamer channel layout */
-  gst_audio_channel_positions_to_valid_order (pos, channels);
-  ffmpegdec->needs_reorder =
-      memcmp (pos, ffmpegdec->ffmpeg_layout, sizeof (pos[0]) * channels) != 0;
+  if (ffmpegdec->mixer) {
+    ffmpegdec->needs_reorder = FALSE;
+  } else {
+    gst_audio_channel_positions_to_valid_order (pos, channels);
+    ffmpegdec->needs_reorder =
+        memcmp (pos, ffmpegdec->ffmpeg_layout,
+        sizeof (pos[0]) * channels) != 0;
+  }
+  if (ffmpegdec->needs_reorder) {
+    gint reorder_map[64], i;
+
+    if (!gst_audio_get_channel_reorder_map (channels, ffmpegdec->ffmpeg_layout,
+            pos, reorder_map))
+      goto caps_failed;
+    for (i = 0; i < channels; i++)
+      ffmpegdec->channel_order[reorder_map[i]] = i;
+  }
   gst_audio_info_set_format (&ffmpegdec->info, format,
       frame->sample_rate, channels, pos);
   ffmpegdec->info.layout = layout;
@@ -463,6 +1071,76 @@ gst_avpacket_init (AVPacket * packet, guint8 * data, guint size)
   packet->size = size;
 }
 
+static void
+gst_ffmpegauddec_avbuffer_unref (gpointer data)
+{
+  AVBufferRef *buf = data;
+
+  av_buffer_unref (&buf);
+}
+
+/* Wraps the decoded samples in a buffer, one memory holding a reference on
+ * the libav buffer for each plane. Returns NULL if the frame can't be
+ * wrapped, in which case the samples need to be copied */
+static GstBuffer *
+gst_ffmpegauddec_wrap_frame (GstFFMpegAudDec * ffmpegdec, AVFrame * frame,
+    gint nsamples, gboolean planar)
+{
+  GstBuffer *outbuf;
+  GstMemoryFlags flags = 0;
+  gint i, n_planes, byte_per_sample;
+  gsize plane_size;
+
+  byte_per_sample = ffmpegdec->info.finfo->width / 8;
+  if (planar) {
+    n_planes = ffmpegdec->info.channels;
+    plane_size = nsamples * byte_per_sample;
+  } else {
+    n_planes = 1;
+    plane_size = nsamples * byte_per_sample * ffmpegdec->info.channels;
+  }
+
+  /* more memories would get merged, which is a copy again */
+  if (n_planes > gst_buffer_get_max_memory ())
+    return NULL;
+
+  for (i = 0; i < n_planes; i++) {
+    AVBufferRef *buf = av_frame_get_plane_buffer (frame, i);
+
+    if (!buf || frame->extended_data[i] < buf->data
+        || frame->extended_data[i] + plane_size > buf->data + buf->size)
+      return NULL;
+
+    /* unless libav keeps a reference, ours will be the only one once the
+     * frame is unreffed and downstream can write to the memory */
+    if (av_buffer_get_ref_count (buf) > 1)
+      flags |= GST_MEMORY_FLAG_READONLY;
+  }
+
+  /* planes are reordered by adding them in the GStreamer channel order */
+  outbuf = gst_buffer_new ();
+  for (i = 0; i < n_planes; i++) {
+    gint plane = ffmpegdec->needs_reorder ? ffmpegdec->channel_order[i] : i;
+    AVBufferRef *buf =
+        av_buffer_ref (av_frame_get_plane_buffer (frame, plane));
+
+    if (!buf) {
+      gst_buffer_unref (outbuf);
+      return NULL;
+    }
+
+    gst_buffer_append_memory (outbuf,
+        gst_memory_new_wrapped (flags, buf->data, buf->size,
+            frame->extended_data[plane] - buf->data, plane_size, buf,
+            gst_ffmpegauddec_avbuffer_unref));
+  }
+
+  if (planar)
+    gst_buffer_add_audio_meta (outbuf, &ffmpegdec->info, nsamples, NULL);
+
+  return outbuf;
+}
+
 /*
  * Returns: whether a frame was decoded
  */
@@ -473,13 +1151,25 @@ gst_ffmpegauddec_audio_frame (GstFFMpegAudDec * ffmpegdec,
   gboolean got_frame = FALSE;
   gint res;
 
-  res = avcodec_receive_frame (ffmpegdec->context, ffmpegdec->frame);
+  if (ffmpegdec->current_job)
+    res = gst_ffmpegauddec_parallel_receive (ffmpegdec, ffmpegdec->frame);
+  else
+    res = avcodec_receive_frame (ffmpegdec->context, ffmpegdec->frame);
 
   if (res >= 0) {
     gint nsamples, channels, byte_per_sample;
     gsize output_size;
     gboolean planar;
 
+    /* only frames of the same format are merged */
+    if (ffmpegdec->pending && settings_changed (ffmpegdec, ffmpegdec->frame)) {
+      *ret = gst_ffmpegauddec_push_pending (ffmpegdec);
+      if (*ret != GST_FLOW_OK) {
+        *outbuf = NULL;
+        goto beach;
+      }
+    }
+
     if (!gst_ffmpegauddec_negotiate (ffmpegdec, ffmpegdec->context,
             ffmpegdec->frame, FALSE)) {
       *outbuf = NULL;
@@ -492,47 +1182,85 @@ gst_ffmpegauddec_audio_frame (GstFFMpegAudDec * ffmpegdec,
     channels = ffmpegdec->info.channels;
     nsamples = ffmpegdec->frame->nb_samples;
     byte_per_sample = ffmpegdec->info.finfo->width / 8;
-    planar = av_sample_fmt_is_planar (ffmpegdec->context->sample_fmt);
+    planar = av_sample_fmt_is_planar (ffmpegdec->frame->format);
 
-    g_return_val_if_fail (ffmpegdec->info.layout == (planar ?
+    g_return_val_if_fail (ffmpegdec->mixer
+        || ffmpegdec->info.layout == (planar ?
             GST_AUDIO_LAYOUT_NON_INTERLEAVED : GST_AUDIO_LAYOUT_INTERLEAVED),
         GST_FLOW_NOT_NEGOTIATED);
 
-    GST_DEBUG_OBJECT (ffmpegdec, "Creating output buffer");
-
-    /* ffmpegdec->frame->linesize[0] might contain padding, allocate only what's needed */
+    /* ffmpegdec->frame->linesize[0] might contain padding, use only what's needed */
     output_size = nsamples * byte_per_sample * channels;
 
-    *outbuf =
-        gst_audio_decoder_allocate_output_buffer (GST_AUDIO_DECODER
-        (ffmpegdec), output_size);
-
-    if (planar) {
-      gint i;
-      GstAudioMeta *meta;
-
-      meta = gst_buffer_add_audio_meta (*outbuf, &ffmpegdec->info, nsamples,
-          NULL);
+    /* planar samples are reordered by permuting the planes, interleaved
+     * ones while copying them out of the libav buffer */
+    *outbuf = NULL;
+    if (ffmpegdec->mixer) {
+      GstMapInfo map;
+      gpointer out[1];
+
+      GST_CAT_TRACE_OBJECT (GST_CAT_PERFORMANCE, ffmpegdec,
+          "Downmixing decoded samples to output buffer");
+
+      *outbuf =
+          gst_audio_decoder_allocate_output_buffer (GST_AUDIO_DECODER
+          (ffmpegdec), output_size);
+      gst_buffer_map (*outbuf, &map, GST_MAP_WRITE);
+      out[0] = map.data;
+      gst_audio_channel_mixer_samples (ffmpegdec->mixer,
+          (const gpointer *) ffmpegdec->frame->extended_data, out, nsamples);
+      gst_buffer_unmap (*outbuf, &map);
+    } else if (!ffmpegdec->needs_reorder || planar) {
+      GST_DEBUG_OBJECT (ffmpegdec, "Wrapping decoded frame");
+      *outbuf = gst_ffmpegauddec_wrap_frame (ffmpegdec, ffmpegdec->frame,
+          nsamples, planar);
+    }
 
-      for (i = 0; i < channels; i++) {
-        gst_buffer_fill (*outbuf, meta->offsets[i],
-            ffmpegdec->frame->extended_data[i], nsamples * byte_per_sample);
+    if (*outbuf == NULL) {
+      GST_DEBUG_OBJECT (ffmpegdec, "Creating output buffer");
+      GST_CAT_TRACE_OBJECT (GST_CAT_PERFORMANCE, ffmpegdec,
+          "Copy decoded samples to output buffer");
+
+      *outbuf =
+          gst_audio_decoder_allocate_output_buffer (GST_AUDIO_DECODER
+          (ffmpegdec), output_size);
+
+      if (planar) {
+        gint i;
+        GstAudioMeta *meta;
+
+        meta = gst_buffer_add_audio_meta (*outbuf, &ffmpegdec->info, nsamples,
+            NULL);
+
+        for (i = 0; i < channels; i++) {
+          gint plane =
+              ffmpegdec->needs_reorder ? ffmpegdec->channel_order[i] : i;
+
+          gst_buffer_fill (*outbuf, meta->offsets[i],
+              ffmpegdec->frame->extended_data[plane],
+              nsamples * byte_per_sample);
+        }
+      } else if (ffmpegdec->needs_reorder) {
+        GstMapInfo map;
+
+        gst_buffer_map (*outbuf, &map, GST_MAP_WRITE);
+        if (!gst_ffmpeg_reorder_copy (map.data, ffmpegdec->frame->data[0],
+                nsamples, channels, ffmpegdec->info.finfo->width,
+                ffmpegdec->channel_order)) {
+          memcpy (map.data, ffmpegdec->frame->data[0], output_size);
+          gst_audio_reorder_channels (map.data, output_size,
+              ffmpegdec->info.finfo->format, channels,
+              ffmpegdec->ffmpeg_layout, ffmpegdec->info.position);
+        }
+        gst_buffer_unmap (*outbuf, &map);
+      } else {
+        gst_buffer_fill (*outbuf, 0, ffmpegdec->frame->data[0], output_size);
       }
-    } else {
-      gst_buffer_fill (*outbuf, 0, ffmpegdec->frame->data[0], output_size);
     }
 
     GST_DEBUG_OBJECT (ffmpegdec, "Buffer created. Size: %" G_GSIZE_FORMAT,
         output_size);
 
-    /* Reorder channels to the GStreamer channel order */
-    if (ffmpegdec->needs_reorder) {
-      *outbuf = gst_buffer_make_writable (*outbuf);
-      gst_audio_buffer_reorder_channels (*outbuf, ffmpegdec->info.finfo->format,
-          ffmpegdec->info.channels, ffmpegdec->ffmpeg_layout,
-          ffmpegdec->info.position);
-    }
-
     /* Mark corrupted frames as corrupted */
     if (ffmpegdec->frame->flags & AV_FRAME_FLAG_CORRUPT)
       GST_BUFFER_FLAG_SET (*outbuf, GST_BUFFER_FLAG_CORRUPTED);
@@ -574,7 +1302,19 @@ gst_ffmpegauddec_frame (GstFFMpegAudDec * ffmpegdec, GstFlowReturn * ret)
   got_frame =
       gst_ffmpegauddec_audio_frame (ffmpegdec, oclass->in_plugin, &outbuf, ret);
 
-  if (outbuf) {
+  if (outbuf && ffmpegdec->min_output_duration > 0) {
+    GST_LOG_OBJECT (ffmpegdec, "Decoded data, queueing buffer %"
+        GST_PTR_FORMAT, outbuf);
+    if (!ffmpegdec->pending)
+      ffmpegdec->pending = gst_buffer_list_new ();
+    ffmpegdec->pending_samples +=
+        gst_buffer_get_size (outbuf) / ffmpegdec->info.bpf;
+    gst_buffer_list_add (ffmpegdec->pending, outbuf);
+
+    if (gst_util_uint64_scale_int (ffmpegdec->pending_samples, GST_SECOND,
+            ffmpegdec->info.rate) >= ffmpegdec->min_output_duration)
+      *ret = gst_ffmpegauddec_push_pending (ffmpegdec);
+  } else if (outbuf) {
     GST_LOG_OBJECT (ffmpegdec, "Decoded data, buffer %" GST_PTR_FORMAT, outbuf);
     *ret =
         gst_audio_decoder_finish_subframe (GST_AUDIO_DECODER_CAST (ffmpegdec),
@@ -594,6 +1334,154 @@ no_codec:
   }
 }
 
+static void
+gst_ffmpegauddec_clear_pending (GstFFMpegAudDec * ffmpegdec)
+{
+  if (ffmpegdec->pending) {
+    gst_buffer_list_unref (ffmpegdec->pending);
+    ffmpegdec->pending = NULL;
+  }
+  ffmpegdec->pending_samples = 0;
+  ffmpegdec->pending_inputs = 0;
+}
+
+/* merges the queued output buffers, they all have the current format */
+static GstBuffer *
+gst_ffmpegauddec_merge_pending (GstFFMpegAudDec * ffmpegdec)
+{
+  GstBufferList *list = ffmpegdec->pending;
+  guint i, n = gst_buffer_list_length (list);
+  GstBuffer *outbuf;
+
+  if (n == 1)
+    return gst_buffer_ref (gst_buffer_list_get (list, 0));
+
+  if (ffmpegdec->info.layout == GST_AUDIO_LAYOUT_INTERLEAVED) {
+    /* just collect the memories, no copy unless there are too many */
+    outbuf = gst_buffer_new ();
+    for (i = 0; i < n; i++) {
+      GstBuffer *buf = gst_buffer_list_get (list, i);
+
+      gst_buffer_copy_into (outbuf, buf, GST_BUFFER_COPY_MEMORY, 0, -1);
+      if (GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_CORRUPTED))
+        GST_BUFFER_FLAG_SET (outbuf, GST_BUFFER_FLAG_CORRUPTED);
+    }
+  } else {
+    GstAudioBuffer dst;
+    gint c, offset = 0;
+    gint bps = ffmpegdec->info.finfo->width / 8;
+
+    GST_CAT_TRACE_OBJECT (GST_CAT_PERFORMANCE, ffmpegdec,
+        "Copy planar samples to merge them");
+
+    outbuf = gst_audio_decoder_allocate_output_buffer (GST_AUDIO_DECODER
+        (ffmpegdec), ffmpegdec->pending_samples * ffmpegdec->info.bpf);
+    gst_buffer_add_audio_meta (outbuf, &ffmpegdec->info,
+        ffmpegdec->pending_samples, NULL);
+    if (!gst_audio_buffer_map (&dst, &ffmpegdec->info, outbuf, GST_MAP_WRITE))
+      goto map_failed;
+
+    for (i = 0; i < n; i++) {
+      GstBuffer *buf = gst_buffer_list_get (list, i);
+      GstAudioBuffer src;
+
+      if (!gst_audio_buffer_map (&src, &ffmpegdec->info, buf, GST_MAP_READ)) {
+        gst_audio_buffer_unmap (&dst);
+        goto map_failed;
+      }
+      for (c = 0; c < dst.n_planes; c++)
+        memcpy ((guint8 *) dst.planes[c] + offset * bps, src.planes[c],
+            src.n_samples * bps);
+      offset += src.n_samples;
+      gst_audio_buffer_unmap (&src);
+
+      if (GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_CORRUPTED))
+        GST_BUFFER_FLAG_SET (outbuf, GST_BUFFER_FLAG_CORRUPTED);
+    }
+    gst_audio_buffer_unmap (&dst);
+  }
+
+  return outbuf;
+
+map_failed:
+  {
+    GST_ERROR_OBJECT (ffmpegdec, "failed to map buffers to merge");
+    gst_buffer_unref (outbuf);
+    return NULL;
+  }
+}
+
+static GstFlowReturn
+gst_ffmpegauddec_push_pending (GstFFMpegAudDec * ffmpegdec)
+{
+  GstAudioDecoder *decoder = GST_AUDIO_DECODER_CAST (ffmpegdec);
+  GstFlowReturn ret = GST_FLOW_ERROR;
+  GstBuffer *outbuf;
+  gint inputs = ffmpegdec->pending_inputs;
+
+  if (!ffmpegdec->pending)
+    return GST_FLOW_OK;
+
+  GST_LOG_OBJECT (ffmpegdec, "pushing %u merged buffers, %d samples",
+      gst_buffer_list_length (ffmpegdec->pending), ffmpegdec->pending_samples);
+
+  outbuf = gst_ffmpegauddec_merge_pending (ffmpegdec);
+  gst_ffmpegauddec_clear_pending (ffmpegdec);
+
+  if (outbuf)
+    ret = gst_audio_decoder_finish_subframe (decoder, outbuf);
+
+  /* and now the input frames that produced it */
+  if (inputs > 0) {
+    GstFlowReturn new_ret = gst_audio_decoder_finish_frame (decoder, NULL,
+        inputs);
+
+    if (ret == GST_FLOW_OK)
+      ret = new_ret;
+  }
+
+  return ret;
+}
+
+static void
+gst_ffmpegauddec_set_property (GObject * object,
+    guint prop_id, const GValue * value, GParamSpec * pspec)
+{
+  GstFFMpegAudDec *ffmpegdec = (GstFFMpegAudDec *) object;
+
+  switch (prop_id) {
+    case PROP_MIN_OUTPUT_DURATION:
+      ffmpegdec->min_output_duration = g_value_get_uint64 (value);
+      gst_ffmpegauddec_update_latency (ffmpegdec);
+      break;
+    case PROP_PARALLEL_CONTEXTS:
+      ffmpegdec->parallel_contexts = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_ffmpegauddec_get_property (GObject * object,
+    guint prop_id, GValue * value, GParamSpec * pspec)
+{
+  GstFFMpegAudDec *ffmpegdec = (GstFFMpegAudDec *) object;
+
+  switch (prop_id) {
+    case PROP_MIN_OUTPUT_DURATION:
+      g_value_set_uint64 (value, ffmpegdec->min_output_duration);
+      break;
+    case PROP_PARALLEL_CONTEXTS:
+      g_value_set_uint (value, ffmpegdec->parallel_contexts);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
 static GstFlowReturn
 gst_ffmpegauddec_drain (GstFFMpegAudDec * ffmpegdec)
 {
@@ -601,15 +1489,27 @@ gst_ffmpegauddec_drain (GstFFMpegAudDec * ffmpegdec)
   gboolean got_any_frames = FALSE;
   gboolean got_frame;
 
-  if (avcodec_send_packet (ffmpegdec->context, NULL))
-    goto send_packet_failed;
+  if (ffmpegdec->parallel_pool) {
+    /* the workers keep nothing back, just wait for them */
+    ret = gst_ffmpegauddec_parallel_output (ffmpegdec, 0);
+  } else {
+    if (avcodec_send_packet (ffmpegdec->context, NULL))
+      goto send_packet_failed;
+
+    do {
+      got_frame = gst_ffmpegauddec_frame (ffmpegdec, &ret);
+      if (got_frame)
+        got_any_frames = TRUE;
+    } while (got_frame);
+    avcodec_flush_buffers (ffmpegdec->context);
+  }
 
-  do {
-    got_frame = gst_ffmpegauddec_frame (ffmpegdec, &ret);
-    if (got_frame)
-      got_any_frames = TRUE;
-  } while (got_frame);
-  avcodec_flush_buffers (ffmpegdec->context);
+  if (ffmpegdec->pending) {
+    GstFlowReturn new_ret = gst_ffmpegauddec_push_pending (ffmpegdec);
+
+    if (ret == GST_FLOW_OK)
+      ret = new_ret;
+  }
 
   if (got_any_frames) {
     GstFlowReturn new_ret =
@@ -635,6 +1535,36 @@ gst_ffmpegauddec_flush (GstAudioDecoder * decoder, gboolean hard)
   if (ffmpegdec->opened) {
     avcodec_flush_buffers (ffmpegdec->context);
   }
+  if (ffmpegdec->parallel_pool)
+    gst_ffmpegauddec_parallel_discard (ffmpegdec);
+  gst_ffmpegauddec_clear_pending (ffmpegdec);
+}
+
+/* finishes the input frame once it was decoded, if it was consumed */
+static GstFlowReturn
+gst_ffmpegauddec_finish_input (GstFFMpegAudDec * ffmpegdec, gboolean consumed,
+    GstFlowReturn ret)
+{
+  if (ffmpegdec->pending && consumed) {
+    /* the input is finished when the output it produced is pushed, so that
+     * the baseclass timestamps the merged buffer from the first one */
+    ffmpegdec->pending_inputs++;
+  } else if (consumed) {
+    /* Even if previous return wasn't GST_FLOW_OK, we need to call
+     * _finish_frame() since baseclass is expecting that _finish_frame()
+     * is followed by _finish_subframe()
+     */
+    GstFlowReturn new_ret =
+        gst_audio_decoder_finish_frame (GST_AUDIO_DECODER (ffmpegdec), NULL, 1);
+
+    /* Only override the flow return value if previously did have a GST_FLOW_OK.
+     * Failure to do this would result in skipping downstream issues caught in
+     * earlier steps. */
+    if (ret == GST_FLOW_OK)
+      ret = new_ret;
+  }
+
+  return ret;
 }
 
 static GstFlowReturn
@@ -660,6 +1590,9 @@ gst_ffmpegauddec_handle_frame (GstAudioDecoder * decoder, GstBuffer * inbuf)
     return gst_ffmpegauddec_drain (ffmpegdec);
   }
 
+  if (ffmpegdec->parallel_pool)
+    return gst_ffmpegauddec_parallel_handle_frame (ffmpegdec, inbuf);
+
   inbuf = gst_buffer_ref (inbuf);
   is_header = GST_BUFFER_FLAG_IS_SET (inbuf, GST_BUFFER_FLAG_HEADER);
 
@@ -686,6 +1619,9 @@ gst_ffmpegauddec_handle_frame (GstAudioDecoder * decoder, GstBuffer * inbuf)
   data = map.data;
   size = map.size;
 
+  if (size > 0)
+    ffmpegdec->n_packets++;
+
   if (size > 0 && (!GST_MEMORY_IS_ZERO_PADDED (map.memory)
           || (map.maxsize - map.size) < AV_INPUT_BUFFER_PADDING_SIZE)) {
     /* add padding */
@@ -695,8 +1631,14 @@ gst_ffmpegauddec_handle_frame (GstAudioDecoder * decoder, GstBuffer * inbuf)
       GST_LOG_OBJECT (ffmpegdec, "resized padding buffer to %d",
           ffmpegdec->padded_size);
     }
+    ffmpegdec->n_padding_copies++;
+    if (ffmpegdec->n_padding_copies == 1)
+      GST_CAT_DEBUG_OBJECT (GST_CAT_PERFORMANCE, ffmpegdec,
+          "Input memory is not padded, copying it");
     GST_CAT_TRACE_OBJECT (GST_CAT_PERFORMANCE, ffmpegdec,
-        "Copy input to add padding");
+        "Copy input to add padding (%" G_GUINT64_FORMAT " of %"
+        G_GUINT64_FORMAT " packets so far)", ffmpegdec->n_padding_copies,
+        ffmpegdec->n_packets);
     memcpy (ffmpegdec->padded, data, size);
     memset (ffmpegdec->padded + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
 
@@ -727,20 +1669,8 @@ gst_ffmpegauddec_handle_frame (GstAudioDecoder * decoder, GstBuffer * inbuf)
     }
   } while (got_frame);
 
-  if (is_header || got_any_frames) {
-    /* Even if previous return wasn't GST_FLOW_OK, we need to call
-     * _finish_frame() since baseclass is expecting that _finish_frame()
-     * is followed by _finish_subframe()
-     */
-    GstFlowReturn new_ret =
-        gst_audio_decoder_finish_frame (GST_AUDIO_DECODER (ffmpegdec), NULL, 1);
-
-    /* Only override the flow return value if previously did have a GST_FLOW_OK.
-     * Failure to do this would result in skipping downstream issues caught in
-     * earlier steps. */
-    if (ret == GST_FLOW_OK)
-      ret = new_ret;
-  }
+  ret = gst_ffmpegauddec_finish_input (ffmpegdec, is_header
+      || got_any_frames, ret);
 
 unmap:
   gst_buffer_unmap (inbuf, &map);
@@ -27,6 +27,8 @@ G_BEGIN_DECLS
 #include <gst/audio/audio.h>
 #include <libavcodec/avcodec.h>
 
+#include "gstavutils.h"
+
 typedef struct _GstFFMpegAudDec GstFFMpegAudDec;
 struct _GstFFMpegAudDec
 {
@@ -40,6 +42,9 @@ struct _GstFFMpegAudDec
 
   guint8 *padded;
   gint padded_size;
+  /* number of input packets, and of those copied to add padding */
+  guint64 n_packets;
+  guint64 n_padding_copies;
 
   /* prevent reopening the decoder on GST_EVENT_CAPS when caps are same as last time. */
   GstCaps *last_caps;
@@ -48,6 +53,38 @@ struct _GstFFMpegAudDec
   GstAudioInfo info;
   GstAudioChannelPosition ffmpeg_layout[64];
   gboolean needs_reorder;
+  /* output channel i is libav channel channel_order[i] */
+  gint channel_order[64];
+
+  /* channel count and layout of the decoded frames, only differ from the
+   * output ones when downmixing */
+  gint frame_channels;
+  GstAudioLayout frame_layout;
+
+  /* channel count downstream wants, 0 if any, and the mixer for decoders
+   * that ignore request_channel_layout */
+  gint downmix_channels;
+  GstAudioChannelMixer *mixer;
+
+  /* output aggregation, see min-output-duration */
+  GstClockTime min_output_duration;
+  GstBufferList *pending;
+  gint pending_samples;
+  gint pending_inputs;
+
+  /* decoding of independent frames on worker threads, see
+   * parallel-contexts. Jobs are queued in input order, the one whose frames
+   * are being output is current_job. Jobs and their decoded frames are
+   * recycled */
+  guint parallel_contexts;
+  GThreadPool *parallel_pool;
+  GAsyncQueue *idle_workers;
+  GstFFMpegFreeList *job_list;
+  GstFFMpegFreeList *job_frame_list;
+  GMutex parallel_lock;
+  GCond parallel_cond;
+  GQueue parallel_jobs;
+  gpointer current_job;
 };
 
 typedef struct _GstFFMpegAudDecClass GstFFMpegAudDecClass;
@@ -39,11 +39,15 @@
 #include "gstavcfg.h"
 #include "gstavcodecmap.h"
 #include "gstavutils.h"
+#include "gstavconvert.h"
 #include "gstavaudenc.h"
 
+#define DEFAULT_CONVERT                 FALSE
+
 enum
 {
   PROP_0,
+  PROP_CONVERT,
   PROP_CFG_BASE,
 };
 
@@ -59,6 +63,8 @@ static GstFlowReturn gst_ffmpegaudenc_handle_frame (GstAudioEncoder * encoder,
 static gboolean gst_ffmpegaudenc_start (GstAudioEncoder * encoder);
 static gboolean gst_ffmpegaudenc_stop (GstAudioEncoder * encoder);
 static void gst_ffmpegaudenc_flush (GstAudioEncoder * encoder);
+static GstCaps *gst_ffmpegaudenc_getcaps (GstAudioEncoder * encoder,
+    GstCaps * filter);
 
 static void gst_ffmpegaudenc_set_property (GObject * object,
     guint prop_id, const GValue * value, GParamSpec * pspec);
@@ -105,6 +111,38 @@ gst_ffmpegaudenc_base_init (GstFFMpegAudEncClass * klass)
     sinkcaps = gst_caps_new_empty_simple ("unknown/unknown");
   }
 
+  /* with the convert property the encoder also takes all the sample formats,
+   * the instances only offer them when it is set */
+  klass->native_caps = gst_caps_ref (sinkcaps);
+  if (in_plugin->sample_fmts) {
+    GstCaps *convcaps = gst_caps_copy (sinkcaps);
+    GValue formats = G_VALUE_INIT, layouts = G_VALUE_INIT, v = G_VALUE_INIT;
+    gint i;
+
+    g_value_init (&formats, GST_TYPE_LIST);
+    g_value_init (&layouts, GST_TYPE_LIST);
+    g_value_init (&v, G_TYPE_STRING);
+    for (i = 0; i <= AV_SAMPLE_FMT_DBL; i++) {
+      GstAudioFormat format = gst_ffmpeg_smpfmt_to_audioformat (i, NULL);
+
+      if (format == GST_AUDIO_FORMAT_UNKNOWN)
+        continue;
+      g_value_set_string (&v, gst_audio_format_to_string (format));
+      gst_value_list_append_value (&formats, &v);
+    }
+    g_value_set_string (&v, "interleaved");
+    gst_value_list_append_value (&layouts, &v);
+    g_value_set_string (&v, "non-interleaved");
+    gst_value_list_append_value (&layouts, &v);
+    gst_caps_set_value (convcaps, "format", &formats);
+    gst_caps_set_value (convcaps, "layout", &layouts);
+    g_value_unset (&v);
+    g_value_unset (&layouts);
+    g_value_unset (&formats);
+
+    sinkcaps = gst_caps_merge (sinkcaps, convcaps);
+  }
+
   /* pad templates */
   sinktempl = gst_pad_template_new ("sink", GST_PAD_SINK,
       GST_PAD_ALWAYS, sinkcaps);
@@ -137,6 +175,12 @@ gst_ffmpegaudenc_class_init (GstFFMpegAudEncClass * klass)
   gobject_class->set_property = gst_ffmpegaudenc_set_property;
   gobject_class->get_property = gst_ffmpegaudenc_get_property;
 
+  g_object_class_install_property (gobject_class, PROP_CONVERT,
+      g_param_spec_boolean ("convert", "Convert",
+          "Accept all the raw sample formats and convert them to the closest "
+          "format the codec takes", DEFAULT_CONVERT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gst_ffmpeg_cfg_install_properties (gobject_class, klass->in_plugin,
       PROP_CFG_BASE, AV_OPT_FLAG_ENCODING_PARAM | AV_OPT_FLAG_AUDIO_PARAM);
 
@@ -149,6 +193,30 @@ gst_ffmpegaudenc_class_init (GstFFMpegAudEncClass * klass)
       GST_DEBUG_FUNCPTR (gst_ffmpegaudenc_set_format);
   gstaudioencoder_class->handle_frame =
       GST_DEBUG_FUNCPTR (gst_ffmpegaudenc_handle_frame);
+  gstaudioencoder_class->getcaps = GST_DEBUG_FUNCPTR (gst_ffmpegaudenc_getcaps);
+}
+
+typedef struct
+{
+  GstBuffer *buffer;
+  GstMapInfo map;
+  /* non-interleaved input is mapped plane by plane instead */
+  GstAudioBuffer abuf;
+  gboolean planes_mapped;
+
+  /* deinterleaving scratch, kept when the info is recycled */
+  guint8 **ext_data_array, *ext_data;
+  gint n_ext_data_array;
+  guint ext_data_size;
+} BufferInfo;
+
+static void
+buffer_info_clear (gpointer data)
+{
+  BufferInfo *info = data;
+
+  av_free (info->ext_data);
+  av_free (info->ext_data_array);
 }
 
 static void
@@ -164,6 +232,13 @@ gst_ffmpegaudenc_init (GstFFMpegAudEnc * ffmpegaudenc)
   ffmpegaudenc->refcontext = avcodec_alloc_context3 (klass->in_plugin);
   ffmpegaudenc->opened = FALSE;
   ffmpegaudenc->frame = av_frame_alloc ();
+  ffmpegaudenc->convert = DEFAULT_CONVERT;
+  ffmpegaudenc->buffer_info_list =
+      gst_ffmpeg_free_list_new (G_OBJECT_TYPE_NAME (ffmpegaudenc),
+      sizeof (BufferInfo), buffer_info_clear);
+  ffmpegaudenc->packet_list =
+      gst_ffmpeg_free_list_new (G_OBJECT_TYPE_NAME (ffmpegaudenc),
+      sizeof (AVPacket), NULL);
 
   gst_audio_encoder_set_drainable (GST_AUDIO_ENCODER (ffmpegaudenc), TRUE);
 }
@@ -180,6 +255,10 @@ gst_ffmpegaudenc_finalize (GObject * object)
   av_free (ffmpegaudenc->context);
   av_free (ffmpegaudenc->refcontext);
 
+  /* output buffers still in use keep the lists alive */
+  gst_ffmpeg_free_list_unref (ffmpegaudenc->buffer_info_list);
+  gst_ffmpeg_free_list_unref (ffmpegaudenc->packet_list);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -209,6 +288,11 @@ gst_ffmpegaudenc_stop (GstAudioEncoder * encoder)
   gst_ffmpeg_avcodec_close (ffmpegaudenc->context);
   ffmpegaudenc->opened = FALSE;
 
+  if (ffmpegaudenc->converter) {
+    gst_ffmpeg_audio_converter_free (ffmpegaudenc->converter);
+    ffmpegaudenc->converter = NULL;
+  }
+
   return TRUE;
 }
 
@@ -222,6 +306,70 @@ gst_ffmpegaudenc_flush (GstAudioEncoder * encoder)
   }
 }
 
+static GstCaps *
+gst_ffmpegaudenc_getcaps (GstAudioEncoder * encoder, GstCaps * filter)
+{
+  GstFFMpegAudEnc *ffmpegaudenc = (GstFFMpegAudEnc *) encoder;
+  GstFFMpegAudEncClass *oclass =
+      (GstFFMpegAudEncClass *) G_OBJECT_GET_CLASS (ffmpegaudenc);
+
+  return gst_audio_encoder_proxy_getcaps (encoder,
+      ffmpegaudenc->convert ? NULL : oclass->native_caps, filter);
+}
+
+/* the libav sample format of the input */
+static enum AVSampleFormat
+gst_ffmpegaudenc_get_sample_fmt (GstAudioInfo * info)
+{
+  enum AVSampleFormat sample_fmt;
+
+  switch (GST_AUDIO_INFO_FORMAT (info)) {
+    case GST_AUDIO_FORMAT_U8:
+      sample_fmt = AV_SAMPLE_FMT_U8;
+      break;
+    case GST_AUDIO_FORMAT_S16:
+      sample_fmt = AV_SAMPLE_FMT_S16;
+      break;
+    case GST_AUDIO_FORMAT_S32:
+      sample_fmt = AV_SAMPLE_FMT_S32;
+      break;
+    case GST_AUDIO_FORMAT_F32:
+      sample_fmt = AV_SAMPLE_FMT_FLT;
+      break;
+    case GST_AUDIO_FORMAT_F64:
+      sample_fmt = AV_SAMPLE_FMT_DBL;
+      break;
+    default:
+      return AV_SAMPLE_FMT_NONE;
+  }
+
+  if (GST_AUDIO_INFO_LAYOUT (info) == GST_AUDIO_LAYOUT_NON_INTERLEAVED)
+    sample_fmt = av_get_planar_sample_fmt (sample_fmt);
+
+  return sample_fmt;
+}
+
+/* whether the codec takes the format directly, or after deinterleaving */
+static gboolean
+gst_ffmpegaudenc_sample_fmt_supported (AVCodec * codec,
+    enum AVSampleFormat sample_fmt)
+{
+  const enum AVSampleFormat *fmts = codec->sample_fmts;
+
+  if (!fmts)
+    return TRUE;
+
+  for (; *fmts != -1; fmts++) {
+    if (*fmts == sample_fmt)
+      return TRUE;
+    if (!av_sample_fmt_is_planar (sample_fmt)
+        && *fmts == av_get_planar_sample_fmt (sample_fmt))
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
 static gboolean
 gst_ffmpegaudenc_set_format (GstAudioEncoder * encoder, GstAudioInfo * info)
 {
@@ -230,6 +378,9 @@ gst_ffmpegaudenc_set_format (GstAudioEncoder * encoder, GstAudioInfo * info)
   GstCaps *allowed_caps;
   GstCaps *icaps;
   gsize frame_size;
+  GstAudioInfo codec_info;
+  enum AVSampleFormat in_fmt;
+  gboolean needs_convert;
   GstFFMpegAudEncClass *oclass =
       (GstFFMpegAudEncClass *) G_OBJECT_GET_CLASS (ffmpegaudenc);
 
@@ -244,10 +395,48 @@ gst_ffmpegaudenc_set_format (GstAudioEncoder * encoder, GstAudioInfo * info)
     }
   }
 
+  if (ffmpegaudenc->converter) {
+    gst_ffmpeg_audio_converter_free (ffmpegaudenc->converter);
+    ffmpegaudenc->converter = NULL;
+  }
+
   gst_ffmpeg_cfg_fill_context (G_OBJECT (ffmpegaudenc), ffmpegaudenc->context);
 
+  /* formats the codec doesn't take are converted to its first one */
+  codec_info = *info;
+  in_fmt = gst_ffmpegaudenc_get_sample_fmt (info);
+  needs_convert =
+      !gst_ffmpegaudenc_sample_fmt_supported (oclass->in_plugin, in_fmt);
+  if (needs_convert) {
+    const enum AVSampleFormat *fmts;
+    GstAudioFormat format = GST_AUDIO_FORMAT_UNKNOWN;
+    GstAudioLayout layout = GST_AUDIO_LAYOUT_INTERLEAVED;
+
+    for (fmts = oclass->in_plugin->sample_fmts;
+        *fmts != -1 && format == GST_AUDIO_FORMAT_UNKNOWN; fmts++)
+      format = gst_ffmpeg_smpfmt_to_audioformat (*fmts, &layout);
+
+    if (!ffmpegaudenc->convert || format == GST_AUDIO_FORMAT_UNKNOWN) {
+      GST_DEBUG_OBJECT (ffmpegaudenc, "avenc_%s: unsupported sample format %s",
+          oclass->in_plugin->name, av_get_sample_fmt_name (in_fmt));
+      return FALSE;
+    }
+    codec_info.finfo = gst_audio_format_get_info (format);
+    codec_info.layout = layout;
+  }
+
   /* fetch pix_fmt and so on */
-  gst_ffmpeg_audioinfo_to_context (info, ffmpegaudenc->context);
+  gst_ffmpeg_audioinfo_to_context (&codec_info, ffmpegaudenc->context);
+
+  if (needs_convert) {
+    ffmpegaudenc->converter = gst_ffmpeg_audio_converter_new (in_fmt,
+        ffmpegaudenc->context->sample_fmt, ffmpegaudenc->context->channels,
+        ffmpegaudenc->context->channel_layout,
+        ffmpegaudenc->context->sample_rate);
+    if (!ffmpegaudenc->converter)
+      return FALSE;
+  }
+
   if (!ffmpegaudenc->context->time_base.den) {
     ffmpegaudenc->context->time_base.den = GST_AUDIO_INFO_RATE (info);
     ffmpegaudenc->context->time_base.num = 1;
@@ -261,6 +450,17 @@ gst_ffmpegaudenc_set_format (GstAudioEncoder * encoder, GstAudioInfo * info)
         (memcmp (ffmpegaudenc->ffmpeg_layout, info->position,
             sizeof (GstAudioChannelPosition) *
             ffmpegaudenc->context->channels) != 0);
+    if (ffmpegaudenc->needs_reorder) {
+      gint reorder_map[64], i;
+
+      if (!gst_audio_get_channel_reorder_map (ffmpegaudenc->context->channels,
+              info->position, ffmpegaudenc->ffmpeg_layout, reorder_map)) {
+        GST_DEBUG_OBJECT (ffmpegaudenc, "Failed to get channel reorder map");
+        return FALSE;
+      }
+      for (i = 0; i < ffmpegaudenc->context->channels; i++)
+        ffmpegaudenc->channel_order[reorder_map[i]] = i;
+    }
   }
 
   /* some codecs support more than one format, first auto-choose one */
@@ -376,30 +576,25 @@ static void
 gst_ffmpegaudenc_free_avpacket (gpointer pkt)
 {
   av_packet_unref ((AVPacket *) pkt);
-  g_slice_free (AVPacket, pkt);
+  gst_ffmpeg_free_list_release (pkt);
 }
 
-typedef struct
-{
-  GstBuffer *buffer;
-  GstMapInfo map;
-
-  guint8 **ext_data_array, *ext_data;
-} BufferInfo;
-
 static void
 buffer_info_free (void *opaque, guint8 * data)
 {
   BufferInfo *info = opaque;
 
-  if (info->buffer) {
+  if (info->planes_mapped) {
+    gst_audio_buffer_unmap (&info->abuf);
+    gst_buffer_unref (info->buffer);
+    info->buffer = NULL;
+    info->planes_mapped = FALSE;
+  } else if (info->buffer) {
     gst_buffer_unmap (info->buffer, &info->map);
     gst_buffer_unref (info->buffer);
-  } else {
-    av_free (info->ext_data);
-    av_free (info->ext_data_array);
+    info->buffer = NULL;
   }
-  g_slice_free (BufferInfo, info);
+  gst_ffmpeg_free_list_release (info);
 }
 
 static GstFlowReturn
@@ -419,18 +614,10 @@ gst_ffmpegaudenc_send_frame (GstFFMpegAudEnc * ffmpegaudenc, GstBuffer * buffer)
   ctx = ffmpegaudenc->context;
 
   if (buffer != NULL) {
-    BufferInfo *buffer_info = g_slice_new0 (BufferInfo);
+    BufferInfo *buffer_info;
     guint8 *audio_in;
     guint in_size;
 
-    buffer_info->buffer = buffer;
-    gst_buffer_map (buffer, &buffer_info->map, GST_MAP_READ);
-    audio_in = buffer_info->map.data;
-    in_size = buffer_info->map.size;
-
-    GST_LOG_OBJECT (ffmpegaudenc, "encoding buffer %p size:%u", audio_in,
-        in_size);
-
     info = gst_audio_encoder_get_audio_info (enc);
     planar = av_sample_fmt_is_planar (ffmpegaudenc->context->sample_fmt);
     frame->format = ffmpegaudenc->context->sample_fmt;
@@ -438,91 +625,144 @@ gst_ffmpegaudenc_send_frame (GstFFMpegAudEnc * ffmpegaudenc, GstBuffer * buffer)
     frame->channels = ffmpegaudenc->context->channels;
     frame->channel_layout = ffmpegaudenc->context->channel_layout;
 
-    if (planar && info->channels > 1) {
-      gint channels;
-      gint i, j;
+    if (ffmpegaudenc->converter) {
+      const uint8_t *planes[64];
+      GstAudioBuffer abuf;
+      gboolean converted;
+      gint i;
 
-      nsamples = frame->nb_samples = in_size / info->bpf;
-      channels = info->channels;
+      if (!gst_audio_buffer_map (&abuf, info, buffer, GST_MAP_READ)) {
+        GST_ERROR_OBJECT (ffmpegaudenc, "failed to map input buffer");
+        gst_buffer_unref (buffer);
+        return GST_FLOW_ERROR;
+      }
 
-      frame->buf[0] =
-          av_buffer_create (NULL, 0, buffer_info_free, buffer_info, 0);
+      /* interleaved input was reordered already */
+      for (i = 0; i < abuf.n_planes; i++) {
+        gint plane = ffmpegaudenc->needs_reorder && abuf.n_planes > 1 ?
+            ffmpegaudenc->channel_order[i] : i;
+
+        planes[i] = abuf.planes[plane];
+      }
+
+      GST_LOG_OBJECT (ffmpegaudenc, "converting %" G_GSIZE_FORMAT " samples",
+          abuf.n_samples);
 
-      if (info->channels > AV_NUM_DATA_POINTERS) {
-        buffer_info->ext_data_array = frame->extended_data =
-            av_malloc_array (info->channels, sizeof (uint8_t *));
+      nsamples = abuf.n_samples;
+      converted = gst_ffmpeg_audio_converter_convert (ffmpegaudenc->converter,
+          planes, nsamples, frame);
+      gst_audio_buffer_unmap (&abuf);
+      gst_buffer_unref (buffer);
+
+      if (!converted) {
+        GST_ERROR_OBJECT (ffmpegaudenc, "failed to convert input buffer");
+        return GST_FLOW_ERROR;
+      }
+    } else if (GST_AUDIO_INFO_LAYOUT (info) ==
+        GST_AUDIO_LAYOUT_NON_INTERLEAVED) {
+      gint channels = info->channels;
+      gint i;
+
+      buffer_info =
+          gst_ffmpeg_free_list_alloc (ffmpegaudenc->buffer_info_list);
+      if (!gst_audio_buffer_map (&buffer_info->abuf, info, buffer,
+              GST_MAP_READ)) {
+        GST_ERROR_OBJECT (ffmpegaudenc, "failed to map input buffer");
+        gst_buffer_unref (buffer);
+        gst_ffmpeg_free_list_release (buffer_info);
+        return GST_FLOW_ERROR;
+      }
+      buffer_info->planes_mapped = TRUE;
+      buffer_info->buffer = buffer;
+
+      GST_LOG_OBJECT (ffmpegaudenc, "encoding %" G_GSIZE_FORMAT
+          " non-interleaved samples", buffer_info->abuf.n_samples);
+
+      /* the planes are passed as they are, in the libav channel order */
+      if (channels > AV_NUM_DATA_POINTERS) {
+        if (buffer_info->n_ext_data_array < channels) {
+          av_free (buffer_info->ext_data_array);
+          buffer_info->ext_data_array =
+              av_malloc_array (channels, sizeof (uint8_t *));
+          buffer_info->n_ext_data_array = channels;
+        }
+        frame->extended_data = buffer_info->ext_data_array;
       } else {
         frame->extended_data = frame->data;
       }
+      for (i = 0; i < channels; i++) {
+        gint plane =
+            ffmpegaudenc->needs_reorder ? ffmpegaudenc->channel_order[i] : i;
 
-      buffer_info->ext_data = frame->extended_data[0] = av_malloc (in_size);
-      frame->linesize[0] = in_size / channels;
-      for (i = 1; i < channels; i++)
-        frame->extended_data[i] =
-            frame->extended_data[i - 1] + frame->linesize[0];
-
-      switch (info->finfo->width) {
-        case 8:{
-          const guint8 *idata = (const guint8 *) audio_in;
-
-          for (i = 0; i < nsamples; i++) {
-            for (j = 0; j < channels; j++) {
-              ((guint8 *) frame->extended_data[j])[i] = idata[j];
-            }
-            idata += channels;
-          }
-          break;
-        }
-        case 16:{
-          const guint16 *idata = (const guint16 *) audio_in;
-
-          for (i = 0; i < nsamples; i++) {
-            for (j = 0; j < channels; j++) {
-              ((guint16 *) frame->extended_data[j])[i] = idata[j];
-            }
-            idata += channels;
-          }
-          break;
-        }
-        case 32:{
-          const guint32 *idata = (const guint32 *) audio_in;
-
-          for (i = 0; i < nsamples; i++) {
-            for (j = 0; j < channels; j++) {
-              ((guint32 *) frame->extended_data[j])[i] = idata[j];
-            }
-            idata += channels;
-          }
+        frame->extended_data[i] = buffer_info->abuf.planes[plane];
+      }
 
-          break;
-        }
-        case 64:{
-          const guint64 *idata = (const guint64 *) audio_in;
-
-          for (i = 0; i < nsamples; i++) {
-            for (j = 0; j < channels; j++) {
-              ((guint64 *) frame->extended_data[j])[i] = idata[j];
-            }
-            idata += channels;
+      nsamples = frame->nb_samples = buffer_info->abuf.n_samples;
+      frame->linesize[0] = nsamples * info->finfo->width / 8;
+      frame->buf[0] =
+          av_buffer_create (NULL, 0, buffer_info_free, buffer_info, 0);
+    } else {
+      buffer_info =
+          gst_ffmpeg_free_list_alloc (ffmpegaudenc->buffer_info_list);
+      buffer_info->buffer = buffer;
+      gst_buffer_map (buffer, &buffer_info->map, GST_MAP_READ);
+      audio_in = buffer_info->map.data;
+      in_size = buffer_info->map.size;
+
+      GST_LOG_OBJECT (ffmpegaudenc, "encoding buffer %p size:%u", audio_in,
+          in_size);
+
+      if (planar && info->channels > 1) {
+        gint channels;
+        gint i;
+
+        nsamples = frame->nb_samples = in_size / info->bpf;
+        channels = info->channels;
+
+        frame->buf[0] =
+            av_buffer_create (NULL, 0, buffer_info_free, buffer_info, 0);
+
+        if (info->channels > AV_NUM_DATA_POINTERS) {
+          if (buffer_info->n_ext_data_array < info->channels) {
+            av_free (buffer_info->ext_data_array);
+            buffer_info->ext_data_array =
+                av_malloc_array (info->channels, sizeof (uint8_t *));
+            buffer_info->n_ext_data_array = info->channels;
           }
+          frame->extended_data = buffer_info->ext_data_array;
+        } else {
+          frame->extended_data = frame->data;
+        }
 
-          break;
+        if (buffer_info->ext_data_size < in_size) {
+          av_free (buffer_info->ext_data);
+          buffer_info->ext_data = av_malloc (in_size);
+          buffer_info->ext_data_size = in_size;
         }
-        default:
+        frame->extended_data[0] = buffer_info->ext_data;
+        frame->linesize[0] = in_size / channels;
+        for (i = 1; i < channels; i++)
+          frame->extended_data[i] =
+              frame->extended_data[i - 1] + frame->linesize[0];
+
+        /* channels are reordered while splitting them */
+        if (!gst_ffmpeg_deinterleave (frame->extended_data, audio_in,
+                nsamples, channels, info->finfo->width,
+                ffmpegaudenc->needs_reorder ? ffmpegaudenc->channel_order :
+                NULL))
           g_assert_not_reached ();
-          break;
-      }
 
-      gst_buffer_unmap (buffer, &buffer_info->map);
-      gst_buffer_unref (buffer);
-      buffer_info->buffer = NULL;
-    } else {
-      frame->data[0] = audio_in;
-      frame->extended_data = frame->data;
-      frame->linesize[0] = in_size;
-      frame->nb_samples = nsamples = in_size / info->bpf;
-      frame->buf[0] =
-          av_buffer_create (NULL, 0, buffer_info_free, buffer_info, 0);
+        gst_buffer_unmap (buffer, &buffer_info->map);
+        gst_buffer_unref (buffer);
+        buffer_info->buffer = NULL;
+      } else {
+        frame->data[0] = audio_in;
+        frame->extended_data = frame->data;
+        frame->linesize[0] = in_size;
+        frame->nb_samples = nsamples = in_size / info->bpf;
+        frame->buf[0] =
+            av_buffer_create (NULL, 0, buffer_info_free, buffer_info, 0);
+      }
     }
 
     /* we have a frame to feed the encoder */
@@ -561,7 +801,7 @@ gst_ffmpegaudenc_receive_packet (GstFFMpegAudEnc * ffmpegaudenc,
 
   ctx = ffmpegaudenc->context;
 
-  pkt = g_slice_new0 (AVPacket);
+  pkt = gst_ffmpeg_free_list_alloc (ffmpegaudenc->packet_list);
 
   res = avcodec_receive_packet (ctx, pkt);
 
@@ -580,7 +820,7 @@ gst_ffmpegaudenc_receive_packet (GstFFMpegAudEnc * ffmpegaudenc,
     *got_packet = TRUE;
   } else {
     GST_LOG_OBJECT (ffmpegaudenc, "no output produced");
-    g_slice_free (AVPacket, pkt);
+    gst_ffmpeg_free_list_release (pkt);
     ret = GST_FLOW_OK;
     *got_packet = FALSE;
   }
@@ -631,8 +871,13 @@ gst_ffmpegaudenc_handle_frame (GstAudioEncoder * encoder, GstBuffer * inbuf)
       ", size %" G_GSIZE_FORMAT, GST_TIME_ARGS (GST_BUFFER_TIMESTAMP (inbuf)),
       GST_TIME_ARGS (GST_BUFFER_DURATION (inbuf)), gst_buffer_get_size (inbuf));
 
-  /* Reorder channels to the GStreamer channel order */
-  if (ffmpegaudenc->needs_reorder) {
+  /* Reorder channels to the libav channel order, planar input is reordered
+   * while deinterleaving it */
+  if (ffmpegaudenc->needs_reorder
+      && (!av_sample_fmt_is_planar (ffmpegaudenc->context->sample_fmt)
+          || ffmpegaudenc->context->channels == 1 || ffmpegaudenc->converter)
+      && GST_AUDIO_INFO_LAYOUT (gst_audio_encoder_get_audio_info (encoder)) ==
+      GST_AUDIO_LAYOUT_INTERLEAVED) {
     GstAudioInfo *info = gst_audio_encoder_get_audio_info (encoder);
 
     inbuf = gst_buffer_make_writable (inbuf);
@@ -682,6 +927,9 @@ gst_ffmpegaudenc_set_property (GObject * object,
   }
 
   switch (prop_id) {
+    case PROP_CONVERT:
+      ffmpegaudenc->convert = g_value_get_boolean (value);
+      break;
     default:
       if (!gst_ffmpeg_cfg_set_property (ffmpegaudenc->refcontext, value, pspec))
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -698,6 +946,9 @@ gst_ffmpegaudenc_get_property (GObject * object,
   ffmpegaudenc = (GstFFMpegAudEnc *) (object);
 
   switch (prop_id) {
+    case PROP_CONVERT:
+      g_value_set_boolean (value, ffmpegaudenc->convert);
+      break;
     default:
       if (!gst_ffmpeg_cfg_get_property (ffmpegaudenc->refcontext, value, pspec))
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
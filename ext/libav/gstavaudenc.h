@@ -28,6 +28,9 @@
 #include <gst/audio/gstaudioencoder.h>
 #include <libavcodec/avcodec.h>
 
+#include "gstavutils.h"
+#include "gstavconvert.h"
+
 G_BEGIN_DECLS
 
 typedef struct _GstFFMpegAudEnc GstFFMpegAudEnc;
@@ -44,6 +47,16 @@ struct _GstFFMpegAudEnc
 
   GstAudioChannelPosition ffmpeg_layout[64];
   gboolean needs_reorder;
+  /* libav channel c is input channel channel_order[c] */
+  gint channel_order[64];
+
+  /* conversion of the sample formats the codec doesn't take */
+  gboolean convert;
+  GstFFMpegAudioConverter *converter;
+
+  /* recycled per buffer input bookkeeping and output packets */
+  GstFFMpegFreeList *buffer_info_list;
+  GstFFMpegFreeList *packet_list;
 };
 
 typedef struct _GstFFMpegAudEncClass GstFFMpegAudEncClass;
@@ -54,6 +67,8 @@ struct _GstFFMpegAudEncClass
 
   AVCodec *in_plugin;
   GstPadTemplate *srctempl, *sinktempl;
+  /* sink caps without conversion */
+  GstCaps *native_caps;
 };
 
 #define GST_TYPE_FFMPEGAUDENC \
@@ -570,6 +570,64 @@ gst_ffmpeg_cfg_get_property (AVCodecContext * refcontext, GValue * value,
   return res >= 0;
 }
 
+/* rate control options an open codec can get, global_quality is only used
+ * through the quality of the frames */
+static const gchar *const rate_control_opts[] = {
+  "b", "maxrate", "bufsize", "global_quality", "crf", NULL
+};
+
+gboolean
+gst_ffmpeg_cfg_is_rate_control (GParamSpec * pspec)
+{
+  const AVOption *opt;
+
+  opt = g_param_spec_get_qdata (pspec, avoption_quark);
+
+  return opt && g_strv_contains (rate_control_opts, opt->name);
+}
+
+gboolean
+gst_ffmpeg_cfg_update_rate_control (AVCodecContext * refcontext,
+    AVCodecContext * context)
+{
+  gboolean changed = FALSE;
+  gint i;
+
+  for (i = 0; rate_control_opts[i]; i++) {
+    const gchar *name = rate_control_opts[i];
+    const AVOption *opt;
+
+    opt = av_opt_find (refcontext, name, NULL, 0, AV_OPT_SEARCH_CHILDREN);
+    if (!opt)
+      continue;
+
+    if (opt->type == AV_OPT_TYPE_FLOAT || opt->type == AV_OPT_TYPE_DOUBLE) {
+      gdouble ref, cur;
+
+      if (av_opt_get_double (refcontext, name, AV_OPT_SEARCH_CHILDREN,
+              &ref) < 0
+          || av_opt_get_double (context, name, AV_OPT_SEARCH_CHILDREN,
+              &cur) < 0 || ref == cur)
+        continue;
+      av_opt_set_double (context, name, ref, AV_OPT_SEARCH_CHILDREN);
+    } else {
+      int64_t ref, cur;
+
+      if (av_opt_get_int (refcontext, name, AV_OPT_SEARCH_CHILDREN, &ref) < 0
+          || av_opt_get_int (context, name, AV_OPT_SEARCH_CHILDREN,
+              &cur) < 0 || ref == cur)
+        continue;
+      av_opt_set_int (context, name, ref, AV_OPT_SEARCH_CHILDREN);
+    }
+
+    GST_DEBUG ("rate control option %s changed", name);
+    if (strcmp (name, "global_quality"))
+      changed = TRUE;
+  }
+
+  return changed;
+}
+
 void
 gst_ffmpeg_cfg_fill_context (GObject * object, AVCodecContext * context)
 {
@@ -37,6 +37,14 @@ gboolean gst_ffmpeg_cfg_get_property (AVCodecContext *refcontext,
     GValue * value, GParamSpec * pspec);
 
 void gst_ffmpeg_cfg_fill_context (GObject *object, AVCodecContext * context);
+
+/* whether the property is a rate control option */
+gboolean gst_ffmpeg_cfg_is_rate_control (GParamSpec * pspec);
+
+/* copies the rate control options of @refcontext to the open @context,
+ * returns TRUE if some changed that are only read when opening the codec */
+gboolean gst_ffmpeg_cfg_update_rate_control (AVCodecContext * refcontext,
+    AVCodecContext * context);
 void gst_ffmpeg_cfg_finalize (void);
 
 G_END_DECLS
@@ -450,9 +450,12 @@ get_nbits_set (guint64 n)
   return x;
 }
 
+/* Encoders accept planar formats in both layouts, interleaved input is
+ * deinterleaved by the element. The non-interleaved caps come first for
+ * them, so that planar input is not interleaved on the way */
 static void
 gst_ffmpeg_audio_set_sample_fmts (GstCaps * caps,
-    const enum AVSampleFormat *fmts, gboolean always_interleaved)
+    const enum AVSampleFormat *fmts, gboolean encode)
 {
   GValue va = { 0, };
   GValue vap = { 0, };
@@ -460,6 +463,7 @@ gst_ffmpeg_audio_set_sample_fmts (GstCaps * caps,
   GstAudioFormat format;
   GstAudioLayout layout;
   GstCaps *caps_copy = NULL;
+  GstCaps *icaps = caps, *pcaps = caps;
 
   if (!fmts || fmts[0] == -1) {
     gint i;
@@ -474,17 +478,13 @@ gst_ffmpeg_audio_set_sample_fmts (GstCaps * caps,
       gst_value_list_append_value (&va, &v);
     }
     gst_caps_set_value (caps, "format", &va);
-    if (!always_interleaved) {
-      g_value_init (&vap, GST_TYPE_LIST);
-      g_value_set_string (&v, "interleaved");
-      gst_value_list_append_value (&vap, &v);
-      g_value_set_string (&v, "non-interleaved");
-      gst_value_list_append_value (&vap, &v);
-      gst_caps_set_value (caps, "layout", &vap);
-      g_value_unset (&vap);
-    } else {
-      gst_caps_set_simple (caps, "layout", G_TYPE_STRING, "interleaved", NULL);
-    }
+    g_value_init (&vap, GST_TYPE_LIST);
+    g_value_set_string (&v, "interleaved");
+    gst_value_list_append_value (&vap, &v);
+    g_value_set_string (&v, "non-interleaved");
+    gst_value_list_append_value (&vap, &v);
+    gst_caps_set_value (caps, "layout", &vap);
+    g_value_unset (&vap);
     g_value_unset (&v);
     g_value_unset (&va);
     return;
@@ -498,10 +498,11 @@ gst_ffmpeg_audio_set_sample_fmts (GstCaps * caps,
     if (format != GST_AUDIO_FORMAT_UNKNOWN) {
       g_value_set_string (&v, gst_audio_format_to_string (format));
       /* Only append values we don't have yet */
-      if (layout == GST_AUDIO_LAYOUT_INTERLEAVED || always_interleaved) {
+      if (layout == GST_AUDIO_LAYOUT_INTERLEAVED || encode) {
         if (!_gst_value_list_contains (&va, &v))
           gst_value_list_append_value (&va, &v);
-      } else {
+      }
+      if (layout == GST_AUDIO_LAYOUT_NON_INTERLEAVED) {
         if (!_gst_value_list_contains (&vap, &v))
           gst_value_list_append_value (&vap, &v);
       }
@@ -510,23 +511,26 @@ gst_ffmpeg_audio_set_sample_fmts (GstCaps * caps,
   }
   if (gst_value_list_get_size (&va) >= 1 && gst_value_list_get_size (&vap) >= 1) {
     caps_copy = gst_caps_copy (caps);
+    if (encode)
+      icaps = caps_copy;
+    else
+      pcaps = caps_copy;
   }
   if (gst_value_list_get_size (&va) == 1) {
-    gst_caps_set_value (caps, "format", gst_value_list_get_value (&va, 0));
-    gst_caps_set_simple (caps, "layout", G_TYPE_STRING, "interleaved", NULL);
+    gst_caps_set_value (icaps, "format", gst_value_list_get_value (&va, 0));
+    gst_caps_set_simple (icaps, "layout", G_TYPE_STRING, "interleaved", NULL);
   } else if (gst_value_list_get_size (&va) > 1) {
-    gst_caps_set_value (caps, "format", &va);
-    gst_caps_set_simple (caps, "layout", G_TYPE_STRING, "interleaved", NULL);
+    gst_caps_set_value (icaps, "format", &va);
+    gst_caps_set_simple (icaps, "layout", G_TYPE_STRING, "interleaved", NULL);
   }
   if (gst_value_list_get_size (&vap) == 1) {
-    gst_caps_set_value (caps_copy ? caps_copy : caps, "format",
-        gst_value_list_get_value (&vap, 0));
-    gst_caps_set_simple (caps_copy ? caps_copy : caps, "layout", G_TYPE_STRING,
-        "non-interleaved", NULL);
+    gst_caps_set_value (pcaps, "format", gst_value_list_get_value (&vap, 0));
+    gst_caps_set_simple (pcaps, "layout", G_TYPE_STRING, "non-interleaved",
+        NULL);
   } else if (gst_value_list_get_size (&vap) > 1) {
-    gst_caps_set_value (caps_copy ? caps_copy : caps, "format", &vap);
-    gst_caps_set_simple (caps_copy ? caps_copy : caps, "layout", G_TYPE_STRING,
-        "non-interleaved", NULL);
+    gst_caps_set_value (pcaps, "format", &vap);
+    gst_caps_set_simple (pcaps, "layout", G_TYPE_STRING, "non-interleaved",
+        NULL);
   }
   if (caps_copy) {
     gst_caps_append (caps, caps_copy);
@@ -3081,6 +3085,10 @@ gst_ffmpeg_audioinfo_to_context (GstAudioInfo * info, AVCodecContext * context)
 
   g_assert (smpl_fmt != -1);
 
+  /* non-interleaved input is only accepted for planar formats */
+  if (info->layout == GST_AUDIO_LAYOUT_NON_INTERLEAVED)
+    smpl_fmt = av_get_planar_sample_fmt (smpl_fmt);
+
   context->sample_fmt = smpl_fmt;
 }
 
@@ -0,0 +1,402 @@
+/* GStreamer
+ * Copyright (C) 2026 BitsmithSolutions
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/video/video.h>
+
+#include <libavutil/buffer.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+#include <libswresample/swresample.h>
+
+#include "gstav.h"
+#include "gstavcodecmap.h"
+#include "gstavutils.h"
+#include "gstavconvert.h"
+
+/* pictures are only split in bands of at least that many rows */
+#define VIDEO_CONVERT_MIN_BAND_HEIGHT 64
+#define VIDEO_CONVERT_MAX_BANDS 8
+
+/* the encoders may read a bit past the end of the planes */
+#define VIDEO_CONVERT_PADDING 64
+
+typedef struct
+{
+  GstFFMpegVideoConverter *conv;
+  guint band;
+} VideoConvertBand;
+
+struct _GstFFMpegVideoConverter
+{
+  enum AVPixelFormat in_fmt, out_fmt;
+  gint width, height;
+
+  /* vertical subsampling of the planes */
+  gint in_shifts[4], out_shifts[4];
+
+  /* destination buffers */
+  AVBufferPool *pool;
+  gint pool_size;
+  gint linesizes[4];
+
+  /* one scaler per band, band b covers the rows from band_rows[b] to
+   * band_rows[b + 1] */
+  guint n_bands;
+  gint band_rows[VIDEO_CONVERT_MAX_BANDS + 1];
+  struct SwsContext *sws[VIDEO_CONVERT_MAX_BANDS];
+  VideoConvertBand bands[VIDEO_CONVERT_MAX_BANDS];
+
+  /* the conversion in progress */
+  const uint8_t *const *src_data;
+  const int *src_linesizes;
+  AVFrame *dst;
+  gint pending;
+  GMutex lock;
+  GCond cond;
+};
+
+static void
+gst_ffmpeg_video_converter_convert_band (GstFFMpegVideoConverter * conv,
+    guint band)
+{
+  const uint8_t *src[4] = { NULL, };
+  uint8_t *dst[4] = { NULL, };
+  gint i, first = conv->band_rows[band];
+
+  for (i = 0; i < 4; i++) {
+    if (conv->src_data[i])
+      src[i] = conv->src_data[i] +
+          (gsize) (first >> conv->in_shifts[i]) * conv->src_linesizes[i];
+    if (conv->dst->data[i])
+      dst[i] = conv->dst->data[i] +
+          (gsize) (first >> conv->out_shifts[i]) * conv->dst->linesize[i];
+  }
+
+  sws_scale (conv->sws[band], src, conv->src_linesizes, 0,
+      conv->band_rows[band + 1] - first, dst, conv->dst->linesize);
+}
+
+static void
+gst_ffmpeg_video_converter_func (gpointer data, gpointer user_data)
+{
+  VideoConvertBand *band = data;
+  GstFFMpegVideoConverter *conv = band->conv;
+
+  gst_ffmpeg_video_converter_convert_band (conv, band->band);
+
+  g_mutex_lock (&conv->lock);
+  if (--conv->pending == 0)
+    g_cond_signal (&conv->cond);
+  g_mutex_unlock (&conv->lock);
+}
+
+static GThreadPool *
+gst_ffmpeg_get_convert_pool (void)
+{
+  static GThreadPool *pool = NULL;
+
+  if (g_once_init_enter (&pool)) {
+    GThreadPool *p = g_thread_pool_new (gst_ffmpeg_video_converter_func, NULL,
+        MIN (gst_ffmpeg_auto_max_threads (), VIDEO_CONVERT_MAX_BANDS) - 1,
+        FALSE, NULL);
+
+    g_once_init_leave (&pool, p);
+  }
+
+  return pool;
+}
+
+GstFFMpegVideoConverter *
+gst_ffmpeg_video_converter_new (enum AVPixelFormat in_fmt,
+    enum AVPixelFormat out_fmt, gint width, gint height)
+{
+  const AVPixFmtDescriptor *in_desc = av_pix_fmt_desc_get (in_fmt);
+  const AVPixFmtDescriptor *out_desc = av_pix_fmt_desc_get (out_fmt);
+  GstFFMpegVideoConverter *conv;
+  uint8_t *data[4];
+  gint align, size;
+  guint i, n_bands;
+
+  if (!in_desc || !out_desc || !sws_isSupportedInput (in_fmt)
+      || !sws_isSupportedOutput (out_fmt)
+      || (out_desc->flags & AV_PIX_FMT_FLAG_PAL))
+    return NULL;
+
+  conv = g_new0 (GstFFMpegVideoConverter, 1);
+  conv->in_fmt = in_fmt;
+  conv->out_fmt = out_fmt;
+  conv->width = width;
+  conv->height = height;
+  g_mutex_init (&conv->lock);
+  g_cond_init (&conv->cond);
+
+  conv->in_shifts[1] = conv->in_shifts[2] = in_desc->log2_chroma_h;
+  conv->out_shifts[1] = conv->out_shifts[2] = out_desc->log2_chroma_h;
+
+  if (av_image_fill_linesizes (conv->linesizes, out_fmt,
+          GST_ROUND_UP_32 (width)) < 0)
+    goto error;
+  size = av_image_fill_pointers (data, out_fmt, height, NULL, conv->linesizes);
+  if (size < 0)
+    goto error;
+  conv->pool_size = size + VIDEO_CONVERT_PADDING;
+  conv->pool = av_buffer_pool_init (conv->pool_size, NULL);
+  if (!conv->pool)
+    goto error;
+
+  /* the palette of the input is not split in rows */
+  n_bands = MIN (gst_ffmpeg_auto_max_threads (), VIDEO_CONVERT_MAX_BANDS);
+  n_bands = MIN (n_bands, height / VIDEO_CONVERT_MIN_BAND_HEIGHT);
+  if (n_bands < 1 || (in_desc->flags & AV_PIX_FMT_FLAG_PAL))
+    n_bands = 1;
+
+  /* bands start on the first row of a chroma sample in all planes. The
+   * vertical chroma filter doesn't see across them, which is invisible next
+   * to the coding artefacts */
+  align = 1 << MAX (in_desc->log2_chroma_h, out_desc->log2_chroma_h);
+  conv->n_bands = n_bands;
+  for (i = 1; i < n_bands; i++)
+    conv->band_rows[i] = ((gint64) height * i / n_bands) & ~(align - 1);
+  conv->band_rows[n_bands] = height;
+
+  for (i = 0; i < n_bands; i++) {
+    gint rows = conv->band_rows[i + 1] - conv->band_rows[i];
+
+    conv->sws[i] = sws_getContext (width, rows, in_fmt, width, rows, out_fmt,
+        SWS_BICUBIC, NULL, NULL, NULL);
+    if (!conv->sws[i])
+      goto error;
+    conv->bands[i].conv = conv;
+    conv->bands[i].band = i;
+  }
+
+  GST_DEBUG ("converting %s to %s in %u bands",
+      av_get_pix_fmt_name (in_fmt), av_get_pix_fmt_name (out_fmt), n_bands);
+
+  return conv;
+
+error:
+  {
+    GST_WARNING ("failed to set up conversion from %s to %s",
+        av_get_pix_fmt_name (in_fmt), av_get_pix_fmt_name (out_fmt));
+    gst_ffmpeg_video_converter_free (conv);
+    return NULL;
+  }
+}
+
+void
+gst_ffmpeg_video_converter_free (GstFFMpegVideoConverter * conv)
+{
+  guint i;
+
+  for (i = 0; i < VIDEO_CONVERT_MAX_BANDS; i++)
+    sws_freeContext (conv->sws[i]);
+
+  /* frames still held by the codec keep the buffers alive */
+  av_buffer_pool_uninit (&conv->pool);
+
+  g_cond_clear (&conv->cond);
+  g_mutex_clear (&conv->lock);
+  g_free (conv);
+}
+
+gboolean
+gst_ffmpeg_video_converter_trim (GstFFMpegVideoConverter * conv)
+{
+  AVBufferPool *pool;
+
+  pool = av_buffer_pool_init (conv->pool_size, NULL);
+  if (!pool)
+    return FALSE;
+
+  /* frames still held by the codec keep their buffers alive */
+  av_buffer_pool_uninit (&conv->pool);
+  conv->pool = pool;
+
+  return TRUE;
+}
+
+gboolean
+gst_ffmpeg_video_converter_convert (GstFFMpegVideoConverter * conv,
+    const uint8_t * const src_data[4], const int src_linesizes[4],
+    AVFrame * dst)
+{
+  AVBufferRef *buf;
+  guint i;
+
+  buf = av_buffer_pool_get (conv->pool);
+  if (!buf)
+    return FALSE;
+
+  dst->buf[0] = buf;
+  av_image_fill_pointers (dst->data, conv->out_fmt, conv->height, buf->data,
+      conv->linesizes);
+  for (i = 0; i < 4; i++)
+    dst->linesize[i] = conv->linesizes[i];
+  dst->format = conv->out_fmt;
+  dst->width = conv->width;
+  dst->height = conv->height;
+
+  conv->src_data = src_data;
+  conv->src_linesizes = src_linesizes;
+  conv->dst = dst;
+
+  if (conv->n_bands == 1) {
+    gst_ffmpeg_video_converter_convert_band (conv, 0);
+    return TRUE;
+  }
+
+  conv->pending = conv->n_bands - 1;
+  for (i = 1; i < conv->n_bands; i++)
+    g_thread_pool_push (gst_ffmpeg_get_convert_pool (), &conv->bands[i], NULL);
+
+  /* do our share while waiting */
+  gst_ffmpeg_video_converter_convert_band (conv, 0);
+
+  g_mutex_lock (&conv->lock);
+  while (conv->pending > 0)
+    g_cond_wait (&conv->cond, &conv->lock);
+  g_mutex_unlock (&conv->lock);
+
+  return TRUE;
+}
+
+void
+gst_ffmpeg_video_converter_get_formats (GValue * formats)
+{
+  const AVPixFmtDescriptor *desc = NULL;
+  GValue v = G_VALUE_INIT;
+
+  g_value_init (formats, GST_TYPE_LIST);
+  g_value_init (&v, G_TYPE_STRING);
+
+  while ((desc = av_pix_fmt_desc_next (desc))) {
+    enum AVPixelFormat pix_fmt = av_pix_fmt_desc_get_id (desc);
+    GstVideoFormat format;
+    guint i, n;
+
+    if (!sws_isSupportedInput (pix_fmt))
+      continue;
+
+    format = gst_ffmpeg_pixfmt_to_videoformat (pix_fmt);
+    if (format == GST_VIDEO_FORMAT_UNKNOWN)
+      continue;
+
+    /* the full range variants map to the same formats */
+    n = gst_value_list_get_size (formats);
+    for (i = 0; i < n; i++) {
+      if (!g_strcmp0 (g_value_get_string (gst_value_list_get_value (formats,
+                      i)), gst_video_format_to_string (format)))
+        break;
+    }
+    if (i < n)
+      continue;
+
+    g_value_set_string (&v, gst_video_format_to_string (format));
+    gst_value_list_append_value (formats, &v);
+  }
+
+  g_value_unset (&v);
+}
+
+struct _GstFFMpegAudioConverter
+{
+  SwrContext *swr;
+  enum AVSampleFormat out_fmt;
+  gint channels;
+  guint64 channel_layout;
+  gint rate;
+};
+
+GstFFMpegAudioConverter *
+gst_ffmpeg_audio_converter_new (enum AVSampleFormat in_fmt,
+    enum AVSampleFormat out_fmt, gint channels, guint64 channel_layout,
+    gint rate)
+{
+  GstFFMpegAudioConverter *conv;
+  guint64 layout;
+
+  conv = g_new0 (GstFFMpegAudioConverter, 1);
+  conv->out_fmt = out_fmt;
+  conv->channels = channels;
+  conv->channel_layout = channel_layout;
+  conv->rate = rate;
+
+  /* same layout on both sides, it is only used to count the channels */
+  layout = channel_layout ? channel_layout :
+      av_get_default_channel_layout (channels);
+  conv->swr = swr_alloc_set_opts (NULL, layout, out_fmt, rate, layout, in_fmt,
+      rate, 0, NULL);
+  if (!conv->swr)
+    goto error;
+  av_opt_set_int (conv->swr, "ich", channels, 0);
+  av_opt_set_int (conv->swr, "och", channels, 0);
+  if (swr_init (conv->swr) < 0)
+    goto error;
+
+  GST_DEBUG ("converting %s to %s", av_get_sample_fmt_name (in_fmt),
+      av_get_sample_fmt_name (out_fmt));
+
+  return conv;
+
+error:
+  {
+    GST_WARNING ("failed to set up conversion from %s to %s",
+        av_get_sample_fmt_name (in_fmt), av_get_sample_fmt_name (out_fmt));
+    gst_ffmpeg_audio_converter_free (conv);
+    return NULL;
+  }
+}
+
+void
+gst_ffmpeg_audio_converter_free (GstFFMpegAudioConverter * conv)
+{
+  swr_free (&conv->swr);
+  g_free (conv);
+}
+
+gboolean
+gst_ffmpeg_audio_converter_convert (GstFFMpegAudioConverter * conv,
+    const uint8_t ** src, gint n_samples, AVFrame * dst)
+{
+  dst->format = conv->out_fmt;
+  dst->nb_samples = n_samples;
+  dst->channels = conv->channels;
+  dst->channel_layout = conv->channel_layout;
+  dst->sample_rate = conv->rate;
+
+  if (av_frame_get_buffer (dst, 0) < 0)
+    return FALSE;
+
+  /* no resampling, so nothing is kept back */
+  if (swr_convert (conv->swr, dst->extended_data, n_samples, src,
+          n_samples) != n_samples) {
+    av_frame_unref (dst);
+    return FALSE;
+  }
+
+  return TRUE;
+}
@@ -0,0 +1,94 @@
+/* GStreamer
+ * Copyright (C) 2026 BitsmithSolutions
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_FFMPEG_CONVERT_H__
+#define __GST_FFMPEG_CONVERT_H__
+
+#include <gst/gst.h>
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+#include <libavutil/samplefmt.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Pixel format conversion done by the encoders when the codec doesn't take
+ * the input format, written directly in a frame from a buffer pool of the
+ * converter. Large pictures are converted in bands of rows in parallel.
+ */
+typedef struct _GstFFMpegVideoConverter GstFFMpegVideoConverter;
+
+GstFFMpegVideoConverter *
+gst_ffmpeg_video_converter_new (enum AVPixelFormat in_fmt,
+                                enum AVPixelFormat out_fmt,
+                                gint width, gint height);
+
+void
+gst_ffmpeg_video_converter_free (GstFFMpegVideoConverter * conv);
+
+/*
+ * Frees the destination buffers not in use, new ones are allocated by the
+ * next conversions.
+ */
+gboolean
+gst_ffmpeg_video_converter_trim (GstFFMpegVideoConverter * conv);
+
+/*
+ * Converts the picture in @src_data into a new buffer attached to @dst,
+ * setting up its data, linesize, format and size.
+ */
+gboolean
+gst_ffmpeg_video_converter_convert (GstFFMpegVideoConverter * conv,
+                                    const uint8_t * const src_data[4],
+                                    const int src_linesizes[4],
+                                    AVFrame * dst);
+
+/*
+ * Fills @formats with the list of the raw video formats that can be
+ * converted from.
+ */
+void
+gst_ffmpeg_video_converter_get_formats (GValue * formats);
+
+/*
+ * Sample format conversion, at the same rate and channel layout.
+ */
+typedef struct _GstFFMpegAudioConverter GstFFMpegAudioConverter;
+
+GstFFMpegAudioConverter *
+gst_ffmpeg_audio_converter_new (enum AVSampleFormat in_fmt,
+                                enum AVSampleFormat out_fmt,
+                                gint channels, guint64 channel_layout,
+                                gint rate);
+
+void
+gst_ffmpeg_audio_converter_free (GstFFMpegAudioConverter * conv);
+
+/*
+ * Converts @n_samples samples from @src, one pointer per plane, into new
+ * buffers attached to @dst, setting up its format and layout.
+ */
+gboolean
+gst_ffmpeg_audio_converter_convert (GstFFMpegAudioConverter * conv,
+                                    const uint8_t ** src, gint n_samples,
+                                    AVFrame * dst);
+
+G_END_DECLS
+
+#endif /* __GST_FFMPEG_CONVERT_H__ */
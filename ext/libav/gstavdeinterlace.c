@@ -386,7 +386,7 @@ process_filter_graph (GstFFMpegDeinterlace * deinterlace, AVFrame * dst,
       deinterlace->filter_frame);
   if (res < 0)
     return res;
-  av_image_copy (dst->data, dst->linesize,
+  gst_ffmpeg_image_copy (dst->data, dst->linesize,
       (const uint8_t **) deinterlace->filter_frame->data,
       deinterlace->filter_frame->linesize, pixfmt, width, height);
   av_frame_unref (deinterlace->filter_frame);
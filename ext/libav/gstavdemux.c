@@ -1527,7 +1527,10 @@ gst_ffmpegdemux_loop (GstFFMpegDemux * demux)
   else
     outsize = pkt.size;
 
-  outbuf = gst_buffer_new_and_alloc (outsize);
+  /* padded so that a downstream libav decoder doesn't need to copy it */
+  outbuf =
+      gst_buffer_new_allocate (gst_ffmpeg_padded_allocator_get (), outsize,
+      NULL);
 
   /* copy the data from packet into the target buffer
    * and do conversions for raw video packets */
@@ -1547,9 +1550,9 @@ gst_ffmpegdemux_loop (GstFFMpegDemux * demux)
         avstream->codecpar->format, avstream->codecpar->width,
         avstream->codecpar->height);
 
-    av_image_copy (dst.data, dst.linesize, (const uint8_t **) src.data,
-        src.linesize, avstream->codecpar->format, avstream->codecpar->width,
-        avstream->codecpar->height);
+    gst_ffmpeg_image_copy (dst.data, dst.linesize,
+        (const uint8_t **) src.data, src.linesize, avstream->codecpar->format,
+        avstream->codecpar->width, avstream->codecpar->height);
     gst_buffer_unmap (outbuf, &map);
   } else {
     gst_buffer_fill (outbuf, 0, pkt.data, outsize);
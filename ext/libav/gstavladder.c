@@ -0,0 +1,1520 @@
+/* GStreamer
+ * Copyright (C) 2026 BitsmithSolutions
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-avladder
+ * @title: avladder
+ *
+ * Encodes the input video at several resolutions and bitrates, one rendition
+ * per request source pad, as needed for adaptive streaming. The input is
+ * scaled only once per rendition, each one from the smallest larger
+ * rendition, and the renditions are encoded in parallel. Keyframes are
+ * forced on the same input frames for all the renditions so that their
+ * segments line up.
+ *
+ * Unlike the avenc_ elements this is not a #GstVideoEncoder, which has one
+ * encoder behind one source pad. The codec is picked at runtime by name, so
+ * its private options are given with #GstFFMpegLadder:options instead of
+ * per codec properties. Like the avenc_ elements it reports the latency of
+ * the encoders and adds the encoder statistics meta to the packets.
+ *
+ * ## Example launch line
+ * |[
+ * gst-launch-1.0 videotestsrc num-buffers=300 ! avladder name=l codec=mpeg4 \
+ *     src_0::width=1280 src_0::bitrate=3000000 \
+ *     src_1::width=640 src_1::bitrate=1000000 \
+ *   l.src_0 ! queue ! mp4mux ! filesink location=720.mp4 \
+ *   l.src_1 ! queue ! mp4mux ! filesink location=360.mp4
+ * ]|
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/dict.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+
+#include <gst/gst.h>
+#include <gst/base/gstflowcombiner.h>
+#include <gst/video/video.h>
+
+#include "gstav.h"
+#include "gstavcodecmap.h"
+#include "gstavutils.h"
+#include "gstavconvert.h"
+#include "gstavmeta.h"
+
+/* Properties */
+
+#define DEFAULT_CODEC                   NULL
+#define DEFAULT_OPTIONS                 NULL
+#define DEFAULT_KEYFRAME_INTERVAL       60
+#define DEFAULT_MAX_THREADS             0
+
+#define DEFAULT_PAD_WIDTH               0
+#define DEFAULT_PAD_HEIGHT              0
+#define DEFAULT_PAD_BITRATE             1000000
+
+/* timestamps of the last input frames, by frame number. More than any
+ * encoder holds back */
+#define N_FRAME_TIMES                   512
+
+enum
+{
+  PROP_0,
+  PROP_CODEC,
+  PROP_OPTIONS,
+  PROP_KEYFRAME_INTERVAL,
+  PROP_MAX_THREADS,
+  PROP_LAST
+};
+
+enum
+{
+  PROP_PAD_0,
+  PROP_PAD_WIDTH,
+  PROP_PAD_HEIGHT,
+  PROP_PAD_BITRATE,
+};
+
+/* one rendition of the ladder */
+typedef struct _GstFFMpegLadderPad GstFFMpegLadderPad;
+typedef struct _GstFFMpegLadderPadClass GstFFMpegLadderPadClass;
+
+struct _GstFFMpegLadderPad
+{
+  GstPad pad;
+
+  /* properties, protected by the object lock */
+  gint width, height;
+  gint bitrate;
+
+  /* of the encoder, protected by the object lock */
+  GstClockTime latency;
+
+  /* set up from the streaming thread, used by it and by the encoding job it
+   * waits for */
+  gint out_width, out_height;
+  GstFFMpegLadderPad *source;   /* rung scaled from, NULL for the input */
+  struct SwsContext *sws;       /* NULL when the picture is the same */
+  AVCodecContext *context;
+  gboolean opened;
+  AVFrame *frame;
+  gboolean drain;
+  gboolean failed;
+  GQueue packets;
+};
+
+struct _GstFFMpegLadderPadClass
+{
+  GstPadClass parent_class;
+};
+
+#define GST_TYPE_FFMPEGLADDER_PAD \
+  (gst_ffmpegladder_pad_get_type())
+#define GST_FFMPEGLADDER_PAD(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_FFMPEGLADDER_PAD,GstFFMpegLadderPad))
+
+GType gst_ffmpegladder_pad_get_type (void);
+
+typedef struct _GstFFMpegLadder
+{
+  GstElement element;
+
+  GstPad *sinkpad;
+  GstFlowCombiner *flow_combiner;
+
+  /* properties, protected by the object lock */
+  gchar *codec_name;
+  gchar *options;
+  guint keyframe_interval;
+  guint max_threads;
+
+  /* a rung was added or removed, protected by the object lock */
+  gboolean need_configure;
+  /* a keyframe was requested, protected by the object lock */
+  gboolean force_keyframe;
+  /* index of the next unnamed source pad, protected by the object lock */
+  guint next_pad_index;
+
+  GstVideoInfo info;
+  gboolean have_info;
+
+  /* the configured rungs, largest first */
+  GList *rungs;
+  AVCodec *codec;
+  guint frames_since_key;
+
+  /* the encoders get frame numbers as timestamps, the frames of the current
+   * encoders start at first_frame */
+  guint64 frame_number;
+  guint64 first_frame;
+  GstClockTime frame_pts[N_FRAME_TIMES];
+  GstClockTime frame_duration[N_FRAME_TIMES];
+
+  /* shared by the encoders of all the rungs */
+  GThreadPool *pool;
+  GMutex lock;
+  GCond cond;
+  guint pending;
+
+  GstFFMpegFreeList *packet_list;
+} GstFFMpegLadder;
+
+typedef struct _GstFFMpegLadderClass
+{
+  GstElementClass parent_class;
+} GstFFMpegLadderClass;
+
+#define GST_TYPE_FFMPEGLADDER \
+  (gst_ffmpegladder_get_type())
+#define GST_FFMPEGLADDER(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_FFMPEGLADDER,GstFFMpegLadder))
+#define GST_IS_FFMPEGLADDER(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_FFMPEGLADDER))
+
+GType gst_ffmpegladder_get_type (void);
+
+static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE ("src_%u",
+    GST_PAD_SRC,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS_ANY);
+
+static void gst_ffmpegladder_child_proxy_init (gpointer g_iface,
+    gpointer iface_data);
+
+G_DEFINE_TYPE (GstFFMpegLadderPad, gst_ffmpegladder_pad, GST_TYPE_PAD);
+G_DEFINE_TYPE_WITH_CODE (GstFFMpegLadder, gst_ffmpegladder, GST_TYPE_ELEMENT,
+    G_IMPLEMENT_INTERFACE (GST_TYPE_CHILD_PROXY,
+        gst_ffmpegladder_child_proxy_init));
+
+static void gst_ffmpegladder_finalize (GObject * object);
+static void gst_ffmpegladder_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_ffmpegladder_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+static GstPad *gst_ffmpegladder_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps);
+static void gst_ffmpegladder_release_pad (GstElement * element, GstPad * pad);
+static GstStateChangeReturn gst_ffmpegladder_change_state (GstElement *
+    element, GstStateChange transition);
+
+static GstFlowReturn gst_ffmpegladder_chain (GstPad * pad, GstObject * parent,
+    GstBuffer * buffer);
+static gboolean gst_ffmpegladder_sink_event (GstPad * pad, GstObject * parent,
+    GstEvent * event);
+static gboolean gst_ffmpegladder_sink_query (GstPad * pad, GstObject * parent,
+    GstQuery * query);
+static gboolean gst_ffmpegladder_src_event (GstPad * pad, GstObject * parent,
+    GstEvent * event);
+static gboolean gst_ffmpegladder_src_query (GstPad * pad, GstObject * parent,
+    GstQuery * query);
+
+static void
+gst_ffmpegladder_pad_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstFFMpegLadderPad *rung = GST_FFMPEGLADDER_PAD (object);
+  GstElement *ladder;
+
+  GST_OBJECT_LOCK (rung);
+  switch (prop_id) {
+    case PROP_PAD_WIDTH:
+      rung->width = g_value_get_int (value);
+      break;
+    case PROP_PAD_HEIGHT:
+      rung->height = g_value_get_int (value);
+      break;
+    case PROP_PAD_BITRATE:
+      rung->bitrate = g_value_get_int (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (rung);
+
+  /* the ladder is set up again with the next frame */
+  ladder = gst_pad_get_parent_element (GST_PAD (rung));
+  if (ladder) {
+    GST_OBJECT_LOCK (ladder);
+    GST_FFMPEGLADDER (ladder)->need_configure = TRUE;
+    GST_OBJECT_UNLOCK (ladder);
+    gst_object_unref (ladder);
+  }
+}
+
+static void
+gst_ffmpegladder_pad_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstFFMpegLadderPad *rung = GST_FFMPEGLADDER_PAD (object);
+
+  GST_OBJECT_LOCK (rung);
+  switch (prop_id) {
+    case PROP_PAD_WIDTH:
+      g_value_set_int (value, rung->width);
+      break;
+    case PROP_PAD_HEIGHT:
+      g_value_set_int (value, rung->height);
+      break;
+    case PROP_PAD_BITRATE:
+      g_value_set_int (value, rung->bitrate);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (rung);
+}
+
+static void
+gst_ffmpegladder_pad_class_init (GstFFMpegLadderPadClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+
+  gobject_class->set_property = gst_ffmpegladder_pad_set_property;
+  gobject_class->get_property = gst_ffmpegladder_pad_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_PAD_WIDTH,
+      g_param_spec_int ("width", "Width",
+          "Width of the rendition, 0 to keep the aspect ratio of the input "
+          "with the height, or the input width", 0, G_MAXINT,
+          DEFAULT_PAD_WIDTH, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PAD_HEIGHT,
+      g_param_spec_int ("height", "Height",
+          "Height of the rendition, 0 to keep the aspect ratio of the input "
+          "with the width, or the input height", 0, G_MAXINT,
+          DEFAULT_PAD_HEIGHT, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PAD_BITRATE,
+      g_param_spec_int ("bitrate", "Bit Rate",
+          "Target bitrate of the rendition (bits/s)", 0, G_MAXINT,
+          DEFAULT_PAD_BITRATE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+}
+
+static void
+gst_ffmpegladder_pad_init (GstFFMpegLadderPad * rung)
+{
+  rung->width = DEFAULT_PAD_WIDTH;
+  rung->height = DEFAULT_PAD_HEIGHT;
+  rung->bitrate = DEFAULT_PAD_BITRATE;
+  g_queue_init (&rung->packets);
+}
+
+static void
+gst_ffmpegladder_class_init (GstFFMpegLadderClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstPadTemplate *sinktempl;
+  GstCaps *sinkcaps;
+  GValue formats = G_VALUE_INIT;
+
+  gobject_class->finalize = gst_ffmpegladder_finalize;
+  gobject_class->set_property = gst_ffmpegladder_set_property;
+  gobject_class->get_property = gst_ffmpegladder_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_CODEC,
+      g_param_spec_string ("codec", "Codec",
+          "Name of the libav encoder of the renditions, an H.264 encoder if "
+          "none", DEFAULT_CODEC, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_OPTIONS,
+      g_param_spec_string ("options", "Options",
+          "Encoder options for all the renditions, as key=value pairs "
+          "separated by ':'", DEFAULT_OPTIONS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_KEYFRAME_INTERVAL,
+      g_param_spec_uint ("keyframe-interval", "Keyframe Interval",
+          "Number of frames between the keyframes of all the renditions "
+          "(0 = only on request)", 0, G_MAXINT, DEFAULT_KEYFRAME_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_MAX_THREADS,
+      g_param_spec_uint ("max-threads", "Max Threads",
+          "Maximum number of renditions encoded at the same time "
+          "(0 = one per rendition, up to the number of processors)",
+          0, G_MAXINT, DEFAULT_MAX_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /* anything the scaler takes */
+  sinkcaps = gst_caps_new_empty_simple ("video/x-raw");
+  gst_ffmpeg_video_converter_get_formats (&formats);
+  gst_caps_set_value (sinkcaps, "format", &formats);
+  g_value_unset (&formats);
+  sinktempl = gst_pad_template_new ("sink", GST_PAD_SINK, GST_PAD_ALWAYS,
+      sinkcaps);
+  gst_caps_unref (sinkcaps);
+
+  gst_element_class_add_pad_template (element_class, sinktempl);
+  gst_element_class_add_static_pad_template_with_gtype (element_class,
+      &src_factory, GST_TYPE_FFMPEGLADDER_PAD);
+
+  gst_element_class_set_static_metadata (element_class,
+      "libav ABR ladder encoder", "Codec/Encoder/Video",
+      "Encodes video at several resolutions and bitrates with aligned "
+      "keyframes",
+      "GStreamer maintainers <gstreamer-devel@lists.freedesktop.org>");
+
+  element_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_ffmpegladder_request_new_pad);
+  element_class->release_pad = GST_DEBUG_FUNCPTR (gst_ffmpegladder_release_pad);
+  element_class->change_state =
+      GST_DEBUG_FUNCPTR (gst_ffmpegladder_change_state);
+
+  gst_type_mark_as_plugin_api (GST_TYPE_FFMPEGLADDER_PAD, 0);
+}
+
+static void
+gst_ffmpegladder_init (GstFFMpegLadder * ladder)
+{
+  GstPadTemplate *templ =
+      gst_element_class_get_pad_template (GST_ELEMENT_GET_CLASS (ladder),
+      "sink");
+
+  ladder->sinkpad = gst_pad_new_from_template (templ, "sink");
+  gst_pad_set_chain_function (ladder->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_ffmpegladder_chain));
+  gst_pad_set_event_function (ladder->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_ffmpegladder_sink_event));
+  gst_pad_set_query_function (ladder->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_ffmpegladder_sink_query));
+  GST_PAD_SET_ACCEPT_TEMPLATE (ladder->sinkpad);
+  gst_element_add_pad (GST_ELEMENT (ladder), ladder->sinkpad);
+
+  ladder->flow_combiner = gst_flow_combiner_new ();
+
+  ladder->codec_name = g_strdup (DEFAULT_CODEC);
+  ladder->options = g_strdup (DEFAULT_OPTIONS);
+  ladder->keyframe_interval = DEFAULT_KEYFRAME_INTERVAL;
+  ladder->max_threads = DEFAULT_MAX_THREADS;
+
+  g_mutex_init (&ladder->lock);
+  g_cond_init (&ladder->cond);
+  ladder->packet_list =
+      gst_ffmpeg_free_list_new (G_OBJECT_TYPE_NAME (ladder),
+      sizeof (AVPacket), NULL);
+}
+
+static void
+gst_ffmpegladder_finalize (GObject * object)
+{
+  GstFFMpegLadder *ladder = GST_FFMPEGLADDER (object);
+
+  gst_flow_combiner_free (ladder->flow_combiner);
+  g_free (ladder->codec_name);
+  g_free (ladder->options);
+  g_mutex_clear (&ladder->lock);
+  g_cond_clear (&ladder->cond);
+  gst_ffmpeg_free_list_unref (ladder->packet_list);
+
+  G_OBJECT_CLASS (gst_ffmpegladder_parent_class)->finalize (object);
+}
+
+static void
+gst_ffmpegladder_free_avpacket (gpointer pkt)
+{
+  av_packet_unref ((AVPacket *) pkt);
+  gst_ffmpeg_free_list_release (pkt);
+}
+
+static void
+gst_ffmpegladder_rung_reset (GstFFMpegLadderPad * rung)
+{
+  GstBuffer *buf;
+
+  if (rung->context) {
+    if (rung->opened)
+      gst_ffmpeg_avcodec_close (rung->context);
+    avcodec_free_context (&rung->context);
+  }
+  rung->opened = FALSE;
+
+  if (rung->sws) {
+    sws_freeContext (rung->sws);
+    rung->sws = NULL;
+  }
+  av_frame_free (&rung->frame);
+  rung->source = NULL;
+  rung->drain = FALSE;
+  rung->failed = FALSE;
+
+  while ((buf = g_queue_pop_head (&rung->packets)))
+    gst_buffer_unref (buf);
+}
+
+static void
+gst_ffmpegladder_reset (GstFFMpegLadder * ladder)
+{
+  GList *l;
+
+  /* the jobs are all done, the pool has no thread left to wait for */
+  if (ladder->pool) {
+    g_thread_pool_free (ladder->pool, FALSE, TRUE);
+    ladder->pool = NULL;
+  }
+
+  for (l = ladder->rungs; l; l = l->next) {
+    gst_ffmpegladder_rung_reset (l->data);
+    gst_object_unref (l->data);
+  }
+  g_list_free (ladder->rungs);
+  ladder->rungs = NULL;
+  ladder->codec = NULL;
+}
+
+/* the input timestamp of frame number @n, the DTS of reordering encoders
+ * start before the first frame */
+static GstClockTime
+gst_ffmpegladder_frame_time (GstFFMpegLadder * ladder, gint64 n)
+{
+  GstClockTime first, duration, offset;
+
+  if (n == AV_NOPTS_VALUE)
+    return GST_CLOCK_TIME_NONE;
+  if (n >= (gint64) ladder->first_frame)
+    return ladder->frame_pts[n % N_FRAME_TIMES];
+
+  first = ladder->frame_pts[ladder->first_frame % N_FRAME_TIMES];
+  if (GST_VIDEO_INFO_FPS_N (&ladder->info) > 0)
+    duration = gst_util_uint64_scale_int (GST_SECOND,
+        GST_VIDEO_INFO_FPS_D (&ladder->info),
+        GST_VIDEO_INFO_FPS_N (&ladder->info));
+  else
+    duration = ladder->frame_duration[ladder->first_frame % N_FRAME_TIMES];
+  if (!GST_CLOCK_TIME_IS_VALID (first) || !GST_CLOCK_TIME_IS_VALID (duration))
+    return GST_CLOCK_TIME_NONE;
+
+  offset = (ladder->first_frame - n) * duration;
+  return first >= offset ? first - offset : GST_CLOCK_TIME_NONE;
+}
+
+/* encodes the picture of the rung, or drains its encoder */
+static void
+gst_ffmpegladder_encode (gpointer data, gpointer user_data)
+{
+  GstFFMpegLadderPad *rung = data;
+  GstFFMpegLadder *ladder = user_data;
+  AVCodecContext *context = rung->context;
+  GstBuffer *outbuf;
+  AVPacket *pkt;
+  gint res;
+
+  res = avcodec_send_frame (context, rung->drain ? NULL : rung->frame);
+
+  while (res >= 0) {
+    pkt = gst_ffmpeg_free_list_alloc (ladder->packet_list);
+    res = avcodec_receive_packet (context, pkt);
+    if (res < 0) {
+      gst_ffmpeg_free_list_release (pkt);
+      break;
+    }
+
+    outbuf =
+        gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY, pkt->data,
+        pkt->size, 0, pkt->size, pkt, gst_ffmpegladder_free_avpacket);
+    gst_buffer_add_ffmpeg_encoder_stats_meta (outbuf, pkt, context);
+    GST_BUFFER_PTS (outbuf) = gst_ffmpegladder_frame_time (ladder, pkt->pts);
+    GST_BUFFER_DTS (outbuf) = gst_ffmpegladder_frame_time (ladder, pkt->dts);
+    if (pkt->pts >= (gint64) ladder->first_frame)
+      GST_BUFFER_DURATION (outbuf) =
+          ladder->frame_duration[pkt->pts % N_FRAME_TIMES];
+    if (!(pkt->flags & AV_PKT_FLAG_KEY))
+      GST_BUFFER_FLAG_SET (outbuf, GST_BUFFER_FLAG_DELTA_UNIT);
+
+    g_queue_push_tail (&rung->packets, outbuf);
+  }
+
+  rung->failed = res != AVERROR (EAGAIN) && res != AVERROR_EOF;
+
+  g_mutex_lock (&ladder->lock);
+  if (--ladder->pending == 0)
+    g_cond_signal (&ladder->cond);
+  g_mutex_unlock (&ladder->lock);
+}
+
+static void
+gst_ffmpegladder_submit (GstFFMpegLadder * ladder, GstFFMpegLadderPad * rung)
+{
+  g_mutex_lock (&ladder->lock);
+  ladder->pending++;
+  g_mutex_unlock (&ladder->lock);
+
+  g_thread_pool_push (ladder->pool, rung, NULL);
+}
+
+static void
+gst_ffmpegladder_wait (GstFFMpegLadder * ladder)
+{
+  g_mutex_lock (&ladder->lock);
+  while (ladder->pending > 0)
+    g_cond_wait (&ladder->cond, &ladder->lock);
+  g_mutex_unlock (&ladder->lock);
+}
+
+/* pushes what the encoders produced, always in the order of the rungs */
+static GstFlowReturn
+gst_ffmpegladder_push (GstFFMpegLadder * ladder)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  GList *l;
+
+  for (l = ladder->rungs; l; l = l->next) {
+    GstFFMpegLadderPad *rung = l->data;
+    GstFlowReturn pad_ret = GST_FLOW_OK;
+    GstBuffer *buf;
+
+    if (rung->failed) {
+      GST_ELEMENT_ERROR (ladder, LIBRARY, ENCODE, (NULL),
+          ("Failed to encode rendition %s", GST_PAD_NAME (rung)));
+      return GST_FLOW_ERROR;
+    }
+
+    while ((buf = g_queue_pop_head (&rung->packets))) {
+      if (pad_ret == GST_FLOW_OK)
+        pad_ret = gst_pad_push (GST_PAD (rung), buf);
+      else
+        gst_buffer_unref (buf);
+    }
+    ret = gst_flow_combiner_update_pad_flow (ladder->flow_combiner,
+        GST_PAD (rung), pad_ret);
+  }
+
+  return ret;
+}
+
+static GstFlowReturn
+gst_ffmpegladder_drain (GstFFMpegLadder * ladder)
+{
+  GList *l;
+
+  for (l = ladder->rungs; l; l = l->next) {
+    GstFFMpegLadderPad *rung = l->data;
+
+    if (rung->opened) {
+      rung->drain = TRUE;
+      gst_ffmpegladder_submit (ladder, rung);
+    }
+  }
+  gst_ffmpegladder_wait (ladder);
+
+  /* the encoders are done, they are opened again with the next frame */
+  GST_OBJECT_LOCK (ladder);
+  ladder->need_configure = TRUE;
+  GST_OBJECT_UNLOCK (ladder);
+
+  return gst_ffmpegladder_push (ladder);
+}
+
+/* the first H.264 encoder that runs outside of hardware, like the ones
+ * avvidenc registers */
+static AVCodec *
+gst_ffmpegladder_find_default_encoder (void)
+{
+  AVCodec *codec;
+  void *i = 0;
+
+  while ((codec = (AVCodec *) av_codec_iterate (&i))) {
+    if (codec->id != AV_CODEC_ID_H264 || !av_codec_is_encoder (codec))
+      continue;
+    if ((codec->capabilities & AV_CODEC_CAP_HARDWARE) ||
+        (codec->capabilities & AV_CODEC_CAP_HYBRID))
+      continue;
+    return codec;
+  }
+
+  return NULL;
+}
+
+static gint
+gst_ffmpegladder_compare_rungs (gconstpointer a, gconstpointer b)
+{
+  const GstFFMpegLadderPad *ra = a, *rb = b;
+  gint64 area_a = (gint64) ra->out_width * ra->out_height;
+  gint64 area_b = (gint64) rb->out_width * rb->out_height;
+
+  if (area_a != area_b)
+    return area_a > area_b ? -1 : 1;
+
+  return rb->out_width - ra->out_width;
+}
+
+static gboolean
+gst_ffmpegladder_push_sticky_event (GstPad * pad, GstEvent ** event,
+    gpointer user_data)
+{
+  GstPad *srcpad = user_data;
+  GstEvent *current;
+
+  /* the events that come after the caps, unless the rendition has them */
+  if (GST_EVENT_TYPE (*event) <= GST_EVENT_CAPS
+      || GST_EVENT_TYPE (*event) == GST_EVENT_EOS)
+    return TRUE;
+
+  current = gst_pad_get_sticky_event (srcpad, GST_EVENT_TYPE (*event), 0);
+  if (current != *event)
+    gst_pad_push_event (srcpad, gst_event_ref (*event));
+  if (current)
+    gst_event_unref (current);
+
+  return TRUE;
+}
+
+static gboolean
+gst_ffmpegladder_open_rung (GstFFMpegLadder * ladder,
+    GstFFMpegLadderPad * rung, enum AVPixelFormat in_fmt,
+    enum AVPixelFormat pix_fmt, guint n_rungs, const gchar * options,
+    gboolean * latency_changed)
+{
+  AVCodecContext *context;
+  AVDictionary *dict = NULL;
+  AVDictionaryEntry *e = NULL;
+  GstCaps *allowed_caps, *other_caps, *caps;
+  gint src_width, src_height;
+  enum AVPixelFormat src_fmt;
+  GstClockTime latency = 0;
+  guint frames;
+
+  context = rung->context = avcodec_alloc_context3 (ladder->codec);
+  if (!context)
+    return FALSE;
+
+  gst_ffmpeg_videoinfo_to_context (&ladder->info, context);
+  context->width = rung->out_width;
+  context->height = rung->out_height;
+  context->pix_fmt = pix_fmt;
+  GST_OBJECT_LOCK (rung);
+  context->bit_rate = rung->bitrate;
+  GST_OBJECT_UNLOCK (rung);
+
+  /* keyframes are only placed by us, on the same frames for every rung */
+  context->gop_size = ladder->keyframe_interval ? ladder->keyframe_interval :
+      G_MAXINT;
+  context->keyint_min = context->gop_size;
+  context->max_b_frames = 0;
+
+  /* and not by the scene cut detection, which differs per rendition. It
+   * is switched off with 0 by libx264 and with a huge threshold by the
+   * MPEG video encoders, the options can turn it on again */
+  av_opt_set_int (context, "sc_threshold",
+      strcmp (ladder->codec->name, "libx264") ? 1000000000 : 0,
+      AV_OPT_SEARCH_CHILDREN);
+
+  /* the renditions already run in parallel, the slices use the processors
+   * left over */
+  context->thread_type = FF_THREAD_SLICE;
+  context->thread_count = MAX (1, gst_ffmpeg_auto_max_threads () / n_rungs);
+
+  if (options && av_dict_parse_string (&dict, options, "=", ":", 0) < 0)
+    GST_WARNING_OBJECT (ladder, "Failed to parse options '%s'", options);
+  while ((e = av_dict_get (dict, "", e, AV_DICT_IGNORE_SUFFIX))) {
+    if (av_opt_set (context, e->key, e->value, AV_OPT_SEARCH_CHILDREN) < 0)
+      GST_WARNING_OBJECT (ladder, "Failed to set option %s=%s", e->key,
+          e->value);
+  }
+  av_dict_free (&dict);
+
+  allowed_caps = gst_pad_get_allowed_caps (GST_PAD (rung));
+  if (!allowed_caps)
+    allowed_caps = gst_pad_get_pad_template_caps (GST_PAD (rung));
+  gst_ffmpeg_caps_with_codecid (ladder->codec->id, AVMEDIA_TYPE_VIDEO,
+      allowed_caps, context);
+
+  if (gst_ffmpeg_avcodec_open (context, ladder->codec) < 0) {
+    gst_caps_unref (allowed_caps);
+    GST_ERROR_OBJECT (rung, "Failed to open the encoder");
+    return FALSE;
+  }
+  rung->opened = TRUE;
+
+  frames = gst_ffmpeg_encoder_get_delay (context);
+  if (GST_VIDEO_INFO_FPS_N (&ladder->info) > 0)
+    latency = gst_util_uint64_scale_ceil (frames * GST_SECOND,
+        GST_VIDEO_INFO_FPS_D (&ladder->info),
+        GST_VIDEO_INFO_FPS_N (&ladder->info));
+  GST_DEBUG_OBJECT (rung, "latency of %u frames, %" GST_TIME_FORMAT, frames,
+      GST_TIME_ARGS (latency));
+
+  GST_OBJECT_LOCK (rung);
+  *latency_changed = rung->latency != latency;
+  rung->latency = latency;
+  GST_OBJECT_UNLOCK (rung);
+
+  other_caps = gst_ffmpeg_codecid_to_caps (ladder->codec->id, context, TRUE);
+  if (!other_caps) {
+    gst_caps_unref (allowed_caps);
+    return FALSE;
+  }
+  caps = gst_caps_intersect (allowed_caps, other_caps);
+  gst_caps_unref (allowed_caps);
+  gst_caps_unref (other_caps);
+  if (gst_caps_is_empty (caps)) {
+    gst_caps_unref (caps);
+    GST_ERROR_OBJECT (rung, "No caps accepted downstream");
+    return FALSE;
+  }
+  caps = gst_caps_fixate (caps);
+
+  /* the segment and the other events that must follow the caps were held
+   * back by the sink pad while the rendition had no caps */
+  gst_pad_push_event (GST_PAD (rung), gst_event_new_caps (caps));
+  gst_caps_unref (caps);
+  gst_pad_sticky_events_foreach (ladder->sinkpad,
+      gst_ffmpegladder_push_sticky_event, rung);
+
+  /* the picture to encode */
+  rung->frame = av_frame_alloc ();
+  rung->frame->format = pix_fmt;
+  rung->frame->width = rung->out_width;
+  rung->frame->height = rung->out_height;
+
+  if (rung->source) {
+    src_width = rung->source->out_width;
+    src_height = rung->source->out_height;
+    src_fmt = pix_fmt;
+  } else {
+    src_width = GST_VIDEO_INFO_WIDTH (&ladder->info);
+    src_height = GST_VIDEO_INFO_HEIGHT (&ladder->info);
+    src_fmt = in_fmt;
+  }
+
+  /* the same picture is used as is */
+  if (src_width == rung->out_width && src_height == rung->out_height
+      && src_fmt == pix_fmt)
+    return TRUE;
+
+  rung->sws = sws_getContext (src_width, src_height, src_fmt,
+      rung->out_width, rung->out_height, pix_fmt, SWS_BICUBIC, NULL, NULL,
+      NULL);
+  if (!rung->sws) {
+    GST_ERROR_OBJECT (rung, "Failed to scale from %dx%d %s", src_width,
+        src_height, av_get_pix_fmt_name (src_fmt));
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* sets up the scaling pyramid and the encoders of the requested rungs */
+static gboolean
+gst_ffmpegladder_configure (GstFFMpegLadder * ladder)
+{
+  GstVideoInfo *info = &ladder->info;
+  gint in_width = GST_VIDEO_INFO_WIDTH (info);
+  gint in_height = GST_VIDEO_INFO_HEIGHT (info);
+  enum AVPixelFormat in_fmt, pix_fmt;
+  gchar *codec_name, *options;
+  guint n_rungs, max_threads;
+  gboolean latency_changed = FALSE;
+  GList *l, *k;
+
+  gst_ffmpegladder_reset (ladder);
+
+  GST_OBJECT_LOCK (ladder);
+  ladder->need_configure = FALSE;
+  codec_name = g_strdup (ladder->codec_name);
+  options = g_strdup (ladder->options);
+  max_threads = ladder->max_threads;
+  for (l = GST_ELEMENT (ladder)->srcpads; l; l = l->next)
+    ladder->rungs = g_list_prepend (ladder->rungs, gst_object_ref (l->data));
+  GST_OBJECT_UNLOCK (ladder);
+
+  if (codec_name)
+    ladder->codec = avcodec_find_encoder_by_name (codec_name);
+  else
+    ladder->codec = gst_ffmpegladder_find_default_encoder ();
+  if (!ladder->codec || ladder->codec->type != AVMEDIA_TYPE_VIDEO)
+    goto no_codec;
+
+  in_fmt = gst_ffmpeg_videoformat_to_pixfmt (GST_VIDEO_INFO_FORMAT (info));
+  if (ladder->codec->pix_fmts)
+    pix_fmt = avcodec_find_best_pix_fmt_of_list (ladder->codec->pix_fmts,
+        in_fmt, GST_VIDEO_INFO_HAS_ALPHA (info), NULL);
+  else
+    pix_fmt = in_fmt;
+  if (pix_fmt == AV_PIX_FMT_NONE || !sws_isSupportedOutput (pix_fmt))
+    goto no_codec;
+
+  /* the size of the renditions, the missing dimension keeps the aspect
+   * ratio of the input */
+  for (l = ladder->rungs; l; l = l->next) {
+    GstFFMpegLadderPad *rung = l->data;
+    gint width, height;
+
+    GST_OBJECT_LOCK (rung);
+    width = rung->width;
+    height = rung->height;
+    GST_OBJECT_UNLOCK (rung);
+
+    if (!width && !height) {
+      width = in_width;
+      height = in_height;
+    } else if (!width) {
+      width = gst_util_uint64_scale_int_round (in_width, height, in_height);
+    } else if (!height) {
+      height = gst_util_uint64_scale_int_round (in_height, width, in_width);
+    }
+    rung->out_width = MAX (2, GST_ROUND_UP_2 (width));
+    rung->out_height = MAX (2, GST_ROUND_UP_2 (height));
+  }
+
+  /* every rung is scaled from the smallest larger one, the largest from the
+   * input */
+  ladder->rungs = g_list_sort (ladder->rungs, gst_ffmpegladder_compare_rungs);
+  for (l = ladder->rungs; l; l = l->next) {
+    GstFFMpegLadderPad *rung = l->data;
+
+    for (k = l->prev; k; k = k->prev) {
+      GstFFMpegLadderPad *source = k->data;
+
+      if (source->out_width >= rung->out_width
+          && source->out_height >= rung->out_height) {
+        rung->source = source;
+        break;
+      }
+    }
+  }
+
+  n_rungs = g_list_length (ladder->rungs);
+  for (l = ladder->rungs; l; l = l->next) {
+    GstFFMpegLadderPad *rung = l->data;
+    gboolean changed;
+
+    GST_DEBUG_OBJECT (rung, "%dx%d at %d bits/s from %s", rung->out_width,
+        rung->out_height, rung->bitrate,
+        rung->source ? GST_PAD_NAME (rung->source) : "the input");
+
+    if (!gst_ffmpegladder_open_rung (ladder, rung, in_fmt, pix_fmt, n_rungs,
+            options, &changed))
+      goto open_failed;
+    latency_changed |= changed;
+  }
+
+  if (latency_changed)
+    gst_element_post_message (GST_ELEMENT (ladder),
+        gst_message_new_latency (GST_OBJECT (ladder)));
+
+  if (n_rungs > 0) {
+    if (!max_threads)
+      max_threads = MIN (n_rungs, gst_ffmpeg_auto_max_threads ());
+    ladder->pool = g_thread_pool_new (gst_ffmpegladder_encode, ladder,
+        max_threads, FALSE, NULL);
+  }
+
+  /* the renditions start with a keyframe */
+  ladder->first_frame = ladder->frame_number;
+  ladder->frames_since_key = 0;
+  GST_OBJECT_LOCK (ladder);
+  ladder->force_keyframe = TRUE;
+  GST_OBJECT_UNLOCK (ladder);
+
+  g_free (codec_name);
+  g_free (options);
+
+  return TRUE;
+
+  /* ERRORS */
+no_codec:
+  {
+    GST_ELEMENT_ERROR (ladder, CORE, NEGOTIATION, (NULL),
+        ("No video encoder '%s' taking %s", GST_STR_NULL (codec_name),
+            GST_VIDEO_INFO_NAME (info)));
+    g_free (codec_name);
+    g_free (options);
+    gst_ffmpegladder_reset (ladder);
+    return FALSE;
+  }
+open_failed:
+  {
+    GST_ELEMENT_ERROR (ladder, LIBRARY, SETTINGS, (NULL),
+        ("Failed to set up the encoder of every rendition"));
+    g_free (codec_name);
+    g_free (options);
+    gst_ffmpegladder_reset (ladder);
+    return FALSE;
+  }
+}
+
+/* gets the picture of the rung from the input or from its source rung */
+static gboolean
+gst_ffmpegladder_scale (GstFFMpegLadder * ladder, GstFFMpegLadderPad * rung,
+    GstVideoFrame * vframe)
+{
+  AVFrame *frame = rung->frame;
+  const uint8_t *src[4] = { NULL, };
+  int src_linesize[4] = { 0, };
+  gint i;
+
+  if (rung->source) {
+    for (i = 0; i < 4; i++) {
+      src[i] = rung->source->frame->data[i];
+      src_linesize[i] = rung->source->frame->linesize[i];
+    }
+  } else {
+    for (i = 0; i < GST_VIDEO_FRAME_N_PLANES (vframe); i++) {
+      src[i] = GST_VIDEO_FRAME_PLANE_DATA (vframe, i);
+      src_linesize[i] = GST_VIDEO_FRAME_PLANE_STRIDE (vframe, i);
+    }
+  }
+
+  if (!rung->sws) {
+    av_frame_unref (frame);
+    frame->format = rung->context->pix_fmt;
+    frame->width = rung->out_width;
+    frame->height = rung->out_height;
+
+    /* no copy of the picture of the source rung */
+    if (rung->source && rung->source->frame->buf[0])
+      return av_frame_ref (frame, rung->source->frame) >= 0;
+
+    /* the encoders copy what they keep of a picture without buffers */
+    for (i = 0; i < 4; i++) {
+      frame->data[i] = (uint8_t *) src[i];
+      frame->linesize[i] = src_linesize[i];
+    }
+    return TRUE;
+  }
+
+  /* a new buffer if the encoder kept the previous one */
+  if (!frame->buf[0] || !av_frame_is_writable (frame)) {
+    av_frame_unref (frame);
+    frame->format = rung->context->pix_fmt;
+    frame->width = rung->out_width;
+    frame->height = rung->out_height;
+    if (av_frame_get_buffer (frame, 0) < 0)
+      return FALSE;
+  }
+
+  sws_scale (rung->sws, src, src_linesize, 0, rung->source ?
+      rung->source->out_height : GST_VIDEO_FRAME_HEIGHT (vframe),
+      frame->data, frame->linesize);
+
+  return TRUE;
+}
+
+static GstFlowReturn
+gst_ffmpegladder_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  GstFFMpegLadder *ladder = GST_FFMPEGLADDER (parent);
+  GstFlowReturn ret;
+  GstVideoFrame vframe;
+  gboolean need_configure, keyframe;
+  guint interval;
+  guint64 n;
+  GList *l;
+
+  if (!ladder->have_info)
+    goto not_negotiated;
+
+  GST_OBJECT_LOCK (ladder);
+  need_configure = ladder->need_configure;
+  GST_OBJECT_UNLOCK (ladder);
+
+  if (need_configure) {
+    ret = gst_ffmpegladder_drain (ladder);
+    if (ret != GST_FLOW_OK && ret != GST_FLOW_NOT_LINKED) {
+      gst_buffer_unref (buffer);
+      return ret;
+    }
+    if (!gst_ffmpegladder_configure (ladder)) {
+      gst_buffer_unref (buffer);
+      return GST_FLOW_NOT_NEGOTIATED;
+    }
+  }
+
+  if (!ladder->rungs) {
+    gst_buffer_unref (buffer);
+    return GST_FLOW_NOT_LINKED;
+  }
+
+  if (!gst_video_frame_map (&vframe, &ladder->info, buffer, GST_MAP_READ))
+    goto map_failed;
+
+  GST_OBJECT_LOCK (ladder);
+  interval = ladder->keyframe_interval;
+  keyframe = ladder->force_keyframe
+      || (interval && ladder->frames_since_key >= interval);
+  ladder->force_keyframe = FALSE;
+  GST_OBJECT_UNLOCK (ladder);
+
+  if (keyframe)
+    ladder->frames_since_key = 0;
+  ladder->frames_since_key++;
+
+  /* the encoding jobs of the previous frame are done */
+  n = ladder->frame_number++;
+  ladder->frame_pts[n % N_FRAME_TIMES] = GST_BUFFER_PTS (buffer);
+  ladder->frame_duration[n % N_FRAME_TIMES] = GST_BUFFER_DURATION (buffer);
+
+  /* the larger rungs come first, each one is encoded while the smaller
+   * ones are scaled from it */
+  for (l = ladder->rungs; l; l = l->next) {
+    GstFFMpegLadderPad *rung = l->data;
+
+    if (!gst_ffmpegladder_scale (ladder, rung, &vframe)) {
+      gst_ffmpegladder_wait (ladder);
+      gst_video_frame_unmap (&vframe);
+      goto scale_failed;
+    }
+
+    rung->frame->pts = n;
+    rung->frame->pict_type = keyframe ? AV_PICTURE_TYPE_I :
+        AV_PICTURE_TYPE_NONE;
+    rung->frame->key_frame = keyframe;
+
+    gst_ffmpegladder_submit (ladder, rung);
+  }
+  gst_ffmpegladder_wait (ladder);
+
+  gst_video_frame_unmap (&vframe);
+  gst_buffer_unref (buffer);
+
+  return gst_ffmpegladder_push (ladder);
+
+  /* ERRORS */
+not_negotiated:
+  {
+    gst_buffer_unref (buffer);
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+map_failed:
+  {
+    GST_ELEMENT_ERROR (ladder, CORE, FAILED, (NULL),
+        ("Failed to map the input buffer"));
+    gst_buffer_unref (buffer);
+    return GST_FLOW_ERROR;
+  }
+scale_failed:
+  {
+    GST_ELEMENT_ERROR (ladder, CORE, FAILED, (NULL),
+        ("Failed to scale the input"));
+    gst_buffer_unref (buffer);
+    return GST_FLOW_ERROR;
+  }
+}
+
+static gboolean
+gst_ffmpegladder_forward_sticky_event (GstElement * element, GstPad * pad,
+    gpointer user_data)
+{
+  if (gst_pad_has_current_caps (pad))
+    gst_pad_push_event (pad, gst_event_ref (user_data));
+
+  return TRUE;
+}
+
+static gboolean
+gst_ffmpegladder_sink_event (GstPad * pad, GstObject * parent,
+    GstEvent * event)
+{
+  GstFFMpegLadder *ladder = GST_FFMPEGLADDER (parent);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS:
+    {
+      GstCaps *caps;
+      GstVideoInfo info;
+
+      gst_event_parse_caps (event, &caps);
+      if (!gst_video_info_from_caps (&info, caps)) {
+        gst_event_unref (event);
+        return FALSE;
+      }
+
+      /* every rendition has its own caps, pushed once its encoder is set
+       * up with the next frame */
+      if (ladder->rungs)
+        gst_ffmpegladder_drain (ladder);
+      ladder->info = info;
+      ladder->have_info = TRUE;
+      GST_OBJECT_LOCK (ladder);
+      ladder->need_configure = TRUE;
+      GST_OBJECT_UNLOCK (ladder);
+
+      gst_event_unref (event);
+      return TRUE;
+    }
+    case GST_EVENT_EOS:
+      if (ladder->rungs)
+        gst_ffmpegladder_drain (ladder);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      /* whatever the encoders hold is dropped with them */
+      gst_ffmpegladder_reset (ladder);
+      ladder->frame_number = 0;
+      gst_flow_combiner_reset (ladder->flow_combiner);
+      GST_OBJECT_LOCK (ladder);
+      ladder->need_configure = TRUE;
+      GST_OBJECT_UNLOCK (ladder);
+      break;
+    case GST_EVENT_CUSTOM_DOWNSTREAM:
+      if (gst_video_event_is_force_key_unit (event)) {
+        GST_OBJECT_LOCK (ladder);
+        ladder->force_keyframe = TRUE;
+        GST_OBJECT_UNLOCK (ladder);
+      }
+      break;
+    default:
+      break;
+  }
+
+  /* a rendition without caps gets the segment and the like from the sink
+   * pad once it has caps, the others right away */
+  if (GST_EVENT_IS_STICKY (event) && GST_EVENT_TYPE (event) > GST_EVENT_CAPS
+      && GST_EVENT_TYPE (event) != GST_EVENT_EOS) {
+    gst_element_foreach_src_pad (GST_ELEMENT (ladder),
+        gst_ffmpegladder_forward_sticky_event, event);
+    gst_event_unref (event);
+    return TRUE;
+  }
+
+  return gst_pad_event_default (pad, parent, event);
+}
+
+static gboolean
+gst_ffmpegladder_sink_query (GstPad * pad, GstObject * parent,
+    GstQuery * query)
+{
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_CAPS:
+    {
+      GstCaps *filter, *caps;
+
+      /* the renditions don't restrict the input */
+      gst_query_parse_caps (query, &filter);
+      caps = gst_pad_get_pad_template_caps (pad);
+      if (filter) {
+        GstCaps *tmp = gst_caps_intersect_full (filter, caps,
+            GST_CAPS_INTERSECT_FIRST);
+
+        gst_caps_unref (caps);
+        caps = tmp;
+      }
+      gst_query_set_caps_result (query, caps);
+      gst_caps_unref (caps);
+      return TRUE;
+    }
+    case GST_QUERY_ALLOCATION:
+      gst_query_add_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL);
+      return TRUE;
+    default:
+      return gst_pad_query_default (pad, parent, query);
+  }
+}
+
+static gboolean
+gst_ffmpegladder_src_event (GstPad * pad, GstObject * parent,
+    GstEvent * event)
+{
+  GstFFMpegLadder *ladder = GST_FFMPEGLADDER (parent);
+
+  /* a keyframe in one rendition is a keyframe in all of them */
+  if (gst_video_event_is_force_key_unit (event)) {
+    GST_OBJECT_LOCK (ladder);
+    ladder->force_keyframe = TRUE;
+    GST_OBJECT_UNLOCK (ladder);
+    gst_event_unref (event);
+    return TRUE;
+  }
+
+  return gst_pad_event_default (pad, parent, event);
+}
+
+static gboolean
+gst_ffmpegladder_src_query (GstPad * pad, GstObject * parent,
+    GstQuery * query)
+{
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_CAPS:
+    {
+      GstCaps *filter, *caps;
+
+      gst_query_parse_caps (query, &filter);
+      caps = gst_pad_get_current_caps (pad);
+      if (!caps)
+        caps = gst_pad_get_pad_template_caps (pad);
+      if (filter) {
+        GstCaps *tmp = gst_caps_intersect_full (filter, caps,
+            GST_CAPS_INTERSECT_FIRST);
+
+        gst_caps_unref (caps);
+        caps = tmp;
+      }
+      gst_query_set_caps_result (query, caps);
+      gst_caps_unref (caps);
+      return TRUE;
+    }
+    case GST_QUERY_LATENCY:
+    {
+      GstFFMpegLadder *ladder = GST_FFMPEGLADDER (parent);
+      GstFFMpegLadderPad *rung = GST_FFMPEGLADDER_PAD (pad);
+      GstClockTime min, max, latency;
+      gboolean live;
+
+      if (!gst_pad_peer_query (ladder->sinkpad, query))
+        return FALSE;
+
+      /* the renditions are pushed as soon as all of them are encoded, each
+       * one only adds what its encoder holds back */
+      gst_query_parse_latency (query, &live, &min, &max);
+      GST_OBJECT_LOCK (rung);
+      latency = rung->latency;
+      GST_OBJECT_UNLOCK (rung);
+
+      min += latency;
+      if (GST_CLOCK_TIME_IS_VALID (max))
+        max += latency;
+      gst_query_set_latency (query, live, min, max);
+      return TRUE;
+    }
+    default:
+      return gst_pad_query_default (pad, parent, query);
+  }
+}
+
+static gboolean
+gst_ffmpegladder_copy_sticky_event (GstPad * pad, GstEvent ** event,
+    gpointer user_data)
+{
+  GstPad *srcpad = user_data;
+
+  /* the caps are those of the encoder of the rendition, the events after
+   * them are pushed once it has them */
+  if (GST_EVENT_TYPE (*event) < GST_EVENT_CAPS)
+    gst_pad_store_sticky_event (srcpad, *event);
+
+  return TRUE;
+}
+
+static GstPad *
+gst_ffmpegladder_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps)
+{
+  GstFFMpegLadder *ladder = GST_FFMPEGLADDER (element);
+  GstPad *srcpad;
+  guint n = 0;
+  gchar *pad_name;
+
+  if (name && sscanf (name, "src_%u", &n) != 1)
+    return NULL;
+
+  GST_OBJECT_LOCK (ladder);
+  /* never reuse the index of a pad that was released */
+  if (!name)
+    n = ladder->next_pad_index;
+  ladder->next_pad_index = MAX (ladder->next_pad_index, n + 1);
+  pad_name = g_strdup_printf ("src_%u", n);
+  ladder->need_configure = TRUE;
+  GST_OBJECT_UNLOCK (ladder);
+
+  srcpad = g_object_new (GST_TYPE_FFMPEGLADDER_PAD, "name", pad_name,
+      "direction", templ->direction, "template", templ, NULL);
+  g_free (pad_name);
+
+  gst_pad_set_event_function (srcpad,
+      GST_DEBUG_FUNCPTR (gst_ffmpegladder_src_event));
+  gst_pad_set_query_function (srcpad,
+      GST_DEBUG_FUNCPTR (gst_ffmpegladder_src_query));
+  gst_pad_use_fixed_caps (srcpad);
+
+  /* activated here when running */
+  if (!gst_element_add_pad (element, srcpad)) {
+    gst_object_unref (srcpad);
+    return NULL;
+  }
+
+  gst_pad_sticky_events_foreach (ladder->sinkpad,
+      gst_ffmpegladder_copy_sticky_event, srcpad);
+
+  gst_flow_combiner_add_pad (ladder->flow_combiner, srcpad);
+  gst_child_proxy_child_added (GST_CHILD_PROXY (ladder), G_OBJECT (srcpad),
+      GST_OBJECT_NAME (srcpad));
+
+  return srcpad;
+}
+
+static void
+gst_ffmpegladder_release_pad (GstElement * element, GstPad * pad)
+{
+  GstFFMpegLadder *ladder = GST_FFMPEGLADDER (element);
+
+  /* a push on this pad, which might be blocked in preroll, returns
+   * FLUSHING now so that the streaming thread lets go of the stream lock */
+  gst_pad_set_active (pad, FALSE);
+
+  /* the encoders of all the rungs are set up again for the remaining ones,
+   * not while they are used. What they hold is pushed out first */
+  GST_PAD_STREAM_LOCK (ladder->sinkpad);
+  gst_flow_combiner_remove_pad (ladder->flow_combiner, pad);
+  gst_ffmpegladder_drain (ladder);
+  gst_ffmpegladder_reset (ladder);
+  GST_OBJECT_LOCK (ladder);
+  ladder->need_configure = TRUE;
+  GST_OBJECT_UNLOCK (ladder);
+
+  gst_child_proxy_child_removed (GST_CHILD_PROXY (ladder), G_OBJECT (pad),
+      GST_OBJECT_NAME (pad));
+  gst_element_remove_pad (element, pad);
+  GST_PAD_STREAM_UNLOCK (ladder->sinkpad);
+}
+
+static GstStateChangeReturn
+gst_ffmpegladder_change_state (GstElement * element,
+    GstStateChange transition)
+{
+  GstFFMpegLadder *ladder = GST_FFMPEGLADDER (element);
+  GstStateChangeReturn ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      gst_flow_combiner_reset (ladder->flow_combiner);
+      break;
+    default:
+      break;
+  }
+
+  ret =
+      GST_ELEMENT_CLASS (gst_ffmpegladder_parent_class)->change_state (element,
+      transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_ffmpegladder_reset (ladder);
+      ladder->have_info = FALSE;
+      ladder->frame_number = 0;
+      GST_OBJECT_LOCK (ladder);
+      ladder->need_configure = TRUE;
+      GST_OBJECT_UNLOCK (ladder);
+      break;
+    default:
+      break;
+  }
+
+  return ret;
+}
+
+static GObject *
+gst_ffmpegladder_child_proxy_get_child_by_index (GstChildProxy * child_proxy,
+    guint index)
+{
+  GstElement *element = GST_ELEMENT (child_proxy);
+  GObject *obj = NULL;
+
+  GST_OBJECT_LOCK (element);
+  obj = g_list_nth_data (element->srcpads, index);
+  if (obj)
+    gst_object_ref (obj);
+  GST_OBJECT_UNLOCK (element);
+
+  return obj;
+}
+
+static guint
+gst_ffmpegladder_child_proxy_get_children_count (GstChildProxy * child_proxy)
+{
+  GstElement *element = GST_ELEMENT (child_proxy);
+  guint count;
+
+  GST_OBJECT_LOCK (element);
+  count = element->numsrcpads;
+  GST_OBJECT_UNLOCK (element);
+
+  return count;
+}
+
+static void
+gst_ffmpegladder_child_proxy_init (gpointer g_iface, gpointer iface_data)
+{
+  GstChildProxyInterface *iface = g_iface;
+
+  iface->get_child_by_index = gst_ffmpegladder_child_proxy_get_child_by_index;
+  iface->get_children_count = gst_ffmpegladder_child_proxy_get_children_count;
+}
+
+static void
+gst_ffmpegladder_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstFFMpegLadder *ladder = GST_FFMPEGLADDER (object);
+
+  GST_OBJECT_LOCK (ladder);
+  switch (prop_id) {
+    case PROP_CODEC:
+      g_free (ladder->codec_name);
+      ladder->codec_name = g_value_dup_string (value);
+      ladder->need_configure = TRUE;
+      break;
+    case PROP_OPTIONS:
+      g_free (ladder->options);
+      ladder->options = g_value_dup_string (value);
+      ladder->need_configure = TRUE;
+      break;
+    case PROP_KEYFRAME_INTERVAL:
+      ladder->keyframe_interval = g_value_get_uint (value);
+      ladder->need_configure = TRUE;
+      break;
+    case PROP_MAX_THREADS:
+      ladder->max_threads = g_value_get_uint (value);
+      ladder->need_configure = TRUE;
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (ladder);
+}
+
+static void
+gst_ffmpegladder_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstFFMpegLadder *ladder = GST_FFMPEGLADDER (object);
+
+  GST_OBJECT_LOCK (ladder);
+  switch (prop_id) {
+    case PROP_CODEC:
+      g_value_set_string (value, ladder->codec_name);
+      break;
+    case PROP_OPTIONS:
+      g_value_set_string (value, ladder->options);
+      break;
+    case PROP_KEYFRAME_INTERVAL:
+      g_value_set_uint (value, ladder->keyframe_interval);
+      break;
+    case PROP_MAX_THREADS:
+      g_value_set_uint (value, ladder->max_threads);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (ladder);
+}
+
+gboolean
+gst_ffmpegladder_register (GstPlugin * plugin)
+{
+  return gst_element_register (plugin, "avladder", GST_RANK_NONE,
+      GST_TYPE_FFMPEGLADDER);
+}
@@ -0,0 +1,367 @@
+/* GStreamer
+ * Copyright (C) 2026 BitsmithSolutions
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include <gst/video/video.h>
+#include <libavutil/pixdesc.h>
+
+#include "gstavmeta.h"
+
+/* the values are in picture coordinates, so any meta transformation that
+ * changes the size or orientation of the picture invalidates them */
+static const gchar *ffmpeg_video_meta_tags[] = {
+  GST_META_TAG_VIDEO_STR,
+  GST_META_TAG_VIDEO_ORIENTATION_STR,
+  GST_META_TAG_VIDEO_SIZE_STR,
+  NULL
+};
+
+/* motion vectors */
+
+GType
+gst_ffmpeg_motion_vectors_meta_api_get_type (void)
+{
+  static GType type = 0;
+
+  if (g_once_init_enter (&type)) {
+    GType _type =
+        gst_meta_api_type_register ("GstFFMpegMotionVectorsMetaAPI",
+        ffmpeg_video_meta_tags);
+    g_once_init_leave (&type, _type);
+  }
+  return type;
+}
+
+static gboolean
+gst_ffmpeg_motion_vectors_meta_init (GstMeta * meta, gpointer params,
+    GstBuffer * buffer)
+{
+  GstFFMpegMotionVectorsMeta *mvmeta = (GstFFMpegMotionVectorsMeta *) meta;
+
+  mvmeta->vectors = NULL;
+  mvmeta->n_vectors = 0;
+  mvmeta->buf = NULL;
+
+  return TRUE;
+}
+
+static void
+gst_ffmpeg_motion_vectors_meta_free (GstMeta * meta, GstBuffer * buffer)
+{
+  GstFFMpegMotionVectorsMeta *mvmeta = (GstFFMpegMotionVectorsMeta *) meta;
+
+  av_buffer_unref (&mvmeta->buf);
+}
+
+static gboolean
+gst_ffmpeg_motion_vectors_meta_transform (GstBuffer * dest, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  GstFFMpegMotionVectorsMeta *mvmeta = (GstFFMpegMotionVectorsMeta *) meta;
+
+  /* the vectors describe the whole picture, not a part of it */
+  if (GST_META_TRANSFORM_IS_COPY (type)
+      && !((GstMetaTransformCopy *) data)->region) {
+    return gst_buffer_add_ffmpeg_motion_vectors_meta (dest, mvmeta->buf) !=
+        NULL;
+  }
+
+  /* transform type not supported */
+  return FALSE;
+}
+
+const GstMetaInfo *
+gst_ffmpeg_motion_vectors_meta_get_info (void)
+{
+  static const GstMetaInfo *meta_info = NULL;
+
+  if (g_once_init_enter ((GstMetaInfo **) & meta_info)) {
+    const GstMetaInfo *mi =
+        gst_meta_register (GST_FFMPEG_MOTION_VECTORS_META_API_TYPE,
+        "GstFFMpegMotionVectorsMeta", sizeof (GstFFMpegMotionVectorsMeta),
+        gst_ffmpeg_motion_vectors_meta_init,
+        gst_ffmpeg_motion_vectors_meta_free,
+        gst_ffmpeg_motion_vectors_meta_transform);
+    g_once_init_leave ((GstMetaInfo **) & meta_info, (GstMetaInfo *) mi);
+  }
+  return meta_info;
+}
+
+GstFFMpegMotionVectorsMeta *
+gst_buffer_add_ffmpeg_motion_vectors_meta (GstBuffer * buffer,
+    AVBufferRef * buf)
+{
+  GstFFMpegMotionVectorsMeta *mvmeta;
+
+  g_return_val_if_fail (GST_IS_BUFFER (buffer), NULL);
+  g_return_val_if_fail (buf != NULL, NULL);
+
+  mvmeta = (GstFFMpegMotionVectorsMeta *) gst_buffer_add_meta (buffer,
+      GST_FFMPEG_MOTION_VECTORS_META_INFO, NULL);
+  if (!mvmeta)
+    return NULL;
+
+  mvmeta->buf = av_buffer_ref (buf);
+  if (!mvmeta->buf) {
+    gst_buffer_remove_meta (buffer, (GstMeta *) mvmeta);
+    return NULL;
+  }
+
+  mvmeta->vectors = (const AVMotionVector *) mvmeta->buf->data;
+  mvmeta->n_vectors = mvmeta->buf->size / sizeof (AVMotionVector);
+
+  return mvmeta;
+}
+
+#ifdef HAVE_AV_VIDEO_ENC_PARAMS
+/* quantisation parameters */
+
+GType
+gst_ffmpeg_qp_meta_api_get_type (void)
+{
+  static GType type = 0;
+
+  if (g_once_init_enter (&type)) {
+    GType _type = gst_meta_api_type_register ("GstFFMpegQPMetaAPI",
+        ffmpeg_video_meta_tags);
+    g_once_init_leave (&type, _type);
+  }
+  return type;
+}
+
+static gboolean
+gst_ffmpeg_qp_meta_init (GstMeta * meta, gpointer params, GstBuffer * buffer)
+{
+  GstFFMpegQPMeta *qpmeta = (GstFFMpegQPMeta *) meta;
+
+  qpmeta->params = NULL;
+  qpmeta->buf = NULL;
+
+  return TRUE;
+}
+
+static void
+gst_ffmpeg_qp_meta_free (GstMeta * meta, GstBuffer * buffer)
+{
+  GstFFMpegQPMeta *qpmeta = (GstFFMpegQPMeta *) meta;
+
+  av_buffer_unref (&qpmeta->buf);
+}
+
+static gboolean
+gst_ffmpeg_qp_meta_transform (GstBuffer * dest, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  GstFFMpegQPMeta *qpmeta = (GstFFMpegQPMeta *) meta;
+
+  /* one value per macroblock of the whole picture */
+  if (GST_META_TRANSFORM_IS_COPY (type)
+      && !((GstMetaTransformCopy *) data)->region)
+    return gst_buffer_add_ffmpeg_qp_meta (dest, qpmeta->buf) != NULL;
+
+  /* transform type not supported */
+  return FALSE;
+}
+
+const GstMetaInfo *
+gst_ffmpeg_qp_meta_get_info (void)
+{
+  static const GstMetaInfo *meta_info = NULL;
+
+  if (g_once_init_enter ((GstMetaInfo **) & meta_info)) {
+    const GstMetaInfo *mi = gst_meta_register (GST_FFMPEG_QP_META_API_TYPE,
+        "GstFFMpegQPMeta", sizeof (GstFFMpegQPMeta),
+        gst_ffmpeg_qp_meta_init, gst_ffmpeg_qp_meta_free,
+        gst_ffmpeg_qp_meta_transform);
+    g_once_init_leave ((GstMetaInfo **) & meta_info, (GstMetaInfo *) mi);
+  }
+  return meta_info;
+}
+
+GstFFMpegQPMeta *
+gst_buffer_add_ffmpeg_qp_meta (GstBuffer * buffer, AVBufferRef * buf)
+{
+  GstFFMpegQPMeta *qpmeta;
+
+  g_return_val_if_fail (GST_IS_BUFFER (buffer), NULL);
+  g_return_val_if_fail (buf != NULL, NULL);
+
+  qpmeta = (GstFFMpegQPMeta *) gst_buffer_add_meta (buffer,
+      GST_FFMPEG_QP_META_INFO, NULL);
+  if (!qpmeta)
+    return NULL;
+
+  qpmeta->buf = av_buffer_ref (buf);
+  if (!qpmeta->buf) {
+    gst_buffer_remove_meta (buffer, (GstMeta *) qpmeta);
+    return NULL;
+  }
+
+  qpmeta->params = (AVVideoEncParams *) qpmeta->buf->data;
+
+  return qpmeta;
+}
+#endif
+
+/* encoder statistics */
+
+GType
+gst_ffmpeg_encoder_stats_meta_api_get_type (void)
+{
+  static GType type = 0;
+  static const gchar *tags[] = { NULL };
+
+  if (g_once_init_enter (&type)) {
+    GType _type = gst_meta_api_type_register ("GstFFMpegEncoderStatsMetaAPI",
+        tags);
+    g_once_init_leave (&type, _type);
+  }
+  return type;
+}
+
+static gboolean
+gst_ffmpeg_encoder_stats_meta_init (GstMeta * meta, gpointer params,
+    GstBuffer * buffer)
+{
+  GstFFMpegEncoderStatsMeta *smeta = (GstFFMpegEncoderStatsMeta *) meta;
+
+  smeta->pict_type = AV_PICTURE_TYPE_NONE;
+  smeta->quality = 0;
+  smeta->size = 0;
+  smeta->n_planes = 0;
+  memset (smeta->error, 0, sizeof (smeta->error));
+  memset (smeta->psnr, 0, sizeof (smeta->psnr));
+
+  return TRUE;
+}
+
+static gboolean
+gst_ffmpeg_encoder_stats_meta_transform (GstBuffer * dest, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  GstFFMpegEncoderStatsMeta *smeta = (GstFFMpegEncoderStatsMeta *) meta;
+  GstFFMpegEncoderStatsMeta *dmeta;
+
+  if (GST_META_TRANSFORM_IS_COPY (type)) {
+    dmeta = (GstFFMpegEncoderStatsMeta *) gst_buffer_add_meta (dest,
+        GST_FFMPEG_ENCODER_STATS_META_INFO, NULL);
+    if (!dmeta)
+      return FALSE;
+
+    dmeta->pict_type = smeta->pict_type;
+    dmeta->quality = smeta->quality;
+    dmeta->size = smeta->size;
+    dmeta->n_planes = smeta->n_planes;
+    memcpy (dmeta->error, smeta->error, sizeof (smeta->error));
+    memcpy (dmeta->psnr, smeta->psnr, sizeof (smeta->psnr));
+    return TRUE;
+  }
+
+  /* transform type not supported */
+  return FALSE;
+}
+
+const GstMetaInfo *
+gst_ffmpeg_encoder_stats_meta_get_info (void)
+{
+  static const GstMetaInfo *meta_info = NULL;
+
+  if (g_once_init_enter ((GstMetaInfo **) & meta_info)) {
+    const GstMetaInfo *mi =
+        gst_meta_register (GST_FFMPEG_ENCODER_STATS_META_API_TYPE,
+        "GstFFMpegEncoderStatsMeta", sizeof (GstFFMpegEncoderStatsMeta),
+        gst_ffmpeg_encoder_stats_meta_init, NULL,
+        gst_ffmpeg_encoder_stats_meta_transform);
+    g_once_init_leave ((GstMetaInfo **) & meta_info, (GstMetaInfo *) mi);
+  }
+  return meta_info;
+}
+
+/* PSNR of a plane from its sum of squared errors, as the ffmpeg tool
+ * reports it */
+static gdouble
+gst_ffmpeg_encoder_stats_psnr (guint64 error, const AVCodecContext * context,
+    guint plane)
+{
+  const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get (context->pix_fmt);
+  gint width = context->width, height = context->height;
+  gdouble max;
+
+  if (!desc)
+    return 0.0;
+
+  if (plane == 1 || plane == 2) {
+    width = AV_CEIL_RSHIFT (width, desc->log2_chroma_w);
+    height = AV_CEIL_RSHIFT (height, desc->log2_chroma_h);
+  }
+  if (error == 0)
+    return INFINITY;
+
+  max = (1 << desc->comp[0].depth) - 1;
+  return 10.0 * log10 (max * max * width * height / (gdouble) error);
+}
+
+GstFFMpegEncoderStatsMeta *
+gst_buffer_add_ffmpeg_encoder_stats_meta (GstBuffer * buffer,
+    const AVPacket * pkt, const AVCodecContext * context)
+{
+  GstFFMpegEncoderStatsMeta *smeta;
+  guint i;
+  gint j;
+
+  g_return_val_if_fail (GST_IS_BUFFER (buffer), NULL);
+  g_return_val_if_fail (pkt != NULL, NULL);
+
+  smeta = (GstFFMpegEncoderStatsMeta *) gst_buffer_add_meta (buffer,
+      GST_FFMPEG_ENCODER_STATS_META_INFO, NULL);
+  if (!smeta)
+    return NULL;
+
+  smeta->size = pkt->size;
+
+  /* u32le quality, u8 picture type, u8 error count, u16 reserved, then
+   * u64le errors */
+  for (j = 0; j < pkt->side_data_elems; j++) {
+    const AVPacketSideData *sd = &pkt->side_data[j];
+
+    if (sd->type != AV_PKT_DATA_QUALITY_STATS || sd->size < 8)
+      continue;
+
+    smeta->quality = GST_READ_UINT32_LE (sd->data);
+    smeta->pict_type = sd->data[4];
+    smeta->n_planes = MIN (sd->data[5], G_N_ELEMENTS (smeta->error));
+    smeta->n_planes = MIN (smeta->n_planes, (sd->size - 8) / 8);
+
+    for (i = 0; i < smeta->n_planes; i++) {
+      smeta->error[i] = GST_READ_UINT64_LE (sd->data + 8 + 8 * i);
+      if (context && (context->flags & AV_CODEC_FLAG_PSNR))
+        smeta->psnr[i] =
+            gst_ffmpeg_encoder_stats_psnr (smeta->error[i], context, i);
+    }
+    break;
+  }
+
+  return smeta;
+}
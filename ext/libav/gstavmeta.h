@@ -0,0 +1,148 @@
+/* GStreamer
+ * Copyright (C) 2026 BitsmithSolutions
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_FFMPEG_META_H__
+#define __GST_FFMPEG_META_H__
+
+#include <gst/gst.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+#include <libavutil/motion_vector.h>
+#include <libavutil/version.h>
+
+#if AV_VERSION_INT (LIBAVUTIL_VERSION_MAJOR, LIBAVUTIL_VERSION_MINOR, LIBAVUTIL_VERSION_MICRO) >= \
+        AV_VERSION_INT (56,45,100)
+#define HAVE_AV_VIDEO_ENC_PARAMS
+#include <libavutil/video_enc_params.h>
+#endif
+
+G_BEGIN_DECLS
+
+/*
+ * GstFFMpegMotionVectorsMeta:
+ *
+ * Motion vectors exported by the decoder for the attached picture, as found
+ * in the AV_FRAME_DATA_MOTION_VECTORS side data. The meta keeps a reference
+ * on the libav side data, so no copy of the vectors is made.
+ *
+ * Applications can look it up by the "GstFFMpegMotionVectorsMetaAPI" API
+ * type name.
+ */
+typedef struct _GstFFMpegMotionVectorsMeta GstFFMpegMotionVectorsMeta;
+
+struct _GstFFMpegMotionVectorsMeta
+{
+  GstMeta meta;
+
+  const AVMotionVector *vectors;
+  guint n_vectors;
+
+  /* < private > */
+  AVBufferRef *buf;
+};
+
+#define GST_FFMPEG_MOTION_VECTORS_META_API_TYPE \
+    (gst_ffmpeg_motion_vectors_meta_api_get_type ())
+#define GST_FFMPEG_MOTION_VECTORS_META_INFO \
+    (gst_ffmpeg_motion_vectors_meta_get_info ())
+
+GType gst_ffmpeg_motion_vectors_meta_api_get_type (void);
+const GstMetaInfo *gst_ffmpeg_motion_vectors_meta_get_info (void);
+
+GstFFMpegMotionVectorsMeta *
+gst_buffer_add_ffmpeg_motion_vectors_meta (GstBuffer * buffer,
+    AVBufferRef * buf);
+
+#ifdef HAVE_AV_VIDEO_ENC_PARAMS
+/*
+ * GstFFMpegQPMeta:
+ *
+ * Quantisation parameters of the attached picture, as found in the
+ * AV_FRAME_DATA_VIDEO_ENC_PARAMS side data. @params gives the frame QP
+ * and, for codecs that export them, the per-block QP deltas; use
+ * av_video_enc_params_block() to access the blocks.
+ *
+ * Applications can look it up by the "GstFFMpegQPMetaAPI" API type name.
+ */
+typedef struct _GstFFMpegQPMeta GstFFMpegQPMeta;
+
+struct _GstFFMpegQPMeta
+{
+  GstMeta meta;
+
+  AVVideoEncParams *params;
+
+  /* < private > */
+  AVBufferRef *buf;
+};
+
+#define GST_FFMPEG_QP_META_API_TYPE (gst_ffmpeg_qp_meta_api_get_type ())
+#define GST_FFMPEG_QP_META_INFO (gst_ffmpeg_qp_meta_get_info ())
+
+GType gst_ffmpeg_qp_meta_api_get_type (void);
+const GstMetaInfo *gst_ffmpeg_qp_meta_get_info (void);
+
+GstFFMpegQPMeta *
+gst_buffer_add_ffmpeg_qp_meta (GstBuffer * buffer, AVBufferRef * buf);
+#endif
+
+/*
+ * GstFFMpegEncoderStatsMeta:
+ *
+ * Rate control outcome of the attached encoded packet: its picture type,
+ * the quality the encoder used for it (a lambda, FF_QP2LAMBDA times the
+ * average QP) and its size. With the psnr flag set on the encoder, @error
+ * holds the sum of squared errors of each of the @n_planes planes and @psnr
+ * the matching PSNR in dB. Picture type, quality and errors come from the
+ * AV_PKT_DATA_QUALITY_STATS side data and stay at AV_PICTURE_TYPE_NONE and
+ * 0 when the encoder doesn't export it.
+ *
+ * Applications can look it up by the "GstFFMpegEncoderStatsMetaAPI" API
+ * type name.
+ */
+typedef struct _GstFFMpegEncoderStatsMeta GstFFMpegEncoderStatsMeta;
+
+struct _GstFFMpegEncoderStatsMeta
+{
+  GstMeta meta;
+
+  enum AVPictureType pict_type;
+  gint quality;
+  gsize size;
+
+  guint n_planes;
+  guint64 error[4];
+  gdouble psnr[4];
+};
+
+#define GST_FFMPEG_ENCODER_STATS_META_API_TYPE \
+    (gst_ffmpeg_encoder_stats_meta_api_get_type ())
+#define GST_FFMPEG_ENCODER_STATS_META_INFO \
+    (gst_ffmpeg_encoder_stats_meta_get_info ())
+
+GType gst_ffmpeg_encoder_stats_meta_api_get_type (void);
+const GstMetaInfo *gst_ffmpeg_encoder_stats_meta_get_info (void);
+
+GstFFMpegEncoderStatsMeta *
+gst_buffer_add_ffmpeg_encoder_stats_meta (GstBuffer * buffer,
+    const AVPacket * pkt, const AVCodecContext * context);
+
+G_END_DECLS
+
+#endif /* __GST_FFMPEG_META_H__ */
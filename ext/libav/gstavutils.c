@@ -31,7 +31,30 @@
 #include <stdlib.h>
 #endif
 
+#include <string.h>
+
+#include <gst/base/gstqueuearray.h>
+
+#include <libavutil/cpu.h>
 #include <libavutil/mem.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#define HAVE_STREAMING_STORES
+#endif
+
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_PERFORMANCE);
 
 const gchar *
 gst_ffmpeg_get_codecid_longname (enum AVCodecID codec_id)
@@ -493,3 +516,1646 @@ gst_ffmpeg_auto_max_threads (void)
 
   return (int) (n_threads);
 }
+
+const gchar *const gst_ffmpeg_lookahead_opts[] = {
+  "rc-lookahead", "rc_lookahead", "lag-in-frames", NULL
+};
+
+guint
+gst_ffmpeg_encoder_get_delay (AVCodecContext * context)
+{
+  gint64 lookahead;
+  guint frames;
+  gint i;
+
+  /* the reordering delay, which the MPEG video encoders report as delay
+   * and the others only through their B-frames */
+  if (context->delay > 0)
+    frames = context->delay;
+  else
+    frames = MAX (MAX (context->max_b_frames, context->has_b_frames), 0);
+
+  for (i = 0; gst_ffmpeg_lookahead_opts[i]; i++) {
+    if (av_opt_get_int (context, gst_ffmpeg_lookahead_opts[i],
+            AV_OPT_SEARCH_CHILDREN, &lookahead) >= 0 && lookahead > 0) {
+      frames += lookahead;
+      break;
+    }
+  }
+
+  if ((context->active_thread_type & FF_THREAD_FRAME)
+      && context->thread_count > 1)
+    frames += context->thread_count - 1;
+
+  return frames;
+}
+
+struct _GstFFMpegIdleWatch
+{
+  gint refcount;
+  GstElement *element;
+  GstFFMpegIdleFunc func;
+  GstClockID id;
+
+  GMutex lock;
+  GThreadPool *pool;
+  gboolean queued;
+};
+
+static void
+gst_ffmpeg_idle_watch_unref (GstFFMpegIdleWatch * watch)
+{
+  if (!g_atomic_int_dec_and_test (&watch->refcount))
+    return;
+
+  gst_object_unref (watch->element);
+  g_mutex_clear (&watch->lock);
+  g_slice_free (GstFFMpegIdleWatch, watch);
+}
+
+static void
+gst_ffmpeg_idle_watch_func (gpointer data, gpointer user_data)
+{
+  GstFFMpegIdleWatch *watch = user_data;
+
+  watch->func (watch->element);
+
+  g_mutex_lock (&watch->lock);
+  watch->queued = FALSE;
+  g_mutex_unlock (&watch->lock);
+}
+
+static gboolean
+gst_ffmpeg_idle_watch_cb (GstClock * clock, GstClockTime time, GstClockID id,
+    gpointer user_data)
+{
+  GstFFMpegIdleWatch *watch = user_data;
+
+  /* the pool is gone once the watch is being freed */
+  g_mutex_lock (&watch->lock);
+  if (watch->pool && !watch->queued) {
+    watch->queued = TRUE;
+    g_thread_pool_push (watch->pool, watch, NULL);
+  }
+  g_mutex_unlock (&watch->lock);
+
+  return TRUE;
+}
+
+GstFFMpegIdleWatch *
+gst_ffmpeg_idle_watch_new (GstElement * element, GstClockTime interval,
+    GstFFMpegIdleFunc func)
+{
+  GstFFMpegIdleWatch *watch;
+  GstClock *clock;
+
+  watch = g_slice_new0 (GstFFMpegIdleWatch);
+  watch->refcount = 1;
+  watch->element = gst_object_ref (element);
+  watch->func = func;
+  g_mutex_init (&watch->lock);
+  watch->pool = g_thread_pool_new (gst_ffmpeg_idle_watch_func, watch, 1,
+      FALSE, NULL);
+
+  clock = gst_system_clock_obtain ();
+  watch->id = gst_clock_new_periodic_id (clock,
+      gst_clock_get_time (clock) + interval, interval);
+  gst_object_unref (clock);
+
+  /* the clock keeps its own reference until the id is freed */
+  g_atomic_int_inc (&watch->refcount);
+  if (gst_clock_id_wait_async (watch->id, gst_ffmpeg_idle_watch_cb, watch,
+          (GDestroyNotify) gst_ffmpeg_idle_watch_unref) != GST_CLOCK_OK) {
+    GST_WARNING_OBJECT (element, "failed to schedule idle watch");
+    gst_ffmpeg_idle_watch_unref (watch);
+    gst_ffmpeg_idle_watch_free (watch);
+    return NULL;
+  }
+
+  return watch;
+}
+
+void
+gst_ffmpeg_idle_watch_free (GstFFMpegIdleWatch * watch)
+{
+  GThreadPool *pool;
+
+  gst_clock_id_unschedule (watch->id);
+  gst_clock_id_unref (watch->id);
+
+  g_mutex_lock (&watch->lock);
+  pool = watch->pool;
+  watch->pool = NULL;
+  g_mutex_unlock (&watch->lock);
+
+  /* waits for a running callback */
+  g_thread_pool_free (pool, TRUE, TRUE);
+
+  gst_ffmpeg_idle_watch_unref (watch);
+}
+
+typedef struct
+{
+  GString *stats;
+  gboolean complete;
+} MultipassStats;
+
+static GMutex multipass_lock;
+static GHashTable *multipass_stats;
+
+static void
+multipass_stats_free (MultipassStats * entry)
+{
+  g_string_free (entry->stats, TRUE);
+  g_slice_free (MultipassStats, entry);
+}
+
+void
+gst_ffmpeg_multipass_stats_begin (const gchar * id)
+{
+  MultipassStats *entry;
+
+  entry = g_slice_new (MultipassStats);
+  entry->stats = g_string_new (NULL);
+  entry->complete = FALSE;
+
+  g_mutex_lock (&multipass_lock);
+  if (!multipass_stats)
+    multipass_stats = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+        (GDestroyNotify) multipass_stats_free);
+  g_hash_table_replace (multipass_stats, g_strdup (id), entry);
+  g_mutex_unlock (&multipass_lock);
+}
+
+void
+gst_ffmpeg_multipass_stats_append (const gchar * id, const gchar * stats)
+{
+  MultipassStats *entry;
+
+  g_mutex_lock (&multipass_lock);
+  if (multipass_stats && (entry = g_hash_table_lookup (multipass_stats, id)))
+    g_string_append (entry->stats, stats);
+  g_mutex_unlock (&multipass_lock);
+}
+
+void
+gst_ffmpeg_multipass_stats_end (const gchar * id)
+{
+  MultipassStats *entry;
+
+  g_mutex_lock (&multipass_lock);
+  if (multipass_stats && (entry = g_hash_table_lookup (multipass_stats, id)))
+    entry->complete = TRUE;
+  g_mutex_unlock (&multipass_lock);
+}
+
+gchar *
+gst_ffmpeg_multipass_stats_get (const gchar * id)
+{
+  MultipassStats *entry;
+  gchar *stats = NULL;
+
+  g_mutex_lock (&multipass_lock);
+  if (multipass_stats && (entry = g_hash_table_lookup (multipass_stats, id))
+      && entry->complete)
+    stats = g_strndup (entry->stats->str, entry->stats->len);
+  g_mutex_unlock (&multipass_lock);
+
+  return stats;
+}
+
+void
+gst_ffmpeg_multipass_stats_remove (const gchar * id)
+{
+  g_mutex_lock (&multipass_lock);
+  if (multipass_stats)
+    g_hash_table_remove (multipass_stats, id);
+  g_mutex_unlock (&multipass_lock);
+}
+
+struct _GstFFMpegCodecThread
+{
+  GstElement *element;
+  GRecMutex *stream_lock;
+  guint depth;
+  GstFFMpegCodecThreadFunc func;
+  GDestroyNotify free_item;
+
+  GThread *thread;
+  GMutex lock;
+  GCond cond;
+  GstQueueArray *queue;
+  gboolean busy;
+  gboolean stopping;
+  GstFlowReturn ret;
+  /* incremented on every state change */
+  guint cookie;
+};
+
+static void
+gst_ffmpeg_codec_thread_signal (GstFFMpegCodecThread * thread)
+{
+  thread->cookie++;
+  g_cond_broadcast (&thread->cond);
+}
+
+static void
+gst_ffmpeg_codec_thread_clear (GstFFMpegCodecThread * thread)
+{
+  gpointer item;
+
+  while ((item = gst_queue_array_pop_head (thread->queue)))
+    thread->free_item (item);
+}
+
+static gpointer
+gst_ffmpeg_codec_thread_loop (gpointer data)
+{
+  GstFFMpegCodecThread *thread = data;
+  GstFlowReturn ret;
+  gpointer item;
+
+  g_mutex_lock (&thread->lock);
+  while (TRUE) {
+    while (!thread->stopping && gst_queue_array_is_empty (thread->queue))
+      g_cond_wait (&thread->cond, &thread->lock);
+    if (thread->stopping)
+      break;
+
+    item = gst_queue_array_pop_head (thread->queue);
+    thread->busy = TRUE;
+    /* there is room in the queue again */
+    gst_ffmpeg_codec_thread_signal (thread);
+    g_mutex_unlock (&thread->lock);
+
+    g_rec_mutex_lock (thread->stream_lock);
+    ret = thread->func (thread->element, item);
+    g_rec_mutex_unlock (thread->stream_lock);
+
+    g_mutex_lock (&thread->lock);
+    if (ret != GST_FLOW_OK && thread->ret == GST_FLOW_OK) {
+      GST_DEBUG_OBJECT (thread->element, "codec thread got flow %s",
+          gst_flow_get_name (ret));
+      thread->ret = ret;
+    }
+    thread->busy = FALSE;
+    gst_ffmpeg_codec_thread_signal (thread);
+  }
+  g_mutex_unlock (&thread->lock);
+
+  return NULL;
+}
+
+GstFFMpegCodecThread *
+gst_ffmpeg_codec_thread_new (GstElement * element, GRecMutex * stream_lock,
+    guint depth, GstFFMpegCodecThreadFunc func, GDestroyNotify free_item)
+{
+  GstFFMpegCodecThread *thread;
+  gchar *name;
+
+  thread = g_slice_new0 (GstFFMpegCodecThread);
+  thread->element = element;
+  thread->stream_lock = stream_lock;
+  thread->depth = MAX (depth, 1);
+  thread->func = func;
+  thread->free_item = free_item;
+  thread->ret = GST_FLOW_OK;
+  g_mutex_init (&thread->lock);
+  g_cond_init (&thread->cond);
+  /* preallocated, so queueing doesn't allocate */
+  thread->queue = gst_queue_array_new (thread->depth);
+
+  name = g_strdup_printf ("%s:codec", GST_OBJECT_NAME (element));
+  thread->thread = g_thread_new (name, gst_ffmpeg_codec_thread_loop, thread);
+  g_free (name);
+
+  return thread;
+}
+
+void
+gst_ffmpeg_codec_thread_free (GstFFMpegCodecThread * thread)
+{
+  g_mutex_lock (&thread->lock);
+  thread->stopping = TRUE;
+  gst_ffmpeg_codec_thread_signal (thread);
+  g_mutex_unlock (&thread->lock);
+
+  g_thread_join (thread->thread);
+
+  gst_ffmpeg_codec_thread_clear (thread);
+  gst_queue_array_free (thread->queue);
+  g_cond_clear (&thread->cond);
+  g_mutex_clear (&thread->lock);
+  g_slice_free (GstFFMpegCodecThread, thread);
+}
+
+/* called with thread->lock and the stream lock, waits for the next state
+ * change with the stream lock released so that the codec thread can make
+ * progress */
+static void
+gst_ffmpeg_codec_thread_cond_wait (GstFFMpegCodecThread * thread)
+{
+  guint cookie = thread->cookie;
+
+  g_mutex_unlock (&thread->lock);
+  g_rec_mutex_unlock (thread->stream_lock);
+  g_mutex_lock (&thread->lock);
+  while (cookie == thread->cookie)
+    g_cond_wait (&thread->cond, &thread->lock);
+  g_mutex_unlock (&thread->lock);
+  g_rec_mutex_lock (thread->stream_lock);
+  g_mutex_lock (&thread->lock);
+}
+
+GstFlowReturn
+gst_ffmpeg_codec_thread_push (GstFFMpegCodecThread * thread, gpointer item)
+{
+  GstFlowReturn ret;
+
+  g_mutex_lock (&thread->lock);
+  while (gst_queue_array_get_length (thread->queue) >= thread->depth
+      && thread->ret == GST_FLOW_OK)
+    gst_ffmpeg_codec_thread_cond_wait (thread);
+
+  ret = thread->ret;
+  if (ret == GST_FLOW_OK) {
+    gst_queue_array_push_tail (thread->queue, item);
+    gst_ffmpeg_codec_thread_signal (thread);
+  }
+  g_mutex_unlock (&thread->lock);
+
+  return ret;
+}
+
+GstFlowReturn
+gst_ffmpeg_codec_thread_wait (GstFFMpegCodecThread * thread)
+{
+  GstFlowReturn ret;
+
+  /* the codec thread itself might end up here when reconfiguring */
+  if (gst_ffmpeg_codec_thread_is_self (thread))
+    return GST_FLOW_OK;
+
+  g_mutex_lock (&thread->lock);
+  while (!gst_queue_array_is_empty (thread->queue) || thread->busy)
+    gst_ffmpeg_codec_thread_cond_wait (thread);
+  /* handed to the caller, which reports it instead of the next push */
+  ret = thread->ret;
+  thread->ret = GST_FLOW_OK;
+  g_mutex_unlock (&thread->lock);
+
+  return ret;
+}
+
+void
+gst_ffmpeg_codec_thread_flush (GstFFMpegCodecThread * thread)
+{
+  g_mutex_lock (&thread->lock);
+  gst_ffmpeg_codec_thread_clear (thread);
+  while (thread->busy)
+    gst_ffmpeg_codec_thread_cond_wait (thread);
+  thread->ret = GST_FLOW_OK;
+  g_mutex_unlock (&thread->lock);
+}
+
+gboolean
+gst_ffmpeg_codec_thread_is_self (GstFFMpegCodecThread * thread)
+{
+  return thread->thread == g_thread_self ();
+}
+
+/* pictures smaller than this are copied by the calling thread only */
+#define IMAGE_COPY_MIN_BAND_SIZE (512 * 1024)
+#define IMAGE_COPY_MAX_BANDS 8
+
+typedef struct
+{
+  guint8 *dst_data[4];
+  gint dst_linesizes[4];
+  const guint8 *src_data[4];
+  gint src_linesizes[4];
+  gint bytewidths[4];
+  gint heights[4];
+  gint n_planes;
+  guint n_bands;
+  gboolean streaming;
+
+  gint pending;
+  GMutex lock;
+  GCond cond;
+} ImageCopyJob;
+
+typedef struct
+{
+  ImageCopyJob *job;
+  guint band;
+} ImageCopyBand;
+
+static gsize
+gst_ffmpeg_get_cache_size (void)
+{
+  static gsize cache_size = 0;
+
+  if (g_once_init_enter (&cache_size)) {
+    glong size = 0;
+
+#if defined(HAVE_UNISTD_H) && defined(_SC_LEVEL3_CACHE_SIZE)
+    size = sysconf (_SC_LEVEL3_CACHE_SIZE);
+#endif
+    /* make a guess if we couldn't find out */
+    if (size <= 0)
+      size = 8 * 1024 * 1024;
+
+    g_once_init_leave (&cache_size, size);
+  }
+
+  return cache_size;
+}
+
+#ifdef HAVE_STREAMING_STORES
+static void
+copy_row_streaming (guint8 * dst, const guint8 * src, gsize size)
+{
+  gsize head = (16 - ((guintptr) dst & 15)) & 15;
+
+  if (head > size)
+    head = size;
+  memcpy (dst, src, head);
+  dst += head;
+  src += head;
+  size -= head;
+
+  while (size >= 64) {
+    __m128i a = _mm_loadu_si128 ((const __m128i *) src);
+    __m128i b = _mm_loadu_si128 ((const __m128i *) (src + 16));
+    __m128i c = _mm_loadu_si128 ((const __m128i *) (src + 32));
+    __m128i d = _mm_loadu_si128 ((const __m128i *) (src + 48));
+
+    _mm_stream_si128 ((__m128i *) dst, a);
+    _mm_stream_si128 ((__m128i *) (dst + 16), b);
+    _mm_stream_si128 ((__m128i *) (dst + 32), c);
+    _mm_stream_si128 ((__m128i *) (dst + 48), d);
+    dst += 64;
+    src += 64;
+    size -= 64;
+  }
+  while (size >= 16) {
+    _mm_stream_si128 ((__m128i *) dst,
+        _mm_loadu_si128 ((const __m128i *) src));
+    dst += 16;
+    src += 16;
+    size -= 16;
+  }
+  memcpy (dst, src, size);
+}
+#endif
+
+static void
+gst_ffmpeg_image_copy_band (ImageCopyJob * job, guint band)
+{
+  gint i, y, first, last;
+
+  for (i = 0; i < job->n_planes; i++) {
+    guint8 *dst;
+    const guint8 *src;
+
+    first = (gint64) job->heights[i] * band / job->n_bands;
+    last = (gint64) job->heights[i] * (band + 1) / job->n_bands;
+    dst = job->dst_data[i] + (gsize) first * job->dst_linesizes[i];
+    src = job->src_data[i] + (gsize) first * job->src_linesizes[i];
+
+#ifdef HAVE_STREAMING_STORES
+    if (job->streaming) {
+      for (y = first; y < last; y++) {
+        copy_row_streaming (dst, src, job->bytewidths[i]);
+        dst += job->dst_linesizes[i];
+        src += job->src_linesizes[i];
+      }
+      continue;
+    }
+#endif
+    if (job->dst_linesizes[i] == job->bytewidths[i] &&
+        job->src_linesizes[i] == job->bytewidths[i]) {
+      memcpy (dst, src, (gsize) job->bytewidths[i] * (last - first));
+      continue;
+    }
+    for (y = first; y < last; y++) {
+      memcpy (dst, src, job->bytewidths[i]);
+      dst += job->dst_linesizes[i];
+      src += job->src_linesizes[i];
+    }
+  }
+
+#ifdef HAVE_STREAMING_STORES
+  /* make the stores visible before signalling completion */
+  if (job->streaming)
+    _mm_sfence ();
+#endif
+}
+
+static void
+gst_ffmpeg_image_copy_func (gpointer data, gpointer user_data)
+{
+  ImageCopyBand *band = data;
+  ImageCopyJob *job = band->job;
+
+  gst_ffmpeg_image_copy_band (job, band->band);
+
+  g_mutex_lock (&job->lock);
+  if (--job->pending == 0)
+    g_cond_signal (&job->cond);
+  g_mutex_unlock (&job->lock);
+}
+
+static GThreadPool *
+gst_ffmpeg_get_copy_pool (void)
+{
+  static GThreadPool *pool = NULL;
+
+  if (g_once_init_enter (&pool)) {
+    GThreadPool *p = g_thread_pool_new (gst_ffmpeg_image_copy_func, NULL,
+        MIN (gst_ffmpeg_auto_max_threads (), IMAGE_COPY_MAX_BANDS) - 1,
+        FALSE, NULL);
+
+    g_once_init_leave (&pool, p);
+  }
+
+  return pool;
+}
+
+void
+gst_ffmpeg_image_copy (uint8_t * dst_data[4], int dst_linesizes[4],
+    const uint8_t * src_data[4], const int src_linesizes[4],
+    enum AVPixelFormat pix_fmt, int width, int height)
+{
+  const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get (pix_fmt);
+  ImageCopyBand bands[IMAGE_COPY_MAX_BANDS];
+  ImageCopyJob job;
+  gsize total = 0;
+  guint n_threads;
+  gint i;
+
+  n_threads = MIN (gst_ffmpeg_auto_max_threads (), IMAGE_COPY_MAX_BANDS);
+
+  /* leave the special cases to libav */
+  if (n_threads < 2 || !desc || (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL |
+              AV_PIX_FMT_FLAG_PAL
+#ifdef AV_PIX_FMT_FLAG_PSEUDOPAL
+              | AV_PIX_FMT_FLAG_PSEUDOPAL
+#endif
+          )))
+    goto fallback;
+
+  memset (&job, 0, sizeof (job));
+  job.n_planes = av_pix_fmt_count_planes (pix_fmt);
+  if (job.n_planes <= 0 || job.n_planes > 4)
+    goto fallback;
+
+  for (i = 0; i < job.n_planes; i++) {
+    job.dst_data[i] = dst_data[i];
+    job.dst_linesizes[i] = dst_linesizes[i];
+    job.src_data[i] = src_data[i];
+    job.src_linesizes[i] = src_linesizes[i];
+    job.bytewidths[i] = av_image_get_linesize (pix_fmt, width, i);
+    if (job.bytewidths[i] < 0)
+      goto fallback;
+    job.heights[i] = height;
+    if (i == 1 || i == 2)
+      job.heights[i] = AV_CEIL_RSHIFT (height, desc->log2_chroma_h);
+    total += (gsize) job.bytewidths[i] * job.heights[i];
+  }
+
+  job.n_bands = MIN (n_threads, total / IMAGE_COPY_MIN_BAND_SIZE);
+  if (job.n_bands < 2)
+    goto fallback;
+
+  /* the destination won't be read back from the cache soon anyway */
+  job.streaming = total > gst_ffmpeg_get_cache_size ();
+  job.pending = job.n_bands - 1;
+  g_mutex_init (&job.lock);
+  g_cond_init (&job.cond);
+
+  for (i = 1; i < job.n_bands; i++) {
+    bands[i].job = &job;
+    bands[i].band = i;
+    g_thread_pool_push (gst_ffmpeg_get_copy_pool (), &bands[i], NULL);
+  }
+
+  /* do our share while waiting */
+  gst_ffmpeg_image_copy_band (&job, 0);
+
+  g_mutex_lock (&job.lock);
+  while (job.pending > 0)
+    g_cond_wait (&job.cond, &job.lock);
+  g_mutex_unlock (&job.lock);
+
+  g_cond_clear (&job.cond);
+  g_mutex_clear (&job.lock);
+
+  return;
+
+fallback:
+  av_image_copy (dst_data, dst_linesizes, src_data, src_linesizes, pix_fmt,
+      width, height);
+}
+
+struct _GstFFMpegFreeList
+{
+  gint refcount;
+  gchar *name;
+  gsize size;
+  GDestroyNotify clear_item;
+
+  GMutex lock;
+  GstFFMpegFreeListItem *items;
+  guint n_allocated;
+};
+
+struct _GstFFMpegFreeListItem
+{
+  GstFFMpegFreeList *list;
+  GstFFMpegFreeListItem *next;
+};
+
+/* keep the object aligned for anything it may contain */
+#define FREE_LIST_ITEM_HEADER_SIZE \
+    GST_ROUND_UP_16 (sizeof (GstFFMpegFreeListItem))
+
+#define FREE_LIST_ITEM_DATA(item) \
+    ((gpointer) (((guint8 *) (item)) + FREE_LIST_ITEM_HEADER_SIZE))
+#define FREE_LIST_ITEM_FROM_DATA(data) \
+    ((GstFFMpegFreeListItem *) \
+        (((guint8 *) (data)) - FREE_LIST_ITEM_HEADER_SIZE))
+
+GstFFMpegFreeList *
+gst_ffmpeg_free_list_new (const gchar * name, gsize size,
+    GDestroyNotify clear_item)
+{
+  GstFFMpegFreeList *list;
+
+  GST_DEBUG_CATEGORY_GET (GST_CAT_PERFORMANCE, "GST_PERFORMANCE");
+
+  list = g_slice_new0 (GstFFMpegFreeList);
+  list->refcount = 1;
+  list->name = g_strdup (name);
+  list->size = size;
+  list->clear_item = clear_item;
+  g_mutex_init (&list->lock);
+
+  return list;
+}
+
+static GstFFMpegFreeList *
+gst_ffmpeg_free_list_ref (GstFFMpegFreeList * list)
+{
+  g_atomic_int_inc (&list->refcount);
+
+  return list;
+}
+
+void
+gst_ffmpeg_free_list_unref (GstFFMpegFreeList * list)
+{
+  GstFFMpegFreeListItem *item;
+
+  if (!g_atomic_int_dec_and_test (&list->refcount))
+    return;
+
+  GST_CAT_DEBUG (GST_CAT_PERFORMANCE, "%s: freeing %u cached objects",
+      list->name, list->n_allocated);
+
+  while ((item = list->items)) {
+    list->items = item->next;
+    if (list->clear_item)
+      list->clear_item (FREE_LIST_ITEM_DATA (item));
+    g_free (item);
+  }
+
+  g_mutex_clear (&list->lock);
+  g_free (list->name);
+  g_slice_free (GstFFMpegFreeList, list);
+}
+
+gpointer
+gst_ffmpeg_free_list_alloc (GstFFMpegFreeList * list)
+{
+  GstFFMpegFreeListItem *item;
+
+  g_mutex_lock (&list->lock);
+  item = list->items;
+  if (item)
+    list->items = item->next;
+  else
+    list->n_allocated++;
+  g_mutex_unlock (&list->lock);
+
+  if (!item) {
+    GST_CAT_DEBUG (GST_CAT_PERFORMANCE, "%s: allocating object %u",
+        list->name, list->n_allocated);
+    item = g_malloc0 (FREE_LIST_ITEM_HEADER_SIZE + list->size);
+  }
+
+  /* every object in use keeps the list alive */
+  item->list = gst_ffmpeg_free_list_ref (list);
+  item->next = NULL;
+
+  return FREE_LIST_ITEM_DATA (item);
+}
+
+void
+gst_ffmpeg_free_list_release (gpointer data)
+{
+  GstFFMpegFreeListItem *item = FREE_LIST_ITEM_FROM_DATA (data);
+  GstFFMpegFreeList *list = item->list;
+
+  g_mutex_lock (&list->lock);
+  item->list = NULL;
+  item->next = list->items;
+  list->items = item;
+  g_mutex_unlock (&list->lock);
+
+  gst_ffmpeg_free_list_unref (list);
+}
+
+void
+gst_ffmpeg_free_list_trim (GstFFMpegFreeList * list)
+{
+  GstFFMpegFreeListItem *items, *item;
+  guint n_freed = 0;
+
+  g_mutex_lock (&list->lock);
+  items = list->items;
+  list->items = NULL;
+  g_mutex_unlock (&list->lock);
+
+  while ((item = items)) {
+    items = item->next;
+    if (list->clear_item)
+      list->clear_item (FREE_LIST_ITEM_DATA (item));
+    g_free (item);
+    n_freed++;
+  }
+
+  g_mutex_lock (&list->lock);
+  list->n_allocated -= n_freed;
+  g_mutex_unlock (&list->lock);
+
+  GST_CAT_DEBUG (GST_CAT_PERFORMANCE, "%s: freed %u cached objects",
+      list->name, n_freed);
+}
+
+typedef struct
+{
+  GstAllocator parent;
+} GstFFMpegPaddedAllocator;
+
+typedef struct
+{
+  GstAllocatorClass parent_class;
+} GstFFMpegPaddedAllocatorClass;
+
+static GType gst_ffmpeg_padded_allocator_get_type (void);
+
+G_DEFINE_TYPE (GstFFMpegPaddedAllocator, gst_ffmpeg_padded_allocator,
+    GST_TYPE_ALLOCATOR);
+
+/* the memory itself comes from the system allocator, only the parameters
+ * are adjusted so that libav can read it in place */
+static GstMemory *
+gst_ffmpeg_padded_allocator_alloc (GstAllocator * allocator, gsize size,
+    GstAllocationParams * params)
+{
+  GstAllocationParams padded;
+
+  if (params)
+    padded = *params;
+  else
+    gst_allocation_params_init (&padded);
+
+  padded.flags |= GST_MEMORY_FLAG_ZERO_PADDED;
+  padded.align |= 15;
+  padded.padding = MAX (padded.padding, AV_INPUT_BUFFER_PADDING_SIZE);
+
+  return gst_allocator_alloc (NULL, size, &padded);
+}
+
+static void
+gst_ffmpeg_padded_allocator_class_init (GstFFMpegPaddedAllocatorClass * klass)
+{
+  GstAllocatorClass *allocator_class = GST_ALLOCATOR_CLASS (klass);
+
+  allocator_class->alloc = gst_ffmpeg_padded_allocator_alloc;
+}
+
+static void
+gst_ffmpeg_padded_allocator_init (GstFFMpegPaddedAllocator * allocator)
+{
+  GstAllocator *alloc = GST_ALLOCATOR_CAST (allocator);
+
+  alloc->mem_type = GST_ALLOCATOR_SYSMEM;
+  GST_OBJECT_FLAG_SET (allocator, GST_ALLOCATOR_FLAG_CUSTOM_ALLOC);
+}
+
+GstAllocator *
+gst_ffmpeg_padded_allocator_get (void)
+{
+  static GstAllocator *allocator = NULL;
+
+  if (g_once_init_enter (&allocator)) {
+    GstAllocator *a = g_object_new (gst_ffmpeg_padded_allocator_get_type (),
+        NULL);
+
+    gst_object_ref_sink (a);
+    GST_OBJECT_FLAG_SET (a, GST_OBJECT_FLAG_MAY_BE_LEAKED);
+    g_once_init_leave (&allocator, a);
+  }
+
+  return allocator;
+}
+
+void
+gst_ffmpeg_propose_padded_allocation (GstElement * element, GstQuery * query,
+    guint size, gsize align)
+{
+  GstAllocator *allocator = gst_ffmpeg_padded_allocator_get ();
+  GstAllocationParams params;
+  GstBufferPool *pool;
+  GstStructure *config;
+  GstCaps *caps;
+  gboolean need_pool;
+
+  gst_allocation_params_init (&params);
+  params.flags = GST_MEMORY_FLAG_ZERO_PADDED;
+  params.align = align;
+  params.padding = AV_INPUT_BUFFER_PADDING_SIZE;
+  gst_query_add_allocation_param (query, allocator, &params);
+
+  gst_query_parse_allocation (query, &caps, &need_pool);
+  if (!need_pool || !caps || size == 0)
+    return;
+
+  pool = gst_buffer_pool_new ();
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_set_params (config, caps, size, 0, 0);
+  gst_buffer_pool_config_set_allocator (config, allocator, &params);
+  if (gst_buffer_pool_set_config (pool, config)) {
+    GST_DEBUG_OBJECT (element, "proposing padded pool of %u bytes buffers",
+        size);
+    gst_query_add_allocation_pool (query, pool, size, 0, 0);
+  }
+  gst_object_unref (pool);
+}
+
+/* gather kernels, dst[c] = src[src_channel[c]] for each frame. The common
+ * layouts get unrolled loops with the permutation in registers */
+#define DEFINE_REORDER_COPY(type,bits)                                      \
+static void                                                                 \
+reorder_copy_##bits (type * dst, const type * src, gint n_frames,           \
+    gint channels, const gint * src_channel)                                \
+{                                                                           \
+  gint i, c;                                                                \
+                                                                            \
+  if (channels == 6) {                                                      \
+    const gint c0 = src_channel[0], c1 = src_channel[1];                    \
+    const gint c2 = src_channel[2], c3 = src_channel[3];                    \
+    const gint c4 = src_channel[4], c5 = src_channel[5];                    \
+                                                                            \
+    for (i = 0; i < n_frames; i++, dst += 6, src += 6) {                    \
+      dst[0] = src[c0]; dst[1] = src[c1]; dst[2] = src[c2];                 \
+      dst[3] = src[c3]; dst[4] = src[c4]; dst[5] = src[c5];                 \
+    }                                                                       \
+  } else if (channels == 8) {                                               \
+    const gint c0 = src_channel[0], c1 = src_channel[1];                    \
+    const gint c2 = src_channel[2], c3 = src_channel[3];                    \
+    const gint c4 = src_channel[4], c5 = src_channel[5];                    \
+    const gint c6 = src_channel[6], c7 = src_channel[7];                    \
+                                                                            \
+    for (i = 0; i < n_frames; i++, dst += 8, src += 8) {                    \
+      dst[0] = src[c0]; dst[1] = src[c1]; dst[2] = src[c2];                 \
+      dst[3] = src[c3]; dst[4] = src[c4]; dst[5] = src[c5];                 \
+      dst[6] = src[c6]; dst[7] = src[c7];                                   \
+    }                                                                       \
+  } else {                                                                  \
+    for (i = 0; i < n_frames; i++, dst += channels, src += channels)        \
+      for (c = 0; c < channels; c++)                                        \
+        dst[c] = src[src_channel[c]];                                       \
+  }                                                                         \
+}
+
+DEFINE_REORDER_COPY (guint8, 8)
+DEFINE_REORDER_COPY (guint16, 16)
+DEFINE_REORDER_COPY (guint32, 32)
+DEFINE_REORDER_COPY (guint64, 64)
+
+#if defined (__SSSE3__)
+#define HAVE_REORDER_COPY_SSSE3
+#define REORDER_COPY_SSSE3_TARGET
+#elif defined (__GNUC__) && (defined (__i386__) || defined (__x86_64__))
+/* built for a baseline without SSSE3, selected at runtime */
+#define HAVE_REORDER_COPY_SSSE3
+#define REORDER_COPY_SSSE3_TARGET __attribute__ ((target ("ssse3")))
+#include <tmmintrin.h>
+#endif
+
+#ifdef HAVE_REORDER_COPY_SSSE3
+/* 6 and 8 channel frames of 16 and 32 bits samples fit in one or two
+ * registers, every output register is gathered with one pshufb per input
+ * register. Frames are loaded and stored as whole registers, the bytes past
+ * a 6 channel frame are overwritten by the next frame, the last frame goes
+ * through the generic loop so nothing is read or written past the
+ * buffers. */
+REORDER_COPY_SSSE3_TARGET static inline void
+reorder_copy_ssse3_masks (__m128i masks[2][2], gint channels, gint size,
+    gint n_regs, const gint * src_channel)
+{
+  guint8 shuffle[16];
+  gint r, k, j;
+
+  for (r = 0; r < n_regs; r++) {
+    for (k = 0; k < n_regs; k++) {
+      for (j = 0; j < 16; j++) {
+        gint sample = (16 * r + j) / size;
+        gint src_byte;
+
+        shuffle[j] = 0x80;
+        if (sample >= channels)
+          continue;
+
+        src_byte = src_channel[sample] * size + (16 * r + j) % size;
+        if (src_byte / 16 == k)
+          shuffle[j] = src_byte % 16;
+      }
+      masks[r][k] = _mm_loadu_si128 ((const __m128i *) shuffle);
+    }
+  }
+}
+
+REORDER_COPY_SSSE3_TARGET static gint
+reorder_copy_1reg_ssse3 (guint8 * dst, const guint8 * src, gint n_frames,
+    gint channels, gint size, const gint * src_channel)
+{
+  const gint frame_size = channels * size;
+  __m128i masks[2][2];
+  gint i;
+
+  reorder_copy_ssse3_masks (masks, channels, size, 1, src_channel);
+
+  for (i = 0; i < n_frames - 1; i++, dst += frame_size, src += frame_size)
+    _mm_storeu_si128 ((__m128i *) dst,
+        _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) src),
+            masks[0][0]));
+
+  return i;
+}
+
+REORDER_COPY_SSSE3_TARGET static gint
+reorder_copy_2reg_ssse3 (guint8 * dst, const guint8 * src, gint n_frames,
+    gint channels, gint size, const gint * src_channel)
+{
+  const gint frame_size = channels * size;
+  __m128i masks[2][2], a, b;
+  gint i;
+
+  reorder_copy_ssse3_masks (masks, channels, size, 2, src_channel);
+
+  for (i = 0; i < n_frames - 1; i++, dst += frame_size, src += frame_size) {
+    a = _mm_loadu_si128 ((const __m128i *) src);
+    b = _mm_loadu_si128 ((const __m128i *) (src + 16));
+
+    _mm_storeu_si128 ((__m128i *) dst,
+        _mm_or_si128 (_mm_shuffle_epi8 (a, masks[0][0]),
+            _mm_shuffle_epi8 (b, masks[0][1])));
+    _mm_storeu_si128 ((__m128i *) (dst + 16),
+        _mm_or_si128 (_mm_shuffle_epi8 (a, masks[1][0]),
+            _mm_shuffle_epi8 (b, masks[1][1])));
+  }
+
+  return i;
+}
+
+/* returns the number of frames done, 0 if the layout has no kernel or the
+ * CPU has no SSSE3 */
+static gint
+reorder_copy_ssse3 (gpointer dst, gconstpointer src, gint n_frames,
+    gint channels, gint size, const gint * src_channel)
+{
+  if (channels != 6 && channels != 8)
+    return 0;
+
+#ifndef __SSSE3__
+  if (!(av_get_cpu_flags () & AV_CPU_FLAG_SSSE3))
+    return 0;
+#endif
+
+  if (channels * size <= 16)
+    return reorder_copy_1reg_ssse3 (dst, src, n_frames, channels, size,
+        src_channel);
+  else
+    return reorder_copy_2reg_ssse3 (dst, src, n_frames, channels, size,
+        src_channel);
+}
+#endif
+
+gboolean
+gst_ffmpeg_reorder_copy (gpointer dst, gconstpointer src, gint n_frames,
+    gint channels, gint width, const gint * channel_order)
+{
+  /* the kernels cover the 6 and 8 channel S16, S32 and F32 layouts */
+#ifdef HAVE_REORDER_COPY_SSSE3
+  if (width == 16 || width == 32) {
+    gint done = reorder_copy_ssse3 (dst, src, n_frames, channels, width / 8,
+        channel_order);
+    dst = (guint8 *) dst + done * channels * (width / 8);
+    src = (const guint8 *) src + done * channels * (width / 8);
+    n_frames -= done;
+  }
+#endif
+
+  switch (width) {
+    case 8:
+      reorder_copy_8 (dst, src, n_frames, channels, channel_order);
+      break;
+    case 16:
+      reorder_copy_16 (dst, src, n_frames, channels, channel_order);
+      break;
+    case 32:
+      reorder_copy_32 (dst, src, n_frames, channels, channel_order);
+      break;
+    case 64:
+      reorder_copy_64 (dst, src, n_frames, channels, channel_order);
+      break;
+    default:
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* scatter kernels, sample c of each frame goes to plane dst[c]. Any channel
+ * reordering is done by permuting the plane pointers */
+#define DEFINE_DEINTERLEAVE(type,bits)                                      \
+static void                                                                 \
+deinterleave_##bits (type ** dst, const type * src, gint n_frames,          \
+    gint channels)                                                          \
+{                                                                           \
+  gint i, c;                                                                \
+                                                                            \
+  if (channels == 2) {                                                      \
+    type *d0 = dst[0], *d1 = dst[1];                                        \
+                                                                            \
+    for (i = 0; i < n_frames; i++, src += 2) {                              \
+      d0[i] = src[0]; d1[i] = src[1];                                       \
+    }                                                                       \
+  } else if (channels == 6) {                                               \
+    type *d0 = dst[0], *d1 = dst[1], *d2 = dst[2];                          \
+    type *d3 = dst[3], *d4 = dst[4], *d5 = dst[5];                          \
+                                                                            \
+    for (i = 0; i < n_frames; i++, src += 6) {                              \
+      d0[i] = src[0]; d1[i] = src[1]; d2[i] = src[2];                       \
+      d3[i] = src[3]; d4[i] = src[4]; d5[i] = src[5];                       \
+    }                                                                       \
+  } else if (channels == 8) {                                               \
+    type *d0 = dst[0], *d1 = dst[1], *d2 = dst[2], *d3 = dst[3];            \
+    type *d4 = dst[4], *d5 = dst[5], *d6 = dst[6], *d7 = dst[7];            \
+                                                                            \
+    for (i = 0; i < n_frames; i++, src += 8) {                              \
+      d0[i] = src[0]; d1[i] = src[1]; d2[i] = src[2]; d3[i] = src[3];       \
+      d4[i] = src[4]; d5[i] = src[5]; d6[i] = src[6]; d7[i] = src[7];       \
+    }                                                                       \
+  } else {                                                                  \
+    for (i = 0; i < n_frames; i++, src += channels)                         \
+      for (c = 0; c < channels; c++)                                        \
+        dst[c][i] = src[c];                                                 \
+  }                                                                         \
+}
+
+DEFINE_DEINTERLEAVE (guint8, 8)
+DEFINE_DEINTERLEAVE (guint16, 16)
+DEFINE_DEINTERLEAVE (guint32, 32)
+DEFINE_DEINTERLEAVE (guint64, 64)
+
+/* The vector kernels handle the bulk of the frames and return how many they
+ * did, the scalar ones above do the tail. On x86 they are built for the
+ * instruction set of the compiler target or, with GCC and clang, for SSE2
+ * and AVX2 anyway and picked from the CPU flags at runtime */
+#if defined (__SSE2__)
+#define HAVE_DEINTERLEAVE_SSE2
+#define DEINTERLEAVE_SSE2_TARGET
+#elif defined (__GNUC__) && (defined (__i386__) || defined (__x86_64__))
+#define HAVE_DEINTERLEAVE_SSE2
+#define DEINTERLEAVE_SSE2_TARGET __attribute__ ((target ("sse2")))
+#include <emmintrin.h>
+#endif
+
+#if defined (__AVX2__)
+#define HAVE_DEINTERLEAVE_AVX2
+#define DEINTERLEAVE_AVX2_TARGET
+#include <immintrin.h>
+#elif defined (__GNUC__) && (defined (__i386__) || defined (__x86_64__))
+#define HAVE_DEINTERLEAVE_AVX2
+#define DEINTERLEAVE_AVX2_TARGET __attribute__ ((target ("avx2")))
+#include <immintrin.h>
+#endif
+
+#ifdef HAVE_DEINTERLEAVE_SSE2
+DEINTERLEAVE_SSE2_TARGET static gint
+deinterleave_16_2ch_sse2 (guint16 ** dst, const guint16 * src, gint n_frames)
+{
+  gint i;
+
+  for (i = 0; i + 8 <= n_frames; i += 8, src += 16) {
+    __m128i a = _mm_loadu_si128 ((const __m128i *) src);
+    __m128i b = _mm_loadu_si128 ((const __m128i *) (src + 8));
+
+    /* sign extend both halves of each 32 bits frame, so that the saturating
+     * pack keeps them unchanged */
+    _mm_storeu_si128 ((__m128i *) (dst[0] + i),
+        _mm_packs_epi32 (_mm_srai_epi32 (_mm_slli_epi32 (a, 16), 16),
+            _mm_srai_epi32 (_mm_slli_epi32 (b, 16), 16)));
+    _mm_storeu_si128 ((__m128i *) (dst[1] + i),
+        _mm_packs_epi32 (_mm_srai_epi32 (a, 16), _mm_srai_epi32 (b, 16)));
+  }
+
+  return i;
+}
+
+/* transposes 8 rows of 8 samples, column c ends up in r[c] */
+DEINTERLEAVE_SSE2_TARGET static inline void
+transpose_16_8x8_sse2 (__m128i r[8])
+{
+  __m128i t[8];
+  gint c;
+
+  t[0] = _mm_unpacklo_epi16 (r[0], r[1]);
+  t[1] = _mm_unpackhi_epi16 (r[0], r[1]);
+  t[2] = _mm_unpacklo_epi16 (r[2], r[3]);
+  t[3] = _mm_unpackhi_epi16 (r[2], r[3]);
+  t[4] = _mm_unpacklo_epi16 (r[4], r[5]);
+  t[5] = _mm_unpackhi_epi16 (r[4], r[5]);
+  t[6] = _mm_unpacklo_epi16 (r[6], r[7]);
+  t[7] = _mm_unpackhi_epi16 (r[6], r[7]);
+
+  r[0] = _mm_unpacklo_epi32 (t[0], t[2]);
+  r[1] = _mm_unpackhi_epi32 (t[0], t[2]);
+  r[2] = _mm_unpacklo_epi32 (t[1], t[3]);
+  r[3] = _mm_unpackhi_epi32 (t[1], t[3]);
+  r[4] = _mm_unpacklo_epi32 (t[4], t[6]);
+  r[5] = _mm_unpackhi_epi32 (t[4], t[6]);
+  r[6] = _mm_unpacklo_epi32 (t[5], t[7]);
+  r[7] = _mm_unpackhi_epi32 (t[5], t[7]);
+
+  for (c = 0; c < 4; c++) {
+    t[2 * c] = _mm_unpacklo_epi64 (r[c], r[c + 4]);
+    t[2 * c + 1] = _mm_unpackhi_epi64 (r[c], r[c + 4]);
+  }
+  for (c = 0; c < 8; c++)
+    r[c] = t[c];
+}
+
+/* one row per frame, the last two samples of each row belong to the next
+ * frame and are dropped. The last row reads two samples into the frame
+ * after the block, which must exist */
+DEINTERLEAVE_SSE2_TARGET static gint
+deinterleave_16_6ch_sse2 (guint16 ** dst, const guint16 * src, gint n_frames)
+{
+  gint i, c;
+
+  for (i = 0; i + 9 <= n_frames; i += 8, src += 48) {
+    __m128i r[8];
+
+    for (c = 0; c < 8; c++)
+      r[c] = _mm_loadu_si128 ((const __m128i *) (src + 6 * c));
+    transpose_16_8x8_sse2 (r);
+    for (c = 0; c < 6; c++)
+      _mm_storeu_si128 ((__m128i *) (dst[c] + i), r[c]);
+  }
+
+  return i;
+}
+
+DEINTERLEAVE_SSE2_TARGET static gint
+deinterleave_16_8ch_sse2 (guint16 ** dst, const guint16 * src, gint n_frames)
+{
+  gint i, c;
+
+  for (i = 0; i + 8 <= n_frames; i += 8, src += 64) {
+    __m128i r[8];
+
+    for (c = 0; c < 8; c++)
+      r[c] = _mm_loadu_si128 ((const __m128i *) (src + 8 * c));
+    transpose_16_8x8_sse2 (r);
+    for (c = 0; c < 8; c++)
+      _mm_storeu_si128 ((__m128i *) (dst[c] + i), r[c]);
+  }
+
+  return i;
+}
+
+DEINTERLEAVE_SSE2_TARGET static gint
+deinterleave_32_2ch_sse2 (guint32 ** dst, const guint32 * src, gint n_frames)
+{
+  gint i;
+
+  for (i = 0; i + 4 <= n_frames; i += 4, src += 8) {
+    __m128 a = _mm_loadu_ps ((const float *) src);
+    __m128 b = _mm_loadu_ps ((const float *) (src + 4));
+
+    _mm_storeu_ps ((float *) (dst[0] + i),
+        _mm_shuffle_ps (a, b, _MM_SHUFFLE (2, 0, 2, 0)));
+    _mm_storeu_ps ((float *) (dst[1] + i),
+        _mm_shuffle_ps (a, b, _MM_SHUFFLE (3, 1, 3, 1)));
+  }
+
+  return i;
+}
+
+/* transposes 4 frames of channels 0-3 and 2-5, the middle ones twice */
+DEINTERLEAVE_SSE2_TARGET static gint
+deinterleave_32_6ch_sse2 (guint32 ** dst, const guint32 * src, gint n_frames)
+{
+  gint i;
+
+  for (i = 0; i + 4 <= n_frames; i += 4, src += 24) {
+    const float *s = (const float *) src;
+    __m128 a0 = _mm_loadu_ps (s), a1 = _mm_loadu_ps (s + 6);
+    __m128 a2 = _mm_loadu_ps (s + 12), a3 = _mm_loadu_ps (s + 18);
+    __m128 b0 = _mm_loadu_ps (s + 2), b1 = _mm_loadu_ps (s + 8);
+    __m128 b2 = _mm_loadu_ps (s + 14), b3 = _mm_loadu_ps (s + 20);
+
+    _MM_TRANSPOSE4_PS (a0, a1, a2, a3);
+    _MM_TRANSPOSE4_PS (b0, b1, b2, b3);
+
+    _mm_storeu_ps ((float *) (dst[0] + i), a0);
+    _mm_storeu_ps ((float *) (dst[1] + i), a1);
+    _mm_storeu_ps ((float *) (dst[2] + i), b0);
+    _mm_storeu_ps ((float *) (dst[3] + i), b1);
+    _mm_storeu_ps ((float *) (dst[4] + i), b2);
+    _mm_storeu_ps ((float *) (dst[5] + i), b3);
+  }
+
+  return i;
+}
+
+DEINTERLEAVE_SSE2_TARGET static gint
+deinterleave_32_8ch_sse2 (guint32 ** dst, const guint32 * src, gint n_frames)
+{
+  gint i;
+
+  for (i = 0; i + 4 <= n_frames; i += 4, src += 32) {
+    const float *s = (const float *) src;
+    __m128 a0 = _mm_loadu_ps (s), a1 = _mm_loadu_ps (s + 8);
+    __m128 a2 = _mm_loadu_ps (s + 16), a3 = _mm_loadu_ps (s + 24);
+    __m128 b0 = _mm_loadu_ps (s + 4), b1 = _mm_loadu_ps (s + 12);
+    __m128 b2 = _mm_loadu_ps (s + 20), b3 = _mm_loadu_ps (s + 28);
+
+    _MM_TRANSPOSE4_PS (a0, a1, a2, a3);
+    _MM_TRANSPOSE4_PS (b0, b1, b2, b3);
+
+    _mm_storeu_ps ((float *) (dst[0] + i), a0);
+    _mm_storeu_ps ((float *) (dst[1] + i), a1);
+    _mm_storeu_ps ((float *) (dst[2] + i), a2);
+    _mm_storeu_ps ((float *) (dst[3] + i), a3);
+    _mm_storeu_ps ((float *) (dst[4] + i), b0);
+    _mm_storeu_ps ((float *) (dst[5] + i), b1);
+    _mm_storeu_ps ((float *) (dst[6] + i), b2);
+    _mm_storeu_ps ((float *) (dst[7] + i), b3);
+  }
+
+  return i;
+}
+
+static gint
+deinterleave_sse2 (gpointer * dst, gconstpointer src, gint n_frames,
+    gint channels, gint width)
+{
+#ifndef __SSE2__
+  if (!(av_get_cpu_flags () & AV_CPU_FLAG_SSE2))
+    return 0;
+#endif
+
+  if (width == 16) {
+    if (channels == 2)
+      return deinterleave_16_2ch_sse2 ((guint16 **) dst, src, n_frames);
+    else if (channels == 6)
+      return deinterleave_16_6ch_sse2 ((guint16 **) dst, src, n_frames);
+    else if (channels == 8)
+      return deinterleave_16_8ch_sse2 ((guint16 **) dst, src, n_frames);
+  } else if (width == 32) {
+    if (channels == 2)
+      return deinterleave_32_2ch_sse2 ((guint32 **) dst, src, n_frames);
+    else if (channels == 6)
+      return deinterleave_32_6ch_sse2 ((guint32 **) dst, src, n_frames);
+    else if (channels == 8)
+      return deinterleave_32_8ch_sse2 ((guint32 **) dst, src, n_frames);
+  }
+
+  return 0;
+}
+#endif
+
+#ifdef HAVE_DEINTERLEAVE_AVX2
+/* the in-lane packs and shuffles leave the 64 bits quarters in the order
+ * 0 2 1 3 */
+#define AVX2_FIX_QUARTERS _MM_SHUFFLE (3, 1, 2, 0)
+
+DEINTERLEAVE_AVX2_TARGET static gint
+deinterleave_16_2ch_avx2 (guint16 ** dst, const guint16 * src, gint n_frames)
+{
+  gint i;
+
+  for (i = 0; i + 16 <= n_frames; i += 16, src += 32) {
+    __m256i a = _mm256_loadu_si256 ((const __m256i *) src);
+    __m256i b = _mm256_loadu_si256 ((const __m256i *) (src + 16));
+    __m256i l, r;
+
+    l = _mm256_packs_epi32 (_mm256_srai_epi32 (_mm256_slli_epi32 (a, 16), 16),
+        _mm256_srai_epi32 (_mm256_slli_epi32 (b, 16), 16));
+    r = _mm256_packs_epi32 (_mm256_srai_epi32 (a, 16),
+        _mm256_srai_epi32 (b, 16));
+
+    _mm256_storeu_si256 ((__m256i *) (dst[0] + i),
+        _mm256_permute4x64_epi64 (l, AVX2_FIX_QUARTERS));
+    _mm256_storeu_si256 ((__m256i *) (dst[1] + i),
+        _mm256_permute4x64_epi64 (r, AVX2_FIX_QUARTERS));
+  }
+
+  return i;
+}
+
+DEINTERLEAVE_AVX2_TARGET static gint
+deinterleave_32_2ch_avx2 (guint32 ** dst, const guint32 * src, gint n_frames)
+{
+  gint i;
+
+  for (i = 0; i + 8 <= n_frames; i += 8, src += 16) {
+    __m256 a = _mm256_loadu_ps ((const float *) src);
+    __m256 b = _mm256_loadu_ps ((const float *) (src + 8));
+    __m256 l = _mm256_shuffle_ps (a, b, _MM_SHUFFLE (2, 0, 2, 0));
+    __m256 r = _mm256_shuffle_ps (a, b, _MM_SHUFFLE (3, 1, 3, 1));
+
+    _mm256_storeu_pd ((double *) (dst[0] + i),
+        _mm256_permute4x64_pd (_mm256_castps_pd (l), AVX2_FIX_QUARTERS));
+    _mm256_storeu_pd ((double *) (dst[1] + i),
+        _mm256_permute4x64_pd (_mm256_castps_pd (r), AVX2_FIX_QUARTERS));
+  }
+
+  return i;
+}
+
+/* transposes 8 frames of 8 channels, the lanes hold channels 0-3 and 4-7 */
+DEINTERLEAVE_AVX2_TARGET static gint
+deinterleave_32_8ch_avx2 (guint32 ** dst, const guint32 * src, gint n_frames)
+{
+  gint i, c;
+
+  for (i = 0; i + 8 <= n_frames; i += 8, src += 64) {
+    __m256 r[8], t[8];
+
+    for (c = 0; c < 8; c++)
+      r[c] = _mm256_loadu_ps ((const float *) (src + 8 * c));
+
+    for (c = 0; c < 8; c += 2) {
+      t[c] = _mm256_unpacklo_ps (r[c], r[c + 1]);
+      t[c + 1] = _mm256_unpackhi_ps (r[c], r[c + 1]);
+    }
+    /* frames 0-3 in r[0-3] and 4-7 in r[4-7], channel c of either lane
+     * in r[c] */
+    for (c = 0; c < 8; c += 4) {
+      r[c] = _mm256_shuffle_ps (t[c], t[c + 2], _MM_SHUFFLE (1, 0, 1, 0));
+      r[c + 1] = _mm256_shuffle_ps (t[c], t[c + 2], _MM_SHUFFLE (3, 2, 3, 2));
+      r[c + 2] = _mm256_shuffle_ps (t[c + 1], t[c + 3],
+          _MM_SHUFFLE (1, 0, 1, 0));
+      r[c + 3] = _mm256_shuffle_ps (t[c + 1], t[c + 3],
+          _MM_SHUFFLE (3, 2, 3, 2));
+    }
+    for (c = 0; c < 4; c++) {
+      _mm256_storeu_ps ((float *) (dst[c] + i),
+          _mm256_permute2f128_ps (r[c], r[c + 4], 0x20));
+      _mm256_storeu_ps ((float *) (dst[c + 4] + i),
+          _mm256_permute2f128_ps (r[c], r[c + 4], 0x31));
+    }
+  }
+
+  return i;
+}
+
+static gint
+deinterleave_avx2 (gpointer * dst, gconstpointer src, gint n_frames,
+    gint channels, gint width)
+{
+#ifndef __AVX2__
+  if (!(av_get_cpu_flags () & AV_CPU_FLAG_AVX2))
+    return 0;
+#endif
+
+  if (width == 16 && channels == 2)
+    return deinterleave_16_2ch_avx2 ((guint16 **) dst, src, n_frames);
+  else if (width == 32 && channels == 2)
+    return deinterleave_32_2ch_avx2 ((guint32 **) dst, src, n_frames);
+  else if (width == 32 && channels == 8)
+    return deinterleave_32_8ch_avx2 ((guint32 **) dst, src, n_frames);
+
+  return 0;
+}
+#endif
+
+#ifdef __ARM_NEON
+/* The structure loads split up to 4 channels. For 6 and 8 channels each
+ * register gets two channels alternating, c and c + 3 or c + 4, which an
+ * unzip of two loads separates */
+static gint
+deinterleave_16_2ch_neon (guint16 ** dst, const guint16 * src, gint n_frames)
+{
+  gint i;
+
+  for (i = 0; i + 8 <= n_frames; i += 8, src += 16) {
+    uint16x8x2_t v = vld2q_u16 (src);
+
+    vst1q_u16 (dst[0] + i, v.val[0]);
+    vst1q_u16 (dst[1] + i, v.val[1]);
+  }
+
+  return i;
+}
+
+static gint
+deinterleave_16_6ch_neon (guint16 ** dst, const guint16 * src, gint n_frames)
+{
+  gint i, c;
+
+  for (i = 0; i + 8 <= n_frames; i += 8, src += 48) {
+    uint16x8x3_t a = vld3q_u16 (src);
+    uint16x8x3_t b = vld3q_u16 (src + 24);
+
+    for (c = 0; c < 3; c++) {
+      uint16x8x2_t v = vuzpq_u16 (a.val[c], b.val[c]);
+
+      vst1q_u16 (dst[c] + i, v.val[0]);
+      vst1q_u16 (dst[c + 3] + i, v.val[1]);
+    }
+  }
+
+  return i;
+}
+
+static gint
+deinterleave_16_8ch_neon (guint16 ** dst, const guint16 * src, gint n_frames)
+{
+  gint i, c;
+
+  for (i = 0; i + 8 <= n_frames; i += 8, src += 64) {
+    uint16x8x4_t a = vld4q_u16 (src);
+    uint16x8x4_t b = vld4q_u16 (src + 32);
+
+    for (c = 0; c < 4; c++) {
+      uint16x8x2_t v = vuzpq_u16 (a.val[c], b.val[c]);
+
+      vst1q_u16 (dst[c] + i, v.val[0]);
+      vst1q_u16 (dst[c + 4] + i, v.val[1]);
+    }
+  }
+
+  return i;
+}
+
+static gint
+deinterleave_32_2ch_neon (guint32 ** dst, const guint32 * src, gint n_frames)
+{
+  gint i;
+
+  for (i = 0; i + 4 <= n_frames; i += 4, src += 8) {
+    uint32x4x2_t v = vld2q_u32 (src);
+
+    vst1q_u32 (dst[0] + i, v.val[0]);
+    vst1q_u32 (dst[1] + i, v.val[1]);
+  }
+
+  return i;
+}
+
+static gint
+deinterleave_32_6ch_neon (guint32 ** dst, const guint32 * src, gint n_frames)
+{
+  gint i, c;
+
+  for (i = 0; i + 4 <= n_frames; i += 4, src += 24) {
+    uint32x4x3_t a = vld3q_u32 (src);
+    uint32x4x3_t b = vld3q_u32 (src + 12);
+
+    for (c = 0; c < 3; c++) {
+      uint32x4x2_t v = vuzpq_u32 (a.val[c], b.val[c]);
+
+      vst1q_u32 (dst[c] + i, v.val[0]);
+      vst1q_u32 (dst[c + 3] + i, v.val[1]);
+    }
+  }
+
+  return i;
+}
+
+static gint
+deinterleave_32_8ch_neon (guint32 ** dst, const guint32 * src, gint n_frames)
+{
+  gint i, c;
+
+  for (i = 0; i + 4 <= n_frames; i += 4, src += 32) {
+    uint32x4x4_t a = vld4q_u32 (src);
+    uint32x4x4_t b = vld4q_u32 (src + 16);
+
+    for (c = 0; c < 4; c++) {
+      uint32x4x2_t v = vuzpq_u32 (a.val[c], b.val[c]);
+
+      vst1q_u32 (dst[c] + i, v.val[0]);
+      vst1q_u32 (dst[c + 4] + i, v.val[1]);
+    }
+  }
+
+  return i;
+}
+
+static gint
+deinterleave_neon (gpointer * dst, gconstpointer src, gint n_frames,
+    gint channels, gint width)
+{
+  if (width == 16) {
+    if (channels == 2)
+      return deinterleave_16_2ch_neon ((guint16 **) dst, src, n_frames);
+    else if (channels == 6)
+      return deinterleave_16_6ch_neon ((guint16 **) dst, src, n_frames);
+    else if (channels == 8)
+      return deinterleave_16_8ch_neon ((guint16 **) dst, src, n_frames);
+  } else if (width == 32) {
+    if (channels == 2)
+      return deinterleave_32_2ch_neon ((guint32 **) dst, src, n_frames);
+    else if (channels == 6)
+      return deinterleave_32_6ch_neon ((guint32 **) dst, src, n_frames);
+    else if (channels == 8)
+      return deinterleave_32_8ch_neon ((guint32 **) dst, src, n_frames);
+  }
+
+  return 0;
+}
+#endif
+
+/* The vector kernels cover 2, 6 and 8 channels of 16 and 32 bits: SSE2
+ * and NEON all of them, AVX2 the stereo ones and 8 channels of 32 bits.
+ * Everything else is done by the scalar kernels */
+gboolean
+gst_ffmpeg_deinterleave (guint8 ** planes, gconstpointer src, gint n_frames,
+    gint channels, gint width, const gint * channel_order)
+{
+  gpointer dst[64];
+  gint c, done = 0, bps = width / 8;
+
+  g_return_val_if_fail (channels > 0 && channels <= 64, FALSE);
+
+  /* input channel channel_order[c] goes to plane c */
+  for (c = 0; c < channels; c++)
+    dst[channel_order ? channel_order[c] : c] = planes[c];
+
+  switch (width) {
+    case 16:
+    case 32:
+#ifdef HAVE_DEINTERLEAVE_AVX2
+      done = deinterleave_avx2 (dst, src, n_frames, channels, width);
+#endif
+#ifdef HAVE_DEINTERLEAVE_SSE2
+      if (!done)
+        done = deinterleave_sse2 (dst, src, n_frames, channels, width);
+#endif
+#ifdef __ARM_NEON
+      done = deinterleave_neon (dst, src, n_frames, channels, width);
+#endif
+      break;
+    case 8:
+    case 64:
+      break;
+    default:
+      return FALSE;
+  }
+
+  /* the remaining frames */
+  if (done < n_frames) {
+    src = (const guint8 *) src + done * channels * bps;
+    for (c = 0; c < channels; c++)
+      dst[c] = (guint8 *) dst[c] + done * bps;
+    n_frames -= done;
+
+    switch (width) {
+      case 8:
+        deinterleave_8 ((guint8 **) dst, src, n_frames, channels);
+        break;
+      case 16:
+        deinterleave_16 ((guint16 **) dst, src, n_frames, channels);
+        break;
+      case 32:
+        deinterleave_32 ((guint32 **) dst, src, n_frames, channels);
+        break;
+      case 64:
+        deinterleave_64 ((guint64 **) dst, src, n_frames, channels);
+        break;
+    }
+  }
+
+  return TRUE;
+}
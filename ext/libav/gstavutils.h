@@ -28,6 +28,7 @@
 #include <libavutil/mathematics.h>
 
 #include <gst/gst.h>
+#include <gst/audio/audio.h>
 
 /*
  *Get the size of an picture
@@ -85,6 +86,16 @@ gst_ffmpeg_init_pix_fmt_info(void);
 int
 gst_ffmpeg_auto_max_threads(void);
 
+/* private options of the encoders that make them look ahead */
+extern const gchar *const gst_ffmpeg_lookahead_opts[];
+
+/*
+ * Number of frames an opened encoder holds back before the packet of a
+ * frame comes out: reordering, lookahead and frame threads.
+ */
+guint
+gst_ffmpeg_encoder_get_delay (AVCodecContext * context);
+
 const gchar *
 gst_ffmpeg_get_codecid_longname (enum AVCodecID codec_id);
 
@@ -94,4 +105,155 @@ av_smp_format_depth(enum AVSampleFormat smp_fmt);
 GstBuffer *
 new_aligned_buffer (gint size);
 
+/*
+ * Same as av_image_copy(), but large pictures are split in bands of rows
+ * copied in parallel, with non-temporal stores when the picture doesn't fit
+ * in the cache anyway.
+ */
+void
+gst_ffmpeg_image_copy (uint8_t * dst_data[4], int dst_linesizes[4],
+                       const uint8_t * src_data[4], const int src_linesizes[4],
+                       enum AVPixelFormat pix_fmt, int width, int height);
+
+/*
+ * Copies @n_frames interleaved frames of @width bits samples from @src to
+ * @dst, output channel c being input channel @channel_order[c], touching
+ * every sample only once. Returns FALSE if the width is not supported,
+ * @dst is untouched then.
+ */
+gboolean
+gst_ffmpeg_reorder_copy (gpointer dst, gconstpointer src, gint n_frames,
+                         gint channels, gint width,
+                         const gint * channel_order);
+
+/*
+ * Splits @n_frames interleaved frames of @width bits samples from @src into
+ * one plane per channel, plane c receiving input channel @channel_order[c],
+ * or channel c if @channel_order is NULL. Returns FALSE if the width is not
+ * supported.
+ */
+gboolean
+gst_ffmpeg_deinterleave (guint8 ** planes, gconstpointer src, gint n_frames,
+                         gint channels, gint width,
+                         const gint * channel_order);
+
+/*
+ * System memory allocated with the zeroed AV_INPUT_BUFFER_PADDING_SIZE
+ * bytes of padding libav needs to read input packets in place, registered
+ * as GST_FFMPEG_PADDED_ALLOCATOR_NAME so that upstream elements can find
+ * it. The decoders offer it, with a pool of @size bytes buffers when
+ * upstream needs one, in their allocation query replies.
+ */
+#define GST_FFMPEG_PADDED_ALLOCATOR_NAME "avpaddedmemory"
+
+GstAllocator *
+gst_ffmpeg_padded_allocator_get (void);
+
+void
+gst_ffmpeg_propose_padded_allocation (GstElement * element, GstQuery * query,
+                                      guint size, gsize align);
+
+/*
+ * Cache of fixed size objects for the per frame bookkeeping of the codec
+ * elements, so that they are recycled instead of going through the heap
+ * once the element reached its steady state. New objects are zeroed,
+ * recycled ones keep their previous content and @clear_item is called on
+ * them when the list is freed or trimmed. Objects may be released from any
+ * thread and after the element dropped its reference on the list. Trimming
+ * frees the objects not in use.
+ */
+typedef struct _GstFFMpegFreeList GstFFMpegFreeList;
+typedef struct _GstFFMpegFreeListItem GstFFMpegFreeListItem;
+
+GstFFMpegFreeList *
+gst_ffmpeg_free_list_new (const gchar * name, gsize size,
+                          GDestroyNotify clear_item);
+
+void
+gst_ffmpeg_free_list_unref (GstFFMpegFreeList * list);
+
+gpointer
+gst_ffmpeg_free_list_alloc (GstFFMpegFreeList * list);
+
+void
+gst_ffmpeg_free_list_release (gpointer data);
+
+void
+gst_ffmpeg_free_list_trim (GstFFMpegFreeList * list);
+
+/*
+ * Periodic callback for the codec elements to release resources when no
+ * data flowed for a while. The system clock only queues @func, which runs
+ * on a thread of the watch so that it can take the stream lock and push
+ * downstream. It is not queued again while it runs. Freeing the watch waits
+ * for a running @func, the watch holds a reference on the element until
+ * then.
+ */
+typedef struct _GstFFMpegIdleWatch GstFFMpegIdleWatch;
+
+typedef void (*GstFFMpegIdleFunc) (GstElement * element);
+
+GstFFMpegIdleWatch *
+gst_ffmpeg_idle_watch_new (GstElement * element, GstClockTime interval,
+                           GstFFMpegIdleFunc func);
+
+void
+gst_ffmpeg_idle_watch_free (GstFFMpegIdleWatch * watch);
+
+/*
+ * Dedicated codec thread for the encoders and decoders. Items (codec frames)
+ * are queued by the streaming thread, up to @depth of them, and handed to
+ * @func from the codec thread with @stream_lock held. The first non-OK flow
+ * return of @func is returned by the next push until the thread is
+ * flushed, or once by wait, which empties the queue.
+ *
+ * Push, wait and flush must be called with @stream_lock held exactly once,
+ * it is released while blocking. Free must be called without it.
+ */
+typedef GstFlowReturn (*GstFFMpegCodecThreadFunc) (GstElement * element,
+                                                    gpointer item);
+
+typedef struct _GstFFMpegCodecThread GstFFMpegCodecThread;
+
+GstFFMpegCodecThread *
+gst_ffmpeg_codec_thread_new (GstElement * element, GRecMutex * stream_lock,
+                             guint depth, GstFFMpegCodecThreadFunc func,
+                             GDestroyNotify free_item);
+
+void
+gst_ffmpeg_codec_thread_free (GstFFMpegCodecThread * thread);
+
+GstFlowReturn
+gst_ffmpeg_codec_thread_push (GstFFMpegCodecThread * thread, gpointer item);
+
+GstFlowReturn
+gst_ffmpeg_codec_thread_wait (GstFFMpegCodecThread * thread);
+
+void
+gst_ffmpeg_codec_thread_flush (GstFFMpegCodecThread * thread);
+
+gboolean
+gst_ffmpeg_codec_thread_is_self (GstFFMpegCodecThread * thread);
+
+/*
+ * First pass statistics of the encoders kept in memory under an id chosen
+ * by the application, for a second pass in the same process. Begin replaces
+ * the statistics of a previous first pass with the same id, end marks them
+ * complete. Get returns a copy of complete statistics, or NULL.
+ */
+void
+gst_ffmpeg_multipass_stats_begin (const gchar * id);
+
+void
+gst_ffmpeg_multipass_stats_append (const gchar * id, const gchar * stats);
+
+void
+gst_ffmpeg_multipass_stats_end (const gchar * id);
+
+gchar *
+gst_ffmpeg_multipass_stats_get (const gchar * id);
+
+void
+gst_ffmpeg_multipass_stats_remove (const gchar * id);
+
 #endif /* __GST_FFMPEG_UTILS_H__ */
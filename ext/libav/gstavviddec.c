@@ -32,6 +32,7 @@
 #include "gstavcodecmap.h"
 #include "gstavutils.h"
 #include "gstavviddec.h"
+#include "gstavmeta.h"
 
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_PERFORMANCE);
 
@@ -47,6 +48,15 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_PERFORMANCE);
 #define DEFAULT_STRIDE_ALIGN            31
 #define DEFAULT_ALLOC_PARAM             { 0, DEFAULT_STRIDE_ALIGN, 0, 0, }
 #define DEFAULT_THREAD_TYPE             0
+#define DEFAULT_REQUEST_KEYFRAME        FALSE
+#define DEFAULT_KEYFRAME_REQUEST_INTERVAL GST_SECOND
+#define DEFAULT_WAIT_FOR_KEYFRAME       FALSE
+#define DEFAULT_EXPORT_MVS              FALSE
+#define DEFAULT_EXPORT_QP               FALSE
+#define DEFAULT_STATS_INTERVAL          0
+#define DEFAULT_IDLE_TIMEOUT            0
+#define DEFAULT_IDLE_CLOSE_CODEC        FALSE
+#define DEFAULT_ASYNC_DEPTH             0
 
 enum
 {
@@ -58,6 +68,16 @@ enum
   PROP_MAX_THREADS,
   PROP_OUTPUT_CORRUPT,
   PROP_THREAD_TYPE,
+  PROP_REQUEST_KEYFRAME,
+  PROP_KEYFRAME_REQUEST_INTERVAL,
+  PROP_WAIT_FOR_KEYFRAME,
+  PROP_EXPORT_MVS,
+  PROP_EXPORT_QP,
+  PROP_STATS,
+  PROP_STATS_INTERVAL,
+  PROP_IDLE_TIMEOUT,
+  PROP_IDLE_CLOSE_CODEC,
+  PROP_ASYNC_DEPTH,
   PROP_LAST
 };
 
@@ -255,6 +275,88 @@ gst_ffmpegviddec_class_init (GstFFMpegVidDecClass * klass)
       g_param_spec_boolean ("output-corrupt", "Output corrupt buffers",
           "Whether libav should output frames even if corrupted",
           DEFAULT_OUTPUT_CORRUPT, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_REQUEST_KEYFRAME,
+      g_param_spec_boolean ("request-keyframe", "Request keyframe",
+          "Request a new key unit from upstream on decoding errors and "
+          "corrupted frames (sent as RTCP PLI by RTP sessions)",
+          DEFAULT_REQUEST_KEYFRAME, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class,
+      PROP_KEYFRAME_REQUEST_INTERVAL,
+      g_param_spec_uint64 ("keyframe-request-interval",
+          "Keyframe request interval",
+          "Minimum time in nanoseconds between two key unit requests "
+          "(0 = no limit)", 0, G_MAXUINT64,
+          DEFAULT_KEYFRAME_REQUEST_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_WAIT_FOR_KEYFRAME,
+      g_param_spec_boolean ("wait-for-keyframe", "Wait for keyframe",
+          "Drop all output after a decoding error until a clean keyframe "
+          "was decoded", DEFAULT_WAIT_FOR_KEYFRAME,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_EXPORT_MVS,
+      g_param_spec_boolean ("export-mvs", "Export motion vectors",
+          "Attach the motion vectors of each picture to the output buffers "
+          "as GstFFMpegMotionVectorsMeta (not every decoder supports it)",
+          DEFAULT_EXPORT_MVS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_EXPORT_QP,
+      g_param_spec_boolean ("export-qp", "Export QP",
+          "Attach the frame and per-block quantisation parameters to the "
+          "output buffers as GstFFMpegQPMeta (requires FFmpeg 4.3, not every "
+          "decoder supports it)", DEFAULT_EXPORT_QP,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstFFMpegVidDec:stats:
+   *
+   * Various decoder statistics. This property returns a GstStructure
+   * with name avdec-stats with the following fields:
+   *
+   * - "frames-in" G_TYPE_UINT64: frames received from upstream
+   * - "frames-out" G_TYPE_UINT64: frames pushed downstream
+   * - "frames-dropped" G_TYPE_UINT64: frames dropped because of decoding
+   *   errors or while waiting for a keyframe
+   * - "qos-dropped-nonref" G_TYPE_UINT64: frames skipped by the decoder
+   *   while skipping non-reference frames because of QoS or trick modes
+   * - "qos-dropped-nonkey" G_TYPE_UINT64: frames skipped by the decoder
+   *   while skipping non-keyframes
+   * - "frames-copied" G_TYPE_UINT64: frames that had to be copied into a
+   *   downstream buffer
+   * - "frames-direct" G_TYPE_UINT64: frames decoded directly into a
+   *   downstream buffer
+   * - "padding-bytes" G_TYPE_UINT64: input bytes copied to add padding
+   * - "padding-copies" G_TYPE_UINT64: input packets that had to be copied
+   *   because upstream didn't provide padded memory
+   * - "pools-created" G_TYPE_UINT64: buffer pools created for output
+   * - "decode-time-histogram" GST_TYPE_ARRAY: of G_TYPE_UINT64, number of
+   *   frames that took less than 1, 2, 4, 8, 16, 32 and 64 ms, and more than
+   *   that, between being sent to and received from the codec
+   */
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics", "Various statistics",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_STATS_INTERVAL,
+      g_param_spec_uint64 ("stats-interval", "Statistics interval",
+          "Interval in nanoseconds at which to post the statistics as element "
+          "message (0 = disabled)", 0, G_MAXUINT64, DEFAULT_STATS_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_IDLE_TIMEOUT,
+      g_param_spec_uint64 ("idle-timeout", "Idle timeout",
+          "Release the internal pool and scratch memory after this many "
+          "nanoseconds without input (0 = disabled, applied on the next "
+          "start)", 0, G_MAXUINT64, DEFAULT_IDLE_TIMEOUT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_IDLE_CLOSE_CODEC,
+      g_param_spec_boolean ("idle-close-codec", "Close codec when idle",
+          "Also close the codec and its threads when idle, it is reopened "
+          "when data flows again (the stream should resume with a keyframe)",
+          DEFAULT_IDLE_CLOSE_CODEC,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_ASYNC_DEPTH,
+      g_param_spec_uint ("async-depth", "Async depth",
+          "Decode in a separate thread with up to this many frames queued, "
+          "which adds the same number of frames of latency (0 = decode in "
+          "the streaming thread, applied on the next start)", 0, 64,
+          DEFAULT_ASYNC_DEPTH, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
   caps = klass->in_plugin->capabilities;
   if (caps & (AV_CODEC_CAP_FRAME_THREADS | AV_CODEC_CAP_SLICE_THREADS)) {
@@ -287,6 +389,16 @@ gst_ffmpegviddec_class_init (GstFFMpegVidDecClass * klass)
   gst_type_mark_as_plugin_api (GST_FFMPEGVIDDEC_TYPE_THREAD_TYPE, 0);
 }
 
+typedef struct
+{
+  GstFFMpegVidDec *ffmpegdec;
+  GstVideoCodecFrame *frame;
+  gboolean mapped;
+  GstVideoFrame vframe;
+  GstBuffer *buffer;
+  AVBufferRef *avbuffer;
+} GstFFMpegVidDecVideoFrame;
+
 static void
 gst_ffmpegviddec_init (GstFFMpegVidDec * ffmpegdec)
 {
@@ -304,6 +416,21 @@ gst_ffmpegviddec_init (GstFFMpegVidDec * ffmpegdec)
   ffmpegdec->max_threads = DEFAULT_MAX_THREADS;
   ffmpegdec->output_corrupt = DEFAULT_OUTPUT_CORRUPT;
   ffmpegdec->thread_type = DEFAULT_THREAD_TYPE;
+  ffmpegdec->request_keyframe = DEFAULT_REQUEST_KEYFRAME;
+  ffmpegdec->keyframe_request_interval = DEFAULT_KEYFRAME_REQUEST_INTERVAL;
+  ffmpegdec->wait_for_keyframe = DEFAULT_WAIT_FOR_KEYFRAME;
+  ffmpegdec->last_keyframe_request = GST_CLOCK_TIME_NONE;
+  ffmpegdec->export_mvs = DEFAULT_EXPORT_MVS;
+  ffmpegdec->export_qp = DEFAULT_EXPORT_QP;
+  ffmpegdec->stats_interval = DEFAULT_STATS_INTERVAL;
+  ffmpegdec->idle_timeout = DEFAULT_IDLE_TIMEOUT;
+  ffmpegdec->idle_close_codec = DEFAULT_IDLE_CLOSE_CODEC;
+  ffmpegdec->async_depth = DEFAULT_ASYNC_DEPTH;
+  ffmpegdec->last_stats_post = GST_CLOCK_TIME_NONE;
+  g_mutex_init (&ffmpegdec->stats_lock);
+  ffmpegdec->frame_list =
+      gst_ffmpeg_free_list_new (G_OBJECT_TYPE_NAME (ffmpegdec),
+      sizeof (GstFFMpegVidDecVideoFrame), NULL);
 
   GST_PAD_SET_ACCEPT_TEMPLATE (GST_VIDEO_DECODER_SINK_PAD (ffmpegdec));
   gst_video_decoder_set_use_default_pad_acceptcaps (GST_VIDEO_DECODER_CAST
@@ -325,6 +452,10 @@ gst_ffmpegviddec_finalize (GObject * object)
     ffmpegdec->context = NULL;
   }
 
+  /* frames still in use keep the list alive */
+  gst_ffmpeg_free_list_unref (ffmpegdec->frame_list);
+  g_mutex_clear (&ffmpegdec->stats_lock);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -442,6 +573,18 @@ gst_ffmpegviddec_set_format (GstVideoDecoder * decoder,
   ffmpegdec = (GstFFMpegVidDec *) decoder;
   oclass = (GstFFMpegVidDecClass *) (G_OBJECT_GET_CLASS (ffmpegdec));
 
+  /* frames still queued were sent with the previous caps */
+  if (ffmpegdec->codec_thread) {
+    GstFlowReturn flow_ret;
+
+    flow_ret = gst_ffmpeg_codec_thread_wait (ffmpegdec->codec_thread);
+    if (flow_ret < GST_FLOW_EOS) {
+      GST_WARNING_OBJECT (ffmpegdec, "queued frames failed: %s",
+          gst_flow_get_name (flow_ret));
+      return FALSE;
+    }
+  }
+
   if (ffmpegdec->last_caps != NULL &&
       gst_caps_is_equal (ffmpegdec->last_caps, state->caps)) {
     return TRUE;
@@ -522,6 +665,21 @@ gst_ffmpegviddec_set_format (GstVideoDecoder * decoder,
    * supports it) */
   ffmpegdec->context->debug_mv = ffmpegdec->debug_mv;
 
+  /* or export them, and the quantisers, as side data that we attach to the
+   * output buffers as metas */
+  if (ffmpegdec->export_mvs) {
+#ifdef AV_CODEC_EXPORT_DATA_MVS
+    ffmpegdec->context->export_side_data |= AV_CODEC_EXPORT_DATA_MVS;
+#else
+    ffmpegdec->context->flags2 |= AV_CODEC_FLAG2_EXPORT_MVS;
+#endif
+  }
+#if defined(AV_CODEC_EXPORT_DATA_VIDEO_ENC_PARAMS) && defined(HAVE_AV_VIDEO_ENC_PARAMS)
+  if (ffmpegdec->export_qp)
+    ffmpegdec->context->export_side_data |=
+        AV_CODEC_EXPORT_DATA_VIDEO_ENC_PARAMS;
+#endif
+
   if (ffmpegdec->thread_type) {
     GST_DEBUG_OBJECT (ffmpegdec, "Use requested thread type 0x%x",
         ffmpegdec->thread_type);
@@ -573,6 +731,11 @@ gst_ffmpegviddec_set_format (GstVideoDecoder * decoder,
         (ffmpegdec->context->has_b_frames) * GST_SECOND, info->fps_d,
         info->fps_n);
 
+    if (ffmpegdec->codec_thread) {
+      latency += gst_util_uint64_scale_ceil (ffmpegdec->async_depth *
+          GST_SECOND, info->fps_d, info->fps_n);
+    }
+
     if (ffmpegdec->context->thread_type & FF_THREAD_FRAME) {
       latency +=
           gst_util_uint64_scale_ceil (ffmpegdec->context->thread_count *
@@ -598,23 +761,14 @@ open_failed:
   }
 }
 
-typedef struct
-{
-  GstFFMpegVidDec *ffmpegdec;
-  GstVideoCodecFrame *frame;
-  gboolean mapped;
-  GstVideoFrame vframe;
-  GstBuffer *buffer;
-  AVBufferRef *avbuffer;
-} GstFFMpegVidDecVideoFrame;
-
 static GstFFMpegVidDecVideoFrame *
 gst_ffmpegviddec_video_frame_new (GstFFMpegVidDec * ffmpegdec,
     GstVideoCodecFrame * frame)
 {
   GstFFMpegVidDecVideoFrame *dframe;
 
-  dframe = g_slice_new0 (GstFFMpegVidDecVideoFrame);
+  dframe = gst_ffmpeg_free_list_alloc (ffmpegdec->frame_list);
+  memset (dframe, 0, sizeof (GstFFMpegVidDecVideoFrame));
   dframe->ffmpegdec = ffmpegdec;
   dframe->frame = frame;
 
@@ -636,7 +790,7 @@ gst_ffmpegviddec_video_frame_free (GstFFMpegVidDec * ffmpegdec,
   if (frame->avbuffer) {
     av_buffer_unref (&frame->avbuffer);
   }
-  g_slice_free (GstFFMpegVidDecVideoFrame, frame);
+  gst_ffmpeg_free_list_release (frame);
 }
 
 static void
@@ -745,6 +899,10 @@ gst_ffmpegviddec_ensure_internal_pool (GstFFMpegVidDec * ffmpegdec,
   ffmpegdec->internal_pool = gst_video_buffer_pool_new ();
   config = gst_buffer_pool_get_config (ffmpegdec->internal_pool);
 
+  g_mutex_lock (&ffmpegdec->stats_lock);
+  ffmpegdec->stats.pools_created++;
+  g_mutex_unlock (&ffmpegdec->stats_lock);
+
   caps = gst_video_info_to_caps (&info);
   gst_buffer_pool_config_set_params (config, caps, info.size, 2, 0);
   gst_buffer_pool_config_set_allocator (config, NULL, &params);
@@ -1371,6 +1529,10 @@ gst_ffmpegviddec_negotiate (GstFFMpegVidDec * ffmpegdec,
           gst_util_uint64_scale_ceil (ffmpegdec->context->thread_count *
           GST_SECOND, fps_d, fps_n);
     }
+    if (ffmpegdec->codec_thread) {
+      latency += gst_util_uint64_scale_ceil (ffmpegdec->async_depth *
+          GST_SECOND, fps_d, fps_n);
+    }
     gst_video_decoder_set_latency (GST_VIDEO_DECODER (ffmpegdec), latency,
         latency);
   }
@@ -1464,6 +1626,143 @@ gst_ffmpegviddec_do_qos (GstFFMpegVidDec * ffmpegdec,
   }
 }
 
+static void
+gst_ffmpegviddec_stats_add_decode_time (GstFFMpegVidDec * ffmpegdec,
+    GstVideoCodecFrame * frame)
+{
+  GstFFMpegVidDecFrameInfo *info =
+      &ffmpegdec->frame_info[frame->system_frame_number & MAX_TS_MASK];
+  guint64 ms;
+  guint bucket = 0;
+
+  if (!GST_CLOCK_TIME_IS_VALID (info->send_time))
+    return;
+
+  ms = (gst_util_get_timestamp () - info->send_time) / GST_MSECOND;
+  info->send_time = GST_CLOCK_TIME_NONE;
+
+  while (ms > 0 && bucket < GST_FFMPEGVIDDEC_N_DECODE_TIME_BUCKETS - 1) {
+    ms >>= 1;
+    bucket++;
+  }
+
+  g_mutex_lock (&ffmpegdec->stats_lock);
+  ffmpegdec->stats.decode_time[bucket]++;
+  g_mutex_unlock (&ffmpegdec->stats_lock);
+}
+
+/* a frame went through the decoder without producing a picture */
+static void
+gst_ffmpegviddec_stats_add_skipped (GstFFMpegVidDec * ffmpegdec,
+    GstVideoCodecFrame * frame)
+{
+  GstFFMpegVidDecFrameInfo *info =
+      &ffmpegdec->frame_info[frame->system_frame_number & MAX_TS_MASK];
+
+  g_mutex_lock (&ffmpegdec->stats_lock);
+  if (info->skip_frame >= AVDISCARD_NONKEY)
+    ffmpegdec->stats.qos_dropped_nonkey++;
+  else if (info->skip_frame >= AVDISCARD_NONREF)
+    ffmpegdec->stats.qos_dropped_nonref++;
+  else
+    ffmpegdec->stats.frames_dropped++;
+  g_mutex_unlock (&ffmpegdec->stats_lock);
+
+  info->send_time = GST_CLOCK_TIME_NONE;
+}
+
+static GstStructure *
+gst_ffmpegviddec_create_stats (GstFFMpegVidDec * ffmpegdec)
+{
+  GstStructure *s;
+  GValue histogram = G_VALUE_INIT;
+  GValue v = G_VALUE_INIT;
+  guint i;
+
+  g_mutex_lock (&ffmpegdec->stats_lock);
+
+  gst_value_array_init (&histogram, GST_FFMPEGVIDDEC_N_DECODE_TIME_BUCKETS);
+  g_value_init (&v, G_TYPE_UINT64);
+  for (i = 0; i < GST_FFMPEGVIDDEC_N_DECODE_TIME_BUCKETS; i++) {
+    g_value_set_uint64 (&v, ffmpegdec->stats.decode_time[i]);
+    gst_value_array_append_value (&histogram, &v);
+  }
+  g_value_unset (&v);
+
+  s = gst_structure_new ("avdec-stats",
+      "frames-in", G_TYPE_UINT64, ffmpegdec->stats.frames_in,
+      "frames-out", G_TYPE_UINT64, ffmpegdec->stats.frames_out,
+      "frames-dropped", G_TYPE_UINT64, ffmpegdec->stats.frames_dropped,
+      "qos-dropped-nonref", G_TYPE_UINT64, ffmpegdec->stats.qos_dropped_nonref,
+      "qos-dropped-nonkey", G_TYPE_UINT64, ffmpegdec->stats.qos_dropped_nonkey,
+      "frames-copied", G_TYPE_UINT64, ffmpegdec->stats.frames_copied,
+      "frames-direct", G_TYPE_UINT64, ffmpegdec->stats.frames_direct,
+      "padding-bytes", G_TYPE_UINT64, ffmpegdec->stats.padding_bytes,
+      "padding-copies", G_TYPE_UINT64, ffmpegdec->stats.padding_copies,
+      "pools-created", G_TYPE_UINT64, ffmpegdec->stats.pools_created, NULL);
+
+  g_mutex_unlock (&ffmpegdec->stats_lock);
+
+  gst_structure_take_value (s, "decode-time-histogram", &histogram);
+
+  return s;
+}
+
+static void
+gst_ffmpegviddec_post_stats (GstFFMpegVidDec * ffmpegdec)
+{
+  GstClockTime now;
+
+  if (ffmpegdec->stats_interval == 0)
+    return;
+
+  now = gst_util_get_timestamp ();
+  if (GST_CLOCK_TIME_IS_VALID (ffmpegdec->last_stats_post) &&
+      now - ffmpegdec->last_stats_post < ffmpegdec->stats_interval)
+    return;
+
+  ffmpegdec->last_stats_post = now;
+  gst_element_post_message (GST_ELEMENT_CAST (ffmpegdec),
+      gst_message_new_element (GST_OBJECT_CAST (ffmpegdec),
+          gst_ffmpegviddec_create_stats (ffmpegdec)));
+}
+
+/* called on decoding errors and corrupted output. Asks upstream for a new key
+ * unit, at most once per keyframe-request-interval, and if configured starts
+ * dropping output until the next clean keyframe so that we don't push
+ * pictures predicted from broken references */
+static void
+gst_ffmpegviddec_decode_error (GstFFMpegVidDec * ffmpegdec)
+{
+  GstClockTime now;
+
+  if (ffmpegdec->wait_for_keyframe && !ffmpegdec->waiting_for_keyframe) {
+    GST_DEBUG_OBJECT (ffmpegdec, "dropping output until next keyframe");
+    ffmpegdec->waiting_for_keyframe = TRUE;
+  }
+
+  if (!ffmpegdec->request_keyframe)
+    return;
+
+  now = gst_util_get_timestamp ();
+  if (GST_CLOCK_TIME_IS_VALID (ffmpegdec->last_keyframe_request) &&
+      now - ffmpegdec->last_keyframe_request <
+      ffmpegdec->keyframe_request_interval) {
+    GST_LOG_OBJECT (ffmpegdec, "not requesting keyframe, last request was %"
+        GST_TIME_FORMAT " ago",
+        GST_TIME_ARGS (now - ffmpegdec->last_keyframe_request));
+    return;
+  }
+
+  GST_DEBUG_OBJECT (ffmpegdec, "requesting keyframe from upstream");
+  ffmpegdec->last_keyframe_request = now;
+
+  /* an RTP session translates this into a PLI (or a FIR for all-headers) */
+  gst_pad_push_event (GST_VIDEO_DECODER_SINK_PAD (ffmpegdec),
+      gst_video_event_new_upstream_force_key_unit (GST_CLOCK_TIME_NONE, FALSE,
+          0));
+}
+
 /* get an outbuf buffer with the current picture */
 static GstFlowReturn
 get_output_buffer (GstFFMpegVidDec * ffmpegdec, GstVideoCodecFrame * frame)
@@ -1511,9 +1810,16 @@ get_output_buffer (GstFFMpegVidDec * ffmpegdec, GstVideoCodecFrame * frame)
 
   outpic = ffmpegdec->picture;
 
-  if (av_frame_copy (&pic, outpic) != 0) {
+  if (pic.format != outpic->format || pic.width > outpic->width
+      || pic.height > outpic->height) {
     GST_ERROR_OBJECT (ffmpegdec, "Failed to copy output frame");
     ret = GST_FLOW_ERROR;
+  } else {
+    GST_CAT_TRACE_OBJECT (GST_CAT_PERFORMANCE, ffmpegdec,
+        "Copy decoded picture to output buffer");
+    gst_ffmpeg_image_copy (pic.data, pic.linesize,
+        (const uint8_t **) outpic->data, outpic->linesize, pic.format,
+        pic.width, pic.height);
   }
 
   gst_video_frame_unmap (&vframe);
@@ -1566,6 +1872,7 @@ gst_ffmpegviddec_video_frame (GstFFMpegVidDec * ffmpegdec,
   GstVideoCodecFrame *out_frame;
   GstFFMpegVidDecVideoFrame *out_dframe;
   GstBufferPool *pool;
+  gboolean copied = FALSE;
 
   *ret = GST_FLOW_OK;
 
@@ -1588,6 +1895,7 @@ gst_ffmpegviddec_video_frame (GstFFMpegVidDec * ffmpegdec,
   } else if (res < 0) {
     *ret = GST_FLOW_OK;
     GST_WARNING_OBJECT (ffmpegdec, "Legitimate decoding error");
+    gst_ffmpegviddec_decode_error (ffmpegdec);
     goto beach;
   }
 
@@ -1601,6 +1909,20 @@ gst_ffmpegviddec_video_frame (GstFFMpegVidDec * ffmpegdec,
   gst_buffer_replace (&out_frame->output_buffer, out_dframe->buffer);
   gst_buffer_replace (&out_dframe->buffer, NULL);
 
+  gst_ffmpegviddec_stats_add_decode_time (ffmpegdec, out_frame);
+
+  if (ffmpegdec->picture->flags & AV_FRAME_FLAG_CORRUPT)
+    gst_ffmpegviddec_decode_error (ffmpegdec);
+
+  if (G_UNLIKELY (ffmpegdec->waiting_for_keyframe)) {
+    if (!ffmpegdec->picture->key_frame
+        || (ffmpegdec->picture->flags & AV_FRAME_FLAG_CORRUPT))
+      goto wait_for_keyframe;
+
+    GST_DEBUG_OBJECT (ffmpegdec, "got clean keyframe, resuming output");
+    ffmpegdec->waiting_for_keyframe = FALSE;
+  }
+
   /* Extract auxilliary info not stored in the main AVframe */
   {
     GstVideoInfo *in_info = &ffmpegdec->input_state->info;
@@ -1651,11 +1973,13 @@ gst_ffmpegviddec_video_frame (GstFFMpegVidDec * ffmpegdec,
   pool = gst_video_decoder_get_buffer_pool (GST_VIDEO_DECODER (ffmpegdec));
   if (G_UNLIKELY (out_frame->output_buffer == NULL)) {
     *ret = get_output_buffer (ffmpegdec, out_frame);
+    copied = TRUE;
   } else if (G_UNLIKELY (out_frame->output_buffer->pool != pool)) {
     GstBuffer *tmp = out_frame->output_buffer;
     out_frame->output_buffer = NULL;
     *ret = get_output_buffer (ffmpegdec, out_frame);
     gst_buffer_unref (tmp);
+    copied = TRUE;
   }
 #ifndef G_DISABLE_ASSERT
   else {
@@ -1711,6 +2035,32 @@ gst_ffmpegviddec_video_frame (GstFFMpegVidDec * ffmpegdec,
     }
   }
 
+  if (ffmpegdec->export_mvs) {
+    AVFrameSideData *side_data = av_frame_get_side_data (ffmpegdec->picture,
+        AV_FRAME_DATA_MOTION_VECTORS);
+    if (side_data && side_data->buf) {
+      GST_LOG_OBJECT (ffmpegdec, "Found %d bytes of motion vectors",
+          side_data->size);
+      out_frame->output_buffer =
+          gst_buffer_make_writable (out_frame->output_buffer);
+      gst_buffer_add_ffmpeg_motion_vectors_meta (out_frame->output_buffer,
+          side_data->buf);
+    }
+  }
+#ifdef HAVE_AV_VIDEO_ENC_PARAMS
+  if (ffmpegdec->export_qp) {
+    AVFrameSideData *side_data = av_frame_get_side_data (ffmpegdec->picture,
+        AV_FRAME_DATA_VIDEO_ENC_PARAMS);
+    if (side_data && side_data->buf) {
+      GST_LOG_OBJECT (ffmpegdec, "Found %d bytes of encoding parameters",
+          side_data->size);
+      out_frame->output_buffer =
+          gst_buffer_make_writable (out_frame->output_buffer);
+      gst_buffer_add_ffmpeg_qp_meta (out_frame->output_buffer, side_data->buf);
+    }
+  }
+#endif
+
   /* cleaning time */
   /* so we decoded this frame, frames preceding it in decoding order
    * that still do not have a buffer allocated seem rather useless,
@@ -1735,6 +2085,7 @@ gst_ffmpegviddec_video_frame (GstFFMpegVidDec * ffmpegdec,
             "discarding ghost frame %p (#%d) PTS:%" GST_TIME_FORMAT " DTS:%"
             GST_TIME_FORMAT, tmp, tmp->system_frame_number,
             GST_TIME_ARGS (tmp->pts), GST_TIME_ARGS (tmp->dts));
+        gst_ffmpegviddec_stats_add_skipped (ffmpegdec, tmp);
         /* drop extra ref and remove from frame list */
         gst_video_decoder_release_frame (dec, tmp);
       } else {
@@ -1748,6 +2099,14 @@ gst_ffmpegviddec_video_frame (GstFFMpegVidDec * ffmpegdec,
 
   av_frame_unref (ffmpegdec->picture);
 
+  g_mutex_lock (&ffmpegdec->stats_lock);
+  ffmpegdec->stats.frames_out++;
+  if (copied)
+    ffmpegdec->stats.frames_copied++;
+  else
+    ffmpegdec->stats.frames_direct++;
+  g_mutex_unlock (&ffmpegdec->stats_lock);
+
   /* FIXME: Ideally we would remap the buffer read-only now before pushing but
    * libav might still have a reference to it!
    */
@@ -1763,10 +2122,25 @@ beach:
 no_output:
   {
     GST_DEBUG_OBJECT (ffmpegdec, "no output buffer");
+    g_mutex_lock (&ffmpegdec->stats_lock);
+    ffmpegdec->stats.frames_dropped++;
+    g_mutex_unlock (&ffmpegdec->stats_lock);
     gst_video_decoder_drop_frame (GST_VIDEO_DECODER (ffmpegdec), out_frame);
     goto beach;
   }
 
+wait_for_keyframe:
+  {
+    GST_LOG_OBJECT (ffmpegdec, "dropping frame, waiting for keyframe");
+    av_frame_unref (ffmpegdec->picture);
+    g_mutex_lock (&ffmpegdec->stats_lock);
+    ffmpegdec->stats.frames_dropped++;
+    g_mutex_unlock (&ffmpegdec->stats_lock);
+    *ret = gst_video_decoder_drop_frame (GST_VIDEO_DECODER (ffmpegdec),
+        out_frame);
+    goto beach;
+  }
+
 negotiation_error:
   {
     if (GST_PAD_IS_FLUSHING (GST_VIDEO_DECODER_SRC_PAD (ffmpegdec))) {
@@ -1811,10 +2185,15 @@ gst_ffmpegviddec_drain (GstVideoDecoder * decoder)
 {
   GstFFMpegVidDec *ffmpegdec = (GstFFMpegVidDec *) decoder;
   GstFlowReturn ret = GST_FLOW_OK;
+  GstFlowReturn thread_ret = GST_FLOW_OK;
   gboolean got_frame = FALSE;
 
+  /* the last queued frames might have failed, report that after draining */
+  if (ffmpegdec->codec_thread)
+    thread_ret = gst_ffmpeg_codec_thread_wait (ffmpegdec->codec_thread);
+
   if (!ffmpegdec->opened)
-    return GST_FLOW_OK;
+    return thread_ret;
 
   if (avcodec_send_packet (ffmpegdec->context, NULL))
     goto send_packet_failed;
@@ -1833,6 +2212,8 @@ gst_ffmpegviddec_drain (GstVideoDecoder * decoder)
     ret = GST_FLOW_OK;
 
 done:
+  if (ret == GST_FLOW_OK)
+    ret = thread_ret;
   return ret;
 
 send_packet_failed:
@@ -1840,11 +2221,104 @@ send_packet_failed:
   goto done;
 }
 
+/* called with the stream lock when we have been idle for a while, releases
+ * everything that is transparently recreated when data flows again */
+static void
+gst_ffmpegviddec_trim (GstFFMpegVidDec * ffmpegdec)
+{
+  GstVideoDecoder *decoder = GST_VIDEO_DECODER (ffmpegdec);
+  GstBufferPool *pool;
+
+  GST_DEBUG_OBJECT (ffmpegdec, "idle, releasing resources");
+
+  g_free (ffmpegdec->padded);
+  ffmpegdec->padded = NULL;
+  ffmpegdec->padded_size = 0;
+  gst_ffmpeg_free_list_trim (ffmpegdec->frame_list);
+
+  /* the internal pool can be the downstream pool, which isn't ours to free */
+  pool = gst_video_decoder_get_buffer_pool (decoder);
+  if (ffmpegdec->internal_pool && ffmpegdec->internal_pool != pool) {
+    gst_buffer_pool_set_active (ffmpegdec->internal_pool, FALSE);
+    gst_object_unref (ffmpegdec->internal_pool);
+    ffmpegdec->internal_pool = NULL;
+  }
+  if (pool)
+    gst_object_unref (pool);
+
+  if (ffmpegdec->idle_close_codec && ffmpegdec->opened
+      && ffmpegdec->input_state) {
+    GList *frames;
+
+    /* push out what the codec still holds, these pictures are late anyway.
+     * When not PLAYING this could block on preroll, keep the codec then */
+    if (GST_STATE (ffmpegdec) == GST_STATE_PLAYING)
+      gst_ffmpegviddec_drain (decoder);
+
+    frames = gst_video_decoder_get_frames (decoder);
+    if (frames == NULL) {
+      GST_DEBUG_OBJECT (ffmpegdec, "closing codec");
+      GST_OBJECT_LOCK (ffmpegdec);
+      gst_ffmpegviddec_close (ffmpegdec, TRUE);
+      GST_OBJECT_UNLOCK (ffmpegdec);
+      ffmpegdec->idle_closed = TRUE;
+    } else {
+      GST_DEBUG_OBJECT (ffmpegdec, "frames pending, keeping codec open");
+      g_list_free_full (frames, (GDestroyNotify) gst_video_codec_frame_unref);
+    }
+  }
+
+  ffmpegdec->idle = TRUE;
+}
+
+static gboolean
+gst_ffmpegviddec_resume (GstFFMpegVidDec * ffmpegdec)
+{
+  GstVideoCodecState *state;
+  gboolean ret;
+
+  ffmpegdec->idle = FALSE;
+
+  if (!ffmpegdec->idle_closed)
+    return TRUE;
+
+  GST_DEBUG_OBJECT (ffmpegdec, "reopening codec after idle period");
+  ffmpegdec->idle_closed = FALSE;
+
+  /* set_format replaces input_state with the state we pass */
+  state = gst_video_codec_state_ref (ffmpegdec->input_state);
+  ret = gst_ffmpegviddec_set_format (GST_VIDEO_DECODER (ffmpegdec), state);
+  gst_video_codec_state_unref (state);
+
+  return ret;
+}
+
+/* called from the thread of the idle watch */
+static void
+gst_ffmpegviddec_idle_cb (GstElement * element)
+{
+  GstFFMpegVidDec *ffmpegdec = (GstFFMpegVidDec *) element;
+  GstVideoDecoder *decoder = GST_VIDEO_DECODER (ffmpegdec);
+
+  /* data is flowing or the element is stopping, try again on the next
+   * tick */
+  if (!g_rec_mutex_trylock (&decoder->stream_lock))
+    return;
+
+  if (!ffmpegdec->idle && !ffmpegdec->sending &&
+      gst_util_get_timestamp () - ffmpegdec->last_input_time >=
+      ffmpegdec->idle_timeout)
+    gst_ffmpegviddec_trim (ffmpegdec);
+
+  GST_VIDEO_DECODER_STREAM_UNLOCK (decoder);
+}
+
+/* called from the streaming thread or the codec thread with the stream lock,
+ * takes ownership of frame */
 static GstFlowReturn
-gst_ffmpegviddec_handle_frame (GstVideoDecoder * decoder,
+gst_ffmpegviddec_decode_frame (GstFFMpegVidDec * ffmpegdec,
     GstVideoCodecFrame * frame)
 {
-  GstFFMpegVidDec *ffmpegdec = (GstFFMpegVidDec *) decoder;
   guint8 *data;
   gint size;
   gboolean got_frame;
@@ -1858,6 +2332,16 @@ gst_ffmpegviddec_handle_frame (GstVideoDecoder * decoder,
       gst_buffer_get_size (frame->input_buffer), GST_TIME_ARGS (frame->dts),
       GST_TIME_ARGS (frame->pts), GST_TIME_ARGS (frame->duration));
 
+  g_mutex_lock (&ffmpegdec->stats_lock);
+  ffmpegdec->stats.frames_in++;
+  g_mutex_unlock (&ffmpegdec->stats_lock);
+
+  ffmpegdec->last_input_time = gst_util_get_timestamp ();
+  if (G_UNLIKELY (ffmpegdec->idle) && !gst_ffmpegviddec_resume (ffmpegdec)) {
+    gst_video_codec_frame_unref (frame);
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
   if (!gst_buffer_map (frame->input_buffer, &minfo, GST_MAP_READ)) {
     GST_ELEMENT_ERROR (ffmpegdec, STREAM, DECODE, ("Decoding problem"),
         ("Failed to map buffer for reading"));
@@ -1880,11 +2364,21 @@ gst_ffmpegviddec_handle_frame (GstVideoDecoder * decoder,
       GST_LOG_OBJECT (ffmpegdec, "resized padding buffer to %d",
           ffmpegdec->padded_size);
     }
-    GST_CAT_TRACE_OBJECT (GST_CAT_PERFORMANCE, ffmpegdec,
-        "Copy input to add padding");
     memcpy (ffmpegdec->padded, data, size);
     memset (ffmpegdec->padded + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
 
+    g_mutex_lock (&ffmpegdec->stats_lock);
+    ffmpegdec->stats.padding_bytes += size;
+    ffmpegdec->stats.padding_copies++;
+    if (ffmpegdec->stats.padding_copies == 1)
+      GST_CAT_DEBUG_OBJECT (GST_CAT_PERFORMANCE, ffmpegdec,
+          "Input memory is not padded, copying it");
+    GST_CAT_TRACE_OBJECT (GST_CAT_PERFORMANCE, ffmpegdec,
+        "Copy input to add padding (%" G_GUINT64_FORMAT " of %"
+        G_GUINT64_FORMAT " packets so far)", ffmpegdec->stats.padding_copies,
+        ffmpegdec->stats.frames_in);
+    g_mutex_unlock (&ffmpegdec->stats_lock);
+
     data = ffmpegdec->padded;
   }
 
@@ -1910,17 +2404,28 @@ gst_ffmpegviddec_handle_frame (GstVideoDecoder * decoder,
   GST_DEBUG_OBJECT (ffmpegdec, "stored opaque values idx %d",
       frame->system_frame_number);
 
+  {
+    GstFFMpegVidDecFrameInfo *info =
+        &ffmpegdec->frame_info[frame->system_frame_number & MAX_TS_MASK];
+
+    info->send_time = gst_util_get_timestamp ();
+    info->skip_frame = ffmpegdec->context->skip_frame;
+  }
+
   /* This might call into get_buffer() from another thread,
    * which would cause a deadlock. Release the lock here
    * and taking it again later seems safe
    * See https://bugzilla.gnome.org/show_bug.cgi?id=726020
    */
+  ffmpegdec->sending = TRUE;
   GST_VIDEO_DECODER_STREAM_UNLOCK (ffmpegdec);
   if (avcodec_send_packet (ffmpegdec->context, &packet) < 0) {
     GST_VIDEO_DECODER_STREAM_LOCK (ffmpegdec);
+    ffmpegdec->sending = FALSE;
     goto send_packet_failed;
   }
   GST_VIDEO_DECODER_STREAM_LOCK (ffmpegdec);
+  ffmpegdec->sending = FALSE;
 
   do {
     /* decode a frame of audio/video now */
@@ -1933,6 +2438,8 @@ gst_ffmpegviddec_handle_frame (GstVideoDecoder * decoder,
     }
   } while (got_frame);
 
+  gst_ffmpegviddec_post_stats (ffmpegdec);
+
 done:
   gst_buffer_unmap (frame->input_buffer, &minfo);
   gst_video_codec_frame_unref (frame);
@@ -1942,15 +2449,39 @@ done:
 send_packet_failed:
   {
     GST_WARNING_OBJECT (ffmpegdec, "Failed to send data for decoding");
+    gst_ffmpegviddec_decode_error (ffmpegdec);
     goto done;
   }
 }
 
+static GstFlowReturn
+gst_ffmpegviddec_handle_frame (GstVideoDecoder * decoder,
+    GstVideoCodecFrame * frame)
+{
+  GstFFMpegVidDec *ffmpegdec = (GstFFMpegVidDec *) decoder;
+  GstFlowReturn ret;
+
+  if (!ffmpegdec->codec_thread)
+    return gst_ffmpegviddec_decode_frame (ffmpegdec, frame);
+
+  /* decoding and pushing happens in the codec thread, we get the flow
+   * return of previous frames here */
+  ret = gst_ffmpeg_codec_thread_push (ffmpegdec->codec_thread, frame);
+  if (ret != GST_FLOW_OK) {
+    GST_DEBUG_OBJECT (ffmpegdec, "codec thread returned %s",
+        gst_flow_get_name (ret));
+    gst_video_decoder_release_frame (decoder, frame);
+  }
+
+  return ret;
+}
+
 static gboolean
 gst_ffmpegviddec_start (GstVideoDecoder * decoder)
 {
   GstFFMpegVidDec *ffmpegdec = (GstFFMpegVidDec *) decoder;
   GstFFMpegVidDecClass *oclass;
+  guint i;
 
   oclass = (GstFFMpegVidDecClass *) (G_OBJECT_GET_CLASS (ffmpegdec));
 
@@ -1964,6 +2495,28 @@ gst_ffmpegviddec_start (GstVideoDecoder * decoder)
   ffmpegdec->context->opaque = ffmpegdec;
   GST_OBJECT_UNLOCK (ffmpegdec);
 
+  g_mutex_lock (&ffmpegdec->stats_lock);
+  memset (&ffmpegdec->stats, 0, sizeof (ffmpegdec->stats));
+  g_mutex_unlock (&ffmpegdec->stats_lock);
+  for (i = 0; i < G_N_ELEMENTS (ffmpegdec->frame_info); i++)
+    ffmpegdec->frame_info[i].send_time = GST_CLOCK_TIME_NONE;
+  ffmpegdec->last_stats_post = GST_CLOCK_TIME_NONE;
+
+  ffmpegdec->last_input_time = gst_util_get_timestamp ();
+  ffmpegdec->idle = FALSE;
+  ffmpegdec->idle_closed = FALSE;
+  if (ffmpegdec->idle_timeout > 0)
+    ffmpegdec->idle_watch = gst_ffmpeg_idle_watch_new (GST_ELEMENT (ffmpegdec),
+        MAX (ffmpegdec->idle_timeout / 2, GST_MSECOND),
+        gst_ffmpegviddec_idle_cb);
+
+  if (ffmpegdec->async_depth > 0)
+    ffmpegdec->codec_thread =
+        gst_ffmpeg_codec_thread_new (GST_ELEMENT (ffmpegdec),
+        &decoder->stream_lock, ffmpegdec->async_depth,
+        (GstFFMpegCodecThreadFunc) gst_ffmpegviddec_decode_frame,
+        (GDestroyNotify) gst_video_codec_frame_unref);
+
   return TRUE;
 }
 
@@ -1972,6 +2525,19 @@ gst_ffmpegviddec_stop (GstVideoDecoder * decoder)
 {
   GstFFMpegVidDec *ffmpegdec = (GstFFMpegVidDec *) decoder;
 
+  if (ffmpegdec->idle_watch) {
+    gst_ffmpeg_idle_watch_free (ffmpegdec->idle_watch);
+    ffmpegdec->idle_watch = NULL;
+  }
+  ffmpegdec->idle = FALSE;
+  ffmpegdec->idle_closed = FALSE;
+
+  /* called without the stream lock */
+  if (ffmpegdec->codec_thread) {
+    gst_ffmpeg_codec_thread_free (ffmpegdec->codec_thread);
+    ffmpegdec->codec_thread = NULL;
+  }
+
   GST_OBJECT_LOCK (ffmpegdec);
   gst_ffmpegviddec_close (ffmpegdec, FALSE);
   GST_OBJECT_UNLOCK (ffmpegdec);
@@ -2005,6 +2571,9 @@ gst_ffmpegviddec_stop (GstVideoDecoder * decoder)
   ffmpegdec->pool_height = 0;
   ffmpegdec->pool_format = 0;
 
+  ffmpegdec->waiting_for_keyframe = FALSE;
+  ffmpegdec->last_keyframe_request = GST_CLOCK_TIME_NONE;
+
   return TRUE;
 }
 
@@ -2027,11 +2596,17 @@ gst_ffmpegviddec_flush (GstVideoDecoder * decoder)
 {
   GstFFMpegVidDec *ffmpegdec = (GstFFMpegVidDec *) decoder;
 
+  if (ffmpegdec->codec_thread)
+    gst_ffmpeg_codec_thread_flush (ffmpegdec->codec_thread);
+
   if (ffmpegdec->opened) {
     GST_LOG_OBJECT (decoder, "flushing buffers");
     avcodec_flush_buffers (ffmpegdec->context);
   }
 
+  /* decoding restarts from scratch, previous errors don't matter anymore */
+  ffmpegdec->waiting_for_keyframe = FALSE;
+
   return TRUE;
 }
 
@@ -2069,6 +2644,10 @@ gst_ffmpegviddec_decide_allocation (GstVideoDecoder * decoder, GstQuery * query)
   if (max != 0 && max < REQUIRED_POOL_MAX_BUFFERS) {
     gst_object_unref (pool);
     pool = gst_video_buffer_pool_new ();
+
+    g_mutex_lock (&ffmpegdec->stats_lock);
+    ffmpegdec->stats.pools_created++;
+    g_mutex_unlock (&ffmpegdec->stats_lock);
     max = 0;
     update_pool = TRUE;
     have_pool = FALSE;
@@ -2186,15 +2765,26 @@ static gboolean
 gst_ffmpegviddec_propose_allocation (GstVideoDecoder * decoder,
     GstQuery * query)
 {
-  GstAllocationParams params;
+  GstCaps *caps;
+  GstStructure *s;
+  gint width = 0, height = 0;
+  guint size = 0;
+
+  /* a compressed picture is assumed to be no bigger than the raw 4:2:0
+   * one, a pool is only offered when the caps tell us how big that is */
+  gst_query_parse_allocation (query, &caps, NULL);
+  if (caps && gst_caps_get_size (caps) > 0) {
+    s = gst_caps_get_structure (caps, 0);
+    if (gst_structure_get_int (s, "width", &width)
+        && gst_structure_get_int (s, "height", &height)
+        && width > 0 && height > 0 && width <= 16384 && height <= 16384)
+      size = width * height * 3 / 2;
+  }
 
-  gst_allocation_params_init (&params);
-  params.flags = GST_MEMORY_FLAG_ZERO_PADDED;
-  params.align = DEFAULT_STRIDE_ALIGN;
-  params.padding = AV_INPUT_BUFFER_PADDING_SIZE;
   /* we would like to have some padding so that we don't have to
-   * memcpy. We don't suggest an allocator. */
-  gst_query_add_allocation_param (query, NULL, &params);
+   * memcpy */
+  gst_ffmpeg_propose_padded_allocation (GST_ELEMENT_CAST (decoder), query,
+      size, DEFAULT_STRIDE_ALIGN);
 
   return GST_VIDEO_DECODER_CLASS (parent_class)->propose_allocation (decoder,
       query);
@@ -2230,6 +2820,33 @@ gst_ffmpegviddec_set_property (GObject * object,
     case PROP_THREAD_TYPE:
       ffmpegdec->thread_type = g_value_get_flags (value);
       break;
+    case PROP_REQUEST_KEYFRAME:
+      ffmpegdec->request_keyframe = g_value_get_boolean (value);
+      break;
+    case PROP_KEYFRAME_REQUEST_INTERVAL:
+      ffmpegdec->keyframe_request_interval = g_value_get_uint64 (value);
+      break;
+    case PROP_WAIT_FOR_KEYFRAME:
+      ffmpegdec->wait_for_keyframe = g_value_get_boolean (value);
+      break;
+    case PROP_EXPORT_MVS:
+      ffmpegdec->export_mvs = g_value_get_boolean (value);
+      break;
+    case PROP_EXPORT_QP:
+      ffmpegdec->export_qp = g_value_get_boolean (value);
+      break;
+    case PROP_STATS_INTERVAL:
+      ffmpegdec->stats_interval = g_value_get_uint64 (value);
+      break;
+    case PROP_IDLE_TIMEOUT:
+      ffmpegdec->idle_timeout = g_value_get_uint64 (value);
+      break;
+    case PROP_IDLE_CLOSE_CODEC:
+      ffmpegdec->idle_close_codec = g_value_get_boolean (value);
+      break;
+    case PROP_ASYNC_DEPTH:
+      ffmpegdec->async_depth = g_value_get_uint (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -2264,6 +2881,36 @@ gst_ffmpegviddec_get_property (GObject * object,
     case PROP_THREAD_TYPE:
       g_value_set_flags (value, ffmpegdec->thread_type);
       break;
+    case PROP_REQUEST_KEYFRAME:
+      g_value_set_boolean (value, ffmpegdec->request_keyframe);
+      break;
+    case PROP_KEYFRAME_REQUEST_INTERVAL:
+      g_value_set_uint64 (value, ffmpegdec->keyframe_request_interval);
+      break;
+    case PROP_WAIT_FOR_KEYFRAME:
+      g_value_set_boolean (value, ffmpegdec->wait_for_keyframe);
+      break;
+    case PROP_EXPORT_MVS:
+      g_value_set_boolean (value, ffmpegdec->export_mvs);
+      break;
+    case PROP_EXPORT_QP:
+      g_value_set_boolean (value, ffmpegdec->export_qp);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed (value, gst_ffmpegviddec_create_stats (ffmpegdec));
+      break;
+    case PROP_STATS_INTERVAL:
+      g_value_set_uint64 (value, ffmpegdec->stats_interval);
+      break;
+    case PROP_IDLE_TIMEOUT:
+      g_value_set_uint64 (value, ffmpegdec->idle_timeout);
+      break;
+    case PROP_IDLE_CLOSE_CODEC:
+      g_value_set_boolean (value, ffmpegdec->idle_close_codec);
+      break;
+    case PROP_ASYNC_DEPTH:
+      g_value_set_uint (value, ffmpegdec->async_depth);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -23,8 +23,37 @@
 #include <gst/video/video.h>
 #include <libavcodec/avcodec.h>
 
+#include "gstavutils.h"
+
 G_BEGIN_DECLS
 
+#define GST_FFMPEGVIDDEC_N_DECODE_TIME_BUCKETS 8
+
+/* counters reported by the "stats" property */
+typedef struct
+{
+  guint64 frames_in;
+  guint64 frames_out;
+  guint64 frames_dropped;
+  guint64 qos_dropped_nonref;
+  guint64 qos_dropped_nonkey;
+  guint64 frames_copied;
+  guint64 frames_direct;
+  guint64 padding_bytes;
+  guint64 padding_copies;
+  guint64 pools_created;
+  /* bucket i counts frames decoded in less than 2^i ms, the last one
+   * counts all the slower ones */
+  guint64 decode_time[GST_FFMPEGVIDDEC_N_DECODE_TIME_BUCKETS];
+} GstFFMpegVidDecStats;
+
+/* per input frame bookkeeping for the statistics */
+typedef struct
+{
+  GstClockTime send_time;
+  enum AVDiscard skip_frame;
+} GstFFMpegVidDecFrameInfo;
+
 typedef struct _GstFFMpegVidDec GstFFMpegVidDec;
 struct _GstFFMpegVidDec
 {
@@ -70,6 +99,19 @@ struct _GstFFMpegVidDec
   int max_threads;
   gboolean output_corrupt;
   guint thread_type;
+  gboolean request_keyframe;
+  GstClockTime keyframe_request_interval;
+  gboolean wait_for_keyframe;
+  gboolean export_mvs;
+  gboolean export_qp;
+  GstClockTime stats_interval;
+  GstClockTime idle_timeout;
+  gboolean idle_close_codec;
+  guint async_depth;
+
+  /* error recovery */
+  gboolean waiting_for_keyframe;
+  GstClockTime last_keyframe_request;
 
   GstCaps *last_caps;
 
@@ -79,6 +121,26 @@ struct _GstFFMpegVidDec
   gint pool_height;
   enum AVPixelFormat pool_format;
   GstVideoInfo pool_info;
+
+  /* decoding in a separate thread, see async-depth */
+  GstFFMpegCodecThread *codec_thread;
+
+  /* idle trimming, protected by the stream lock */
+  GstFFMpegIdleWatch *idle_watch;
+  GstClockTime last_input_time;
+  gboolean sending;
+  gboolean idle;
+  gboolean idle_closed;
+
+  /* statistics, also updated from the frame threads */
+  GMutex stats_lock;
+  GstFFMpegVidDecStats stats;
+  GstClockTime last_stats_post;
+  /* indexed by system_frame_number & 0xff */
+  GstFFMpegVidDecFrameInfo frame_info[256];
+
+  /* recycled GstFFMpegVidDecVideoFrame */
+  GstFFMpegFreeList *frame_list;
 };
 
 typedef struct _GstFFMpegVidDecClass GstFFMpegVidDecClass;
@@ -31,13 +31,29 @@
 #include <libavcodec/avcodec.h>
 #include <libavutil/stereo3d.h>
 #include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
 
 #include "gstav.h"
 #include "gstavcodecmap.h"
 #include "gstavutils.h"
+#include "gstavconvert.h"
 #include "gstavvidenc.h"
 #include "gstavcfg.h"
-
+#include "gstavmeta.h"
+
+#define DEFAULT_IDLE_TIMEOUT            0
+#define DEFAULT_IDLE_CLOSE_CODEC        FALSE
+#define DEFAULT_ASYNC_DEPTH             0
+#define DEFAULT_CONVERT                 FALSE
+#define DEFAULT_ADAPTIVE_SPEED          FALSE
+#define DEFAULT_LOW_LATENCY             FALSE
+#define DEFAULT_MAX_THREADS             0
+#define DEFAULT_THREAD_TYPE             0
+#define DEFAULT_STRIDE_ALIGN            31
+#define DEFAULT_PARALLEL_CONTEXTS       1
+#define MAX_PARALLEL_CONTEXTS           64
+#define DEFAULT_ALLOC_PARAM             { 0, DEFAULT_STRIDE_ALIGN, 0, 0, }
+#define STATS_WINDOW                    GST_SECOND
 
 enum
 {
@@ -45,6 +61,17 @@ enum
   PROP_QUANTIZER,
   PROP_PASS,
   PROP_FILENAME,
+  PROP_IDLE_TIMEOUT,
+  PROP_IDLE_CLOSE_CODEC,
+  PROP_ASYNC_DEPTH,
+  PROP_CONVERT,
+  PROP_ADAPTIVE_SPEED,
+  PROP_LOW_LATENCY,
+  PROP_MAX_THREADS,
+  PROP_THREAD_TYPE,
+  PROP_MULTIPASS_CACHE_ID,
+  PROP_PARALLEL_CONTEXTS,
+  PROP_STATS,
   PROP_CFG_BASE,
 };
 
@@ -60,10 +87,20 @@ static gboolean gst_ffmpegvidenc_set_format (GstVideoEncoder * encoder,
     GstVideoCodecState * state);
 static gboolean gst_ffmpegvidenc_propose_allocation (GstVideoEncoder * encoder,
     GstQuery * query);
+static GstCaps *gst_ffmpegvidenc_getcaps (GstVideoEncoder * encoder,
+    GstCaps * filter);
 static gboolean gst_ffmpegvidenc_flush (GstVideoEncoder * encoder);
 
 static GstFlowReturn gst_ffmpegvidenc_handle_frame (GstVideoEncoder * encoder,
     GstVideoCodecFrame * frame);
+static GstFlowReturn gst_ffmpegvidenc_flush_buffers (GstFFMpegVidEnc *
+    ffmpegenc, gboolean send);
+static void gst_ffmpegvidenc_init_speed (GstFFMpegVidEnc * ffmpegenc);
+static void gst_ffmpegvidenc_parallel_start (GstFFMpegVidEnc * ffmpegenc);
+static void gst_ffmpegvidenc_parallel_stop (GstFFMpegVidEnc * ffmpegenc);
+static GstFlowReturn gst_ffmpegvidenc_parallel_drain (GstFFMpegVidEnc *
+    ffmpegenc, gboolean send);
+static void gst_ffmpegvidenc_stats_reset (GstFFMpegVidEnc * ffmpegenc);
 
 static void gst_ffmpegvidenc_set_property (GObject * object,
     guint prop_id, const GValue * value, GParamSpec * pspec);
@@ -96,6 +133,27 @@ gst_ffmpeg_pass_get_type (void)
   return ffmpeg_pass_type;
 }
 
+static const GFlagsValue ffmpegenc_thread_types[] = {
+  {0x0, "Auto", "auto"},
+  {0x1, "Frame", "frame"},
+  {0x2, "Slice", "slice"},
+  {0, NULL, NULL},
+};
+
+#define GST_FFMPEGVIDENC_TYPE_THREAD_TYPE (gst_ffmpegvidenc_thread_type_get_type())
+static GType
+gst_ffmpegvidenc_thread_type_get_type (void)
+{
+  static GType ffmpegenc_thread_type_type = 0;
+
+  if (!ffmpegenc_thread_type_type) {
+    ffmpegenc_thread_type_type =
+        g_flags_register_static ("GstLibAVVidEncThreadType",
+        ffmpegenc_thread_types);
+  }
+  return ffmpegenc_thread_type_type;
+}
+
 static void
 gst_ffmpegvidenc_base_init (GstFFMpegVidEncClass * klass)
 {
@@ -136,6 +194,20 @@ gst_ffmpegvidenc_base_init (GstFFMpegVidEncClass * klass)
     sinkcaps = gst_caps_new_empty_simple ("unknown/unknown");
   }
 
+  /* with the convert property the encoder also takes all the formats it
+   * can convert from, the instances only offer them when it is set */
+  klass->native_caps = gst_caps_ref (sinkcaps);
+  if (in_plugin->pix_fmts) {
+    GstCaps *convcaps = gst_caps_copy (sinkcaps);
+    GValue formats = G_VALUE_INIT;
+
+    gst_ffmpeg_video_converter_get_formats (&formats);
+    gst_caps_set_value (convcaps, "format", &formats);
+    g_value_unset (&formats);
+
+    sinkcaps = gst_caps_merge (sinkcaps, convcaps);
+  }
+
   /* pad templates */
   sinktempl = gst_pad_template_new ("sink", GST_PAD_SINK,
       GST_PAD_ALWAYS, sinkcaps);
@@ -159,6 +231,7 @@ gst_ffmpegvidenc_class_init (GstFFMpegVidEncClass * klass)
 {
   GObjectClass *gobject_class;
   GstVideoEncoderClass *venc_class;
+  int caps;
 
   gobject_class = (GObjectClass *) klass;
   venc_class = (GstVideoEncoderClass *) klass;
@@ -183,6 +256,125 @@ gst_ffmpegvidenc_class_init (GstFFMpegVidEncClass * klass)
           "Filename for multipass cache file", "stats.log",
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT));
 
+  g_object_class_install_property (gobject_class, PROP_IDLE_TIMEOUT,
+      g_param_spec_uint64 ("idle-timeout", "Idle timeout",
+          "Release the cached packets and conversion buffers after this "
+          "many nanoseconds without input (0 = disabled)", 0, G_MAXUINT64,
+          DEFAULT_IDLE_TIMEOUT, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_IDLE_CLOSE_CODEC,
+      g_param_spec_boolean ("idle-close-codec", "Close codec when idle",
+          "Close the codec and its threads when idle, it is reopened when "
+          "data flows again (not done for multipass encoding)",
+          DEFAULT_IDLE_CLOSE_CODEC,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ASYNC_DEPTH,
+      g_param_spec_uint ("async-depth", "Async depth",
+          "Encode in a separate thread with up to this many frames queued, "
+          "which adds the same number of frames of latency (0 = encode in "
+          "the streaming thread)", 0, 64, DEFAULT_ASYNC_DEPTH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CONVERT,
+      g_param_spec_boolean ("convert", "Convert",
+          "Accept all the raw formats the encoder can convert from and "
+          "convert them to the closest format the codec takes",
+          DEFAULT_CONVERT, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstFFMpegVidEnc:adaptive-speed:
+   *
+   * Trade quality for speed when the input frames arrive later and later
+   * against the clock, stepping the motion search and macroblock decision
+   * options towards faster settings, and back once there is headroom again.
+   * Every step posts an element message with a structure with name
+   * avenc-speed with the following fields:
+   *
+   * - "level" G_TYPE_UINT: 0 for the configured settings, up to 3 for the
+   *   fastest ones
+   * - "lateness" G_TYPE_INT64: how much later than usual the frame that
+   *   caused the step arrived, in nanoseconds
+   */
+  g_object_class_install_property (gobject_class, PROP_ADAPTIVE_SPEED,
+      g_param_spec_boolean ("adaptive-speed", "Adaptive speed",
+          "Use faster encoding settings while the encoder falls behind the "
+          "clock in live pipelines", DEFAULT_ADAPTIVE_SPEED,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LOW_LATENCY,
+      g_param_spec_boolean ("low-latency", "Low latency",
+          "Output every frame as soon as it is encoded: no B-frames, no "
+          "lookahead and only slice threading", DEFAULT_LOW_LATENCY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MULTIPASS_CACHE_ID,
+      g_param_spec_string ("multipass-cache-id", "Multipass Cache Id",
+          "Keep the multipass statistics in memory under this id instead of "
+          "in the multipass cache file, for a second pass in the same "
+          "process. They are released when the second pass stops", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstFFMpegVidEnc:parallel-contexts:
+   *
+   * Encode chunks of the input on this many codec contexts on worker
+   * threads, each chunk a closed GOP of gop-size frames, or a single frame
+   * for intra-only codecs like MJPEG, ProRes, DNxHD or FFV1. Meant for
+   * offline transcoding: it is not used with live input, multipass
+   * encoding, conversion or async-depth, up to twice as many chunks as
+   * contexts are held back and the rate control runs separately on each
+   * chunk. The output stays in input order.
+   */
+  g_object_class_install_property (gobject_class, PROP_PARALLEL_CONTEXTS,
+      g_param_spec_uint ("parallel-contexts", "Parallel contexts",
+          "Number of contexts encoding chunks of the input in parallel "
+          "(0 = number of processors, 1 = disabled)", 0,
+          MAX_PARALLEL_CONTEXTS, DEFAULT_PARALLEL_CONTEXTS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstFFMpegVidEnc:stats:
+   *
+   * Statistics of the output, for controllers that adapt the rate without
+   * parsing the bitstream. A structure with name avenc-stats with the
+   * following fields:
+   *
+   * - "frames" G_TYPE_UINT64: packets output since the encoder started
+   * - "bitrate" G_TYPE_UINT64: bitrate of the last second of output, in
+   *   bits/s
+   * - "keyframe-interval" G_TYPE_UINT: frames between the last two
+   *   keyframes, 0 until there were two
+   * - "encode-time" G_TYPE_UINT64: moving average of the time the codec
+   *   spends on a frame, in nanoseconds. Not measured with
+   *   parallel-contexts
+   *
+   * The details of every packet are in the GstFFMpegEncoderStatsMeta of
+   * the output buffers.
+   */
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Bitrate, keyframe interval and encode time of the output",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  /* thread-type replaces the generic thread_type option, which is not
+   * installed then. The generic threads option still is, max-threads wins
+   * over it unless max-threads is left at 0 (auto) */
+  caps = klass->in_plugin->capabilities;
+  if (caps & (AV_CODEC_CAP_FRAME_THREADS | AV_CODEC_CAP_SLICE_THREADS)) {
+    g_object_class_install_property (gobject_class, PROP_MAX_THREADS,
+        g_param_spec_int ("max-threads", "Maximum encode threads",
+            "Maximum number of worker threads to spawn. (0 = auto)",
+            0, G_MAXINT, DEFAULT_MAX_THREADS,
+            G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property (gobject_class, PROP_THREAD_TYPE,
+        g_param_spec_flags ("thread-type", "Thread type",
+            "Multithreading methods to use (auto = slice when live, frame "
+            "when the codec can and upstream isn't live)",
+            GST_FFMPEGVIDENC_TYPE_THREAD_TYPE, DEFAULT_THREAD_TYPE,
+            G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  }
+
   /* register additional properties, possibly dependent on the exact CODEC */
   gst_ffmpeg_cfg_install_properties (gobject_class, klass->in_plugin,
       PROP_CFG_BASE, AV_OPT_FLAG_ENCODING_PARAM | AV_OPT_FLAG_VIDEO_PARAM);
@@ -193,13 +385,21 @@ gst_ffmpegvidenc_class_init (GstFFMpegVidEncClass * klass)
   venc_class->handle_frame = gst_ffmpegvidenc_handle_frame;
   venc_class->set_format = gst_ffmpegvidenc_set_format;
   venc_class->propose_allocation = gst_ffmpegvidenc_propose_allocation;
+  venc_class->getcaps = gst_ffmpegvidenc_getcaps;
   venc_class->flush = gst_ffmpegvidenc_flush;
 
   gobject_class->finalize = gst_ffmpegvidenc_finalize;
 
   gst_type_mark_as_plugin_api (GST_TYPE_FFMPEG_PASS, 0);
+  gst_type_mark_as_plugin_api (GST_FFMPEGVIDENC_TYPE_THREAD_TYPE, 0);
 }
 
+typedef struct
+{
+  GstBuffer *buffer;
+  GstVideoFrame vframe;
+} BufferInfo;
+
 static void
 gst_ffmpegvidenc_init (GstFFMpegVidEnc * ffmpegenc)
 {
@@ -213,6 +413,26 @@ gst_ffmpegvidenc_init (GstFFMpegVidEnc * ffmpegenc)
   ffmpegenc->picture = av_frame_alloc ();
   ffmpegenc->opened = FALSE;
   ffmpegenc->file = NULL;
+  ffmpegenc->idle_timeout = DEFAULT_IDLE_TIMEOUT;
+  ffmpegenc->idle_close_codec = DEFAULT_IDLE_CLOSE_CODEC;
+  ffmpegenc->async_depth = DEFAULT_ASYNC_DEPTH;
+  ffmpegenc->convert = DEFAULT_CONVERT;
+  ffmpegenc->adaptive_speed = DEFAULT_ADAPTIVE_SPEED;
+  ffmpegenc->low_latency = DEFAULT_LOW_LATENCY;
+  ffmpegenc->max_threads = DEFAULT_MAX_THREADS;
+  ffmpegenc->thread_type = DEFAULT_THREAD_TYPE;
+  ffmpegenc->parallel_contexts = DEFAULT_PARALLEL_CONTEXTS;
+  g_mutex_init (&ffmpegenc->parallel_lock);
+  g_cond_init (&ffmpegenc->parallel_cond);
+  g_queue_init (&ffmpegenc->parallel_jobs);
+  g_queue_init (&ffmpegenc->stats_window);
+  gst_ffmpegvidenc_stats_reset (ffmpegenc);
+  ffmpegenc->buffer_info_list =
+      gst_ffmpeg_free_list_new (G_OBJECT_TYPE_NAME (ffmpegenc),
+      sizeof (BufferInfo), NULL);
+  ffmpegenc->packet_list =
+      gst_ffmpeg_free_list_new (G_OBJECT_TYPE_NAME (ffmpegenc),
+      sizeof (AVPacket), NULL);
 }
 
 static void
@@ -226,10 +446,131 @@ gst_ffmpegvidenc_finalize (GObject * object)
   gst_ffmpeg_avcodec_close (ffmpegenc->refcontext);
   av_free (ffmpegenc->context);
   av_free (ffmpegenc->refcontext);
+  g_free (ffmpegenc->multipass_id);
+  g_mutex_clear (&ffmpegenc->parallel_lock);
+  g_cond_clear (&ffmpegenc->parallel_cond);
+  gst_ffmpegvidenc_stats_reset (ffmpegenc);
+
+  /* output buffers still in use keep the lists alive */
+  gst_ffmpeg_free_list_unref (ffmpegenc->buffer_info_list);
+  gst_ffmpeg_free_list_unref (ffmpegenc->packet_list);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
+static gboolean
+gst_ffmpegvidenc_upstream_is_live (GstFFMpegVidEnc * ffmpegenc)
+{
+  GstQuery *query;
+  gboolean is_live = FALSE;
+
+  query = gst_query_new_latency ();
+  if (gst_pad_peer_query (GST_VIDEO_ENCODER_SINK_PAD (ffmpegenc), query))
+    gst_query_parse_latency (query, &is_live, NULL, NULL);
+  gst_query_unref (query);
+
+  return is_live;
+}
+
+/* same policy as the decoders, frame threads are only used when upstream is
+ * not live */
+static void
+gst_ffmpegvidenc_set_threading (GstFFMpegVidEnc * ffmpegenc,
+    GstVideoInfo * info)
+{
+  GstFFMpegVidEncClass *oclass =
+      (GstFFMpegVidEncClass *) G_OBJECT_GET_CLASS (ffmpegenc);
+  AVCodecContext *context = ffmpegenc->context;
+  int caps = oclass->in_plugin->capabilities;
+  gint mb_rows;
+
+  if (!(caps & (AV_CODEC_CAP_FRAME_THREADS | AV_CODEC_CAP_SLICE_THREADS)))
+    return;
+
+  if (ffmpegenc->thread_type) {
+    GST_DEBUG_OBJECT (ffmpegenc, "Use requested thread type 0x%x",
+        ffmpegenc->thread_type);
+    context->thread_type = ffmpegenc->thread_type;
+  } else {
+    /* Check if upstream is live. If it isn't we can enable frame based
+     * threading, which is adding latency */
+    if (gst_ffmpegvidenc_upstream_is_live (ffmpegenc)
+        || ffmpegenc->low_latency
+        || !(caps & AV_CODEC_CAP_FRAME_THREADS))
+      context->thread_type = FF_THREAD_SLICE;
+    else
+      context->thread_type = FF_THREAD_SLICE | FF_THREAD_FRAME;
+  }
+
+  if (ffmpegenc->max_threads > 0) {
+    context->thread_count = ffmpegenc->max_threads;
+  } else if (context->thread_count != 1) {
+    /* set with the generic threads option, keep it */
+  } else if ((caps & AV_CODEC_CAP_AUTO_THREADS)
+      && !(context->thread_type & FF_THREAD_FRAME)) {
+    context->thread_count = 0;
+  } else {
+    /* frame threads add one frame of latency each, slice threads split the
+     * picture in slices of macroblock rows, more of them than a couple of
+     * rows each only cost bits */
+    context->thread_count = MIN (gst_ffmpeg_auto_max_threads (), 16);
+    if (!(context->thread_type & FF_THREAD_FRAME)
+        || !(caps & AV_CODEC_CAP_FRAME_THREADS)) {
+      mb_rows = (GST_VIDEO_INFO_HEIGHT (info) + 15) / 16;
+      context->thread_count = CLAMP (mb_rows / 2, 1, context->thread_count);
+    }
+  }
+
+  GST_DEBUG_OBJECT (ffmpegenc, "thread type 0x%x, %d threads",
+      context->thread_type, context->thread_count);
+}
+
+static void
+gst_ffmpegvidenc_set_low_latency (GstFFMpegVidEnc * ffmpegenc)
+{
+  GstFFMpegVidEncClass *oclass =
+      (GstFFMpegVidEncClass *) G_OBJECT_GET_CLASS (ffmpegenc);
+  AVCodecContext *context = ffmpegenc->context;
+  gint i;
+
+  context->thread_type = FF_THREAD_SLICE;
+  context->max_b_frames = 0;
+
+  for (i = 0; gst_ffmpeg_lookahead_opts[i]; i++)
+    av_opt_set_int (context, gst_ffmpeg_lookahead_opts[i], 0,
+        AV_OPT_SEARCH_CHILDREN);
+
+  /* the MPEG video encoders refuse the flag for anything but MPEG-2 */
+  if (oclass->in_plugin->id == AV_CODEC_ID_MPEG2VIDEO)
+    context->flags |= AV_CODEC_FLAG_LOW_DELAY;
+}
+
+/* publishes how many frames the opened codec, its frame threads and the
+ * codec thread hold back before the packet of a frame comes out */
+static void
+gst_ffmpegvidenc_update_latency (GstFFMpegVidEnc * ffmpegenc)
+{
+  AVCodecContext *context = ffmpegenc->context;
+  GstVideoInfo *info = &ffmpegenc->input_state->info;
+  GstClockTime latency = 0;
+  guint frames;
+
+  frames = gst_ffmpeg_encoder_get_delay (context);
+
+  if (ffmpegenc->codec_thread)
+    frames += ffmpegenc->async_depth;
+
+  if (GST_VIDEO_INFO_FPS_N (info) > 0)
+    latency = gst_util_uint64_scale_ceil (frames * GST_SECOND,
+        GST_VIDEO_INFO_FPS_D (info), GST_VIDEO_INFO_FPS_N (info));
+
+  GST_DEBUG_OBJECT (ffmpegenc, "latency of %u frames, %" GST_TIME_FORMAT,
+      frames, GST_TIME_ARGS (latency));
+
+  gst_video_encoder_set_latency (GST_VIDEO_ENCODER (ffmpegenc), latency,
+      latency);
+}
+
 static gboolean
 gst_ffmpegvidenc_set_format (GstVideoEncoder * encoder,
     GstVideoCodecState * state)
@@ -243,6 +584,22 @@ gst_ffmpegvidenc_set_format (GstVideoEncoder * encoder,
   GstFFMpegVidEncClass *oclass =
       (GstFFMpegVidEncClass *) G_OBJECT_GET_CLASS (ffmpegenc);
 
+  /* frames still queued belong to the previous session */
+  if (ffmpegenc->codec_thread) {
+    GstFlowReturn flow_ret;
+
+    flow_ret = gst_ffmpeg_codec_thread_wait (ffmpegenc->codec_thread);
+    if (flow_ret < GST_FLOW_EOS) {
+      GST_WARNING_OBJECT (ffmpegenc, "queued frames failed: %s",
+          gst_flow_get_name (flow_ret));
+      return FALSE;
+    }
+  }
+  if (ffmpegenc->parallel_pool) {
+    gst_ffmpegvidenc_parallel_drain (ffmpegenc, TRUE);
+    gst_ffmpegvidenc_parallel_stop (ffmpegenc);
+  }
+
   /* close old session */
   if (ffmpegenc->opened) {
     gst_ffmpeg_avcodec_close (ffmpegenc->context);
@@ -254,9 +611,19 @@ gst_ffmpegvidenc_set_format (GstVideoEncoder * encoder,
     }
   }
 
+  if (ffmpegenc->converter) {
+    gst_ffmpeg_video_converter_free (ffmpegenc->converter);
+    ffmpegenc->converter = NULL;
+  }
+
   /* additional avcodec settings */
   gst_ffmpeg_cfg_fill_context (G_OBJECT (ffmpegenc), ffmpegenc->context);
 
+  gst_ffmpegvidenc_set_threading (ffmpegenc, &state->info);
+
+  if (ffmpegenc->low_latency)
+    gst_ffmpegvidenc_set_low_latency (ffmpegenc);
+
   if (GST_VIDEO_INFO_IS_INTERLACED (&state->info))
     ffmpegenc->context->flags |=
         AV_CODEC_FLAG_INTERLACED_DCT | AV_CODEC_FLAG_INTERLACED_ME;
@@ -270,6 +637,13 @@ gst_ffmpegvidenc_set_format (GstVideoEncoder * encoder,
           = ffmpegenc->picture->quality = FF_QP2LAMBDA * ffmpegenc->quantizer;
       break;
     case AV_CODEC_FLAG_PASS1:  /* need to prepare a stats file */
+      if (ffmpegenc->multipass_id) {
+        /* a new session only when starting */
+        if (!ffmpegenc->multipass_begun)
+          gst_ffmpeg_multipass_stats_begin (ffmpegenc->multipass_id);
+        ffmpegenc->multipass_begun = TRUE;
+        break;
+      }
       /* we don't close when changing caps, fingers crossed */
       if (!ffmpegenc->file)
         ffmpegenc->file = g_fopen (ffmpegenc->filename, "w");
@@ -280,6 +654,14 @@ gst_ffmpegvidenc_set_format (GstVideoEncoder * encoder,
     {                           /* need to read the whole stats file ! */
       gsize size;
 
+      if (ffmpegenc->multipass_id) {
+        ffmpegenc->context->stats_in =
+            gst_ffmpeg_multipass_stats_get (ffmpegenc->multipass_id);
+        if (!ffmpegenc->context->stats_in)
+          goto stats_missing_err;
+        break;
+      }
+
       if (!g_file_get_contents (ffmpegenc->filename,
               &ffmpegenc->context->stats_in, &size, NULL))
         goto file_read_err;
@@ -294,6 +676,30 @@ gst_ffmpegvidenc_set_format (GstVideoEncoder * encoder,
   /* fetch pix_fmt, fps, par, width, height... */
   gst_ffmpeg_videoinfo_to_context (&state->info, ffmpegenc->context);
 
+  /* convert formats the codec doesn't take to the closest one it does */
+  if (ffmpegenc->context->pix_fmt == AV_PIX_FMT_NONE && ffmpegenc->convert
+      && oclass->in_plugin->pix_fmts) {
+    GstVideoFormat format = GST_VIDEO_INFO_FORMAT (&state->info);
+    enum AVPixelFormat in_fmt = gst_ffmpeg_videoformat_to_pixfmt (format);
+
+    ffmpegenc->context->pix_fmt =
+        avcodec_find_best_pix_fmt_of_list (oclass->in_plugin->pix_fmts,
+        in_fmt, GST_VIDEO_INFO_HAS_ALPHA (&state->info), NULL);
+    ffmpegenc->converter = gst_ffmpeg_video_converter_new (in_fmt,
+        ffmpegenc->context->pix_fmt, GST_VIDEO_INFO_WIDTH (&state->info),
+        GST_VIDEO_INFO_HEIGHT (&state->info));
+    if (!ffmpegenc->converter)
+      goto bad_input_fmt;
+
+    /* swscale goes from RGB to limited range BT.601 */
+    if ((av_pix_fmt_desc_get (in_fmt)->flags & AV_PIX_FMT_FLAG_RGB)
+        && !(av_pix_fmt_desc_get (ffmpegenc->context->pix_fmt)->flags &
+            AV_PIX_FMT_FLAG_RGB)) {
+      ffmpegenc->context->colorspace = AVCOL_SPC_SMPTE170M;
+      ffmpegenc->context->color_range = AVCOL_RANGE_MPEG;
+    }
+  }
+
   /* sanitize time base */
   if (ffmpegenc->context->time_base.num <= 0
       || ffmpegenc->context->time_base.den <= 0)
@@ -329,6 +735,9 @@ gst_ffmpegvidenc_set_format (GstVideoEncoder * encoder,
   gst_ffmpeg_caps_with_codecid (oclass->in_plugin->id,
       oclass->in_plugin->type, allowed_caps, ffmpegenc->context);
 
+  /* keep the speed we adapted to across reopening */
+  gst_ffmpegvidenc_init_speed (ffmpegenc);
+
   /* open codec */
   if (gst_ffmpeg_avcodec_open (ffmpegenc->context, oclass->in_plugin) < 0) {
     gst_caps_unref (allowed_caps);
@@ -397,8 +806,15 @@ gst_ffmpegvidenc_set_format (GstVideoEncoder * encoder,
     gst_tag_list_unref (tags);
   }
 
+  gst_ffmpegvidenc_update_latency (ffmpegenc);
+
   /* success! */
   ffmpegenc->opened = TRUE;
+  ffmpegenc->rc_reopen = FALSE;
+  ffmpegenc->frames_in_gop = 0;
+  ffmpegenc->min_delay = GST_CLOCK_STIME_NONE;
+
+  gst_ffmpegvidenc_parallel_start (ffmpegenc);
 
   return TRUE;
 
@@ -417,6 +833,13 @@ file_read_err:
         GST_ERROR_SYSTEM);
     return FALSE;
   }
+stats_missing_err:
+  {
+    GST_ELEMENT_ERROR (ffmpegenc, RESOURCE, NOT_FOUND,
+        (("No complete first pass statistics with id \"%s\"."),
+            ffmpegenc->multipass_id), (NULL));
+    return FALSE;
+  }
 
 insane_timebase:
   {
@@ -470,25 +893,106 @@ static gboolean
 gst_ffmpegvidenc_propose_allocation (GstVideoEncoder * encoder,
     GstQuery * query)
 {
+  GstFFMpegVidEnc *ffmpegenc = (GstFFMpegVidEnc *) encoder;
+  GstAllocationParams params = DEFAULT_ALLOC_PARAM;
+  GstVideoAlignment align;
+  GstBufferPool *pool;
+  GstStructure *config;
+  GstVideoInfo info;
+  GstCaps *caps;
+  gboolean need_pool;
+  gint width, height;
+  gint linesize_align[AV_NUM_DATA_POINTERS];
+  gsize max_align;
+  guint size;
+  gint i;
+
   gst_query_add_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL);
 
+  /* converted input is never read in place */
+  gst_query_parse_allocation (query, &caps, &need_pool);
+  if (!ffmpegenc->opened || ffmpegenc->converter || !caps
+      || !gst_video_info_from_caps (&info, caps))
+    goto done;
+
+  width = GST_VIDEO_INFO_WIDTH (&info);
+  height = GST_VIDEO_INFO_HEIGHT (&info);
+
+  /* the padding and stride alignment the codec reads frames with without
+   * copying them first */
+  avcodec_align_dimensions2 (ffmpegenc->context, &width, &height,
+      linesize_align);
+
+  gst_video_alignment_reset (&align);
+  align.padding_right = width - GST_VIDEO_INFO_WIDTH (&info);
+  align.padding_bottom = height - GST_VIDEO_INFO_HEIGHT (&info);
+
+  max_align = DEFAULT_STRIDE_ALIGN;
+  for (i = 0; i < GST_VIDEO_MAX_PLANES; i++) {
+    if (linesize_align[i] > 0)
+      max_align |= linesize_align[i] - 1;
+  }
+
+  for (i = 0; i < GST_VIDEO_MAX_PLANES; i++)
+    align.stride_align[i] = max_align;
+
+  params.align = max_align;
+
+  GST_DEBUG_OBJECT (ffmpegenc, "proposing aligned dimension %dx%d -> %dx%d, "
+      "stride_align %" G_GSIZE_FORMAT, GST_VIDEO_INFO_WIDTH (&info),
+      GST_VIDEO_INFO_HEIGHT (&info), width, height, max_align);
+
+  if (need_pool) {
+    pool = gst_video_buffer_pool_new ();
+
+    config = gst_buffer_pool_get_config (pool);
+    gst_buffer_pool_config_set_params (config, caps,
+        GST_VIDEO_INFO_SIZE (&info), 0, 0);
+    gst_buffer_pool_config_set_allocator (config, NULL, &params);
+    gst_buffer_pool_config_add_option (config,
+        GST_BUFFER_POOL_OPTION_VIDEO_META);
+    gst_buffer_pool_config_add_option (config,
+        GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT);
+    gst_buffer_pool_config_set_video_alignment (config, &align);
+
+    if (gst_buffer_pool_set_config (pool, config)) {
+      /* the pool grew the size for the padding */
+      config = gst_buffer_pool_get_config (pool);
+      gst_buffer_pool_config_get_params (config, NULL, &size, NULL, NULL);
+      gst_structure_free (config);
+
+      gst_query_add_allocation_pool (query, pool, size, 0, 0);
+    } else {
+      GST_WARNING_OBJECT (ffmpegenc, "aligned pool configuration rejected");
+    }
+    gst_object_unref (pool);
+  }
+
+  gst_query_add_allocation_param (query, NULL, &params);
+
+done:
   return GST_VIDEO_ENCODER_CLASS (parent_class)->propose_allocation (encoder,
       query);
 }
 
+static GstCaps *
+gst_ffmpegvidenc_getcaps (GstVideoEncoder * encoder, GstCaps * filter)
+{
+  GstFFMpegVidEnc *ffmpegenc = (GstFFMpegVidEnc *) encoder;
+  GstFFMpegVidEncClass *oclass =
+      (GstFFMpegVidEncClass *) G_OBJECT_GET_CLASS (ffmpegenc);
+
+  return gst_video_encoder_proxy_getcaps (encoder,
+      ffmpegenc->convert ? NULL : oclass->native_caps, filter);
+}
+
 static void
 gst_ffmpegvidenc_free_avpacket (gpointer pkt)
 {
   av_packet_unref ((AVPacket *) pkt);
-  g_slice_free (AVPacket, pkt);
+  gst_ffmpeg_free_list_release (pkt);
 }
 
-typedef struct
-{
-  GstBuffer *buffer;
-  GstVideoFrame vframe;
-} BufferInfo;
-
 static void
 buffer_info_free (void *opaque, guint8 * data)
 {
@@ -496,7 +1000,7 @@ buffer_info_free (void *opaque, guint8 * data)
 
   gst_video_frame_unmap (&info->vframe);
   gst_buffer_unref (info->buffer);
-  g_slice_free (BufferInfo, info);
+  gst_ffmpeg_free_list_release (info);
 }
 
 static enum AVStereo3DType
@@ -546,21 +1050,15 @@ gst_ffmpegvidenc_add_cc (GstBuffer * buffer, AVFrame * picture)
   }
 }
 
-static GstFlowReturn
-gst_ffmpegvidenc_send_frame (GstFFMpegVidEnc * ffmpegenc,
-    GstVideoCodecFrame * frame)
+/* sets up @picture with the content of @frame for @context, which is the
+ * main context or one of the parallel ones */
+static gboolean
+gst_ffmpegvidenc_fill_picture (GstFFMpegVidEnc * ffmpegenc,
+    AVCodecContext * context, GstVideoCodecFrame * frame, AVFrame * picture)
 {
   GstVideoInfo *info = &ffmpegenc->input_state->info;
   BufferInfo *buffer_info;
   guint c;
-  gint res;
-  GstFlowReturn ret = GST_FLOW_ERROR;
-  AVFrame *picture = NULL;
-
-  if (!frame)
-    goto send_frame;
-
-  picture = ffmpegenc->picture;
 
   gst_ffmpegvidenc_add_cc (frame->input_buffer, picture);
 
@@ -587,42 +1085,194 @@ gst_ffmpegvidenc_send_frame (GstFFMpegVidEnc * ffmpegenc,
   if (GST_VIDEO_CODEC_FRAME_IS_FORCE_KEYFRAME (frame))
     picture->pict_type = AV_PICTURE_TYPE_I;
 
-  buffer_info = g_slice_new0 (BufferInfo);
-  buffer_info->buffer = gst_buffer_ref (frame->input_buffer);
+  /* constant quantizer encoding takes the quality of each frame */
+  if (ffmpegenc->pass == AV_CODEC_FLAG_QSCALE)
+    picture->quality = context->global_quality;
 
-  if (!gst_video_frame_map (&buffer_info->vframe, info, frame->input_buffer,
-          GST_MAP_READ)) {
-    GST_ERROR_OBJECT (ffmpegenc, "Failed to map input buffer");
-    gst_buffer_unref (buffer_info->buffer);
-    g_slice_free (BufferInfo, buffer_info);
-    gst_video_codec_frame_unref (frame);
-    goto done;
+  if (ffmpegenc->converter) {
+    const uint8_t *src_data[4] = { NULL, };
+    int src_linesizes[4] = { 0, };
+    GstVideoFrame vframe;
+    gboolean converted;
+
+    if (!gst_video_frame_map (&vframe, info, frame->input_buffer,
+            GST_MAP_READ)) {
+      GST_ERROR_OBJECT (ffmpegenc, "Failed to map input buffer");
+      av_frame_unref (picture);
+      return FALSE;
+    }
+
+    /* the codec gets its own copy in the format it takes */
+    for (c = 0; c < GST_VIDEO_FRAME_N_PLANES (&vframe); c++) {
+      src_data[c] = GST_VIDEO_FRAME_PLANE_DATA (&vframe, c);
+      src_linesizes[c] = GST_VIDEO_FRAME_PLANE_STRIDE (&vframe, c);
+    }
+    converted = gst_ffmpeg_video_converter_convert (ffmpegenc->converter,
+        src_data, src_linesizes, picture);
+    gst_video_frame_unmap (&vframe);
+
+    if (!converted) {
+      GST_ERROR_OBJECT (ffmpegenc, "Failed to convert input buffer");
+      av_frame_unref (picture);
+      return FALSE;
+    }
+  } else {
+    buffer_info = gst_ffmpeg_free_list_alloc (ffmpegenc->buffer_info_list);
+    buffer_info->buffer = gst_buffer_ref (frame->input_buffer);
+
+    if (!gst_video_frame_map (&buffer_info->vframe, info,
+            frame->input_buffer, GST_MAP_READ)) {
+      GST_ERROR_OBJECT (ffmpegenc, "Failed to map input buffer");
+      gst_buffer_unref (buffer_info->buffer);
+      gst_ffmpeg_free_list_release (buffer_info);
+      av_frame_unref (picture);
+      return FALSE;
+    }
+
+    /* Fill avpicture */
+    picture->buf[0] =
+        av_buffer_create (NULL, 0, buffer_info_free, buffer_info, 0);
+    for (c = 0; c < AV_NUM_DATA_POINTERS; c++) {
+      if (c < GST_VIDEO_INFO_N_COMPONENTS (info)) {
+        picture->data[c] =
+            GST_VIDEO_FRAME_PLANE_DATA (&buffer_info->vframe, c);
+        picture->linesize[c] =
+            GST_VIDEO_FRAME_COMP_STRIDE (&buffer_info->vframe, c);
+      } else {
+        picture->data[c] = NULL;
+        picture->linesize[c] = 0;
+      }
+    }
+
+    picture->format = context->pix_fmt;
+    picture->width = GST_VIDEO_FRAME_WIDTH (&buffer_info->vframe);
+    picture->height = GST_VIDEO_FRAME_HEIGHT (&buffer_info->vframe);
   }
 
-  /* Fill avpicture */
-  picture->buf[0] =
-      av_buffer_create (NULL, 0, buffer_info_free, buffer_info, 0);
-  for (c = 0; c < AV_NUM_DATA_POINTERS; c++) {
-    if (c < GST_VIDEO_INFO_N_COMPONENTS (info)) {
-      picture->data[c] = GST_VIDEO_FRAME_PLANE_DATA (&buffer_info->vframe, c);
-      picture->linesize[c] =
-          GST_VIDEO_FRAME_COMP_STRIDE (&buffer_info->vframe, c);
-    } else {
-      picture->data[c] = NULL;
-      picture->linesize[c] = 0;
+  picture->pts =
+      gst_ffmpeg_time_gst_to_ff (frame->pts / context->ticks_per_frame,
+      context->time_base);
+
+  return TRUE;
+}
+
+/* output statistics, see the stats property */
+typedef struct
+{
+  GstClockTime time;
+  gsize size;
+} GstFFMpegVidEncStatsEntry;
+
+static void
+gst_ffmpegvidenc_stats_reset (GstFFMpegVidEnc * ffmpegenc)
+{
+  GstFFMpegVidEncStatsEntry *entry;
+
+  GST_OBJECT_LOCK (ffmpegenc);
+  while ((entry = g_queue_pop_head (&ffmpegenc->stats_window)))
+    g_slice_free (GstFFMpegVidEncStatsEntry, entry);
+  ffmpegenc->stats_window_bytes = 0;
+  ffmpegenc->stats_frames = 0;
+  ffmpegenc->stats_last_keyframe = G_MAXUINT64;
+  ffmpegenc->stats_keyframe_interval = 0;
+  ffmpegenc->stats_encode_time = GST_CLOCK_TIME_NONE;
+  GST_OBJECT_UNLOCK (ffmpegenc);
+}
+
+static void
+gst_ffmpegvidenc_stats_add_packet (GstFFMpegVidEnc * ffmpegenc,
+    GstClockTime time, gsize size, gboolean keyframe)
+{
+  GstFFMpegVidEncStatsEntry *entry;
+
+  GST_OBJECT_LOCK (ffmpegenc);
+  if (keyframe) {
+    if (ffmpegenc->stats_last_keyframe != G_MAXUINT64)
+      ffmpegenc->stats_keyframe_interval =
+          ffmpegenc->stats_frames - ffmpegenc->stats_last_keyframe;
+    ffmpegenc->stats_last_keyframe = ffmpegenc->stats_frames;
+  }
+  ffmpegenc->stats_frames++;
+
+  if (GST_CLOCK_TIME_IS_VALID (time)) {
+    entry = g_slice_new (GstFFMpegVidEncStatsEntry);
+    entry->time = time;
+    entry->size = size;
+    g_queue_push_tail (&ffmpegenc->stats_window, entry);
+    ffmpegenc->stats_window_bytes += size;
+
+    while ((entry = g_queue_peek_head (&ffmpegenc->stats_window))
+        && entry->time + STATS_WINDOW <= time) {
+      g_queue_pop_head (&ffmpegenc->stats_window);
+      ffmpegenc->stats_window_bytes -= entry->size;
+      g_slice_free (GstFFMpegVidEncStatsEntry, entry);
     }
   }
+  GST_OBJECT_UNLOCK (ffmpegenc);
+}
 
-  picture->format = ffmpegenc->context->pix_fmt;
-  picture->width = GST_VIDEO_FRAME_WIDTH (&buffer_info->vframe);
-  picture->height = GST_VIDEO_FRAME_HEIGHT (&buffer_info->vframe);
+static void
+gst_ffmpegvidenc_stats_add_encode_time (GstFFMpegVidEnc * ffmpegenc,
+    GstClockTime time)
+{
+  GST_OBJECT_LOCK (ffmpegenc);
+  if (GST_CLOCK_TIME_IS_VALID (ffmpegenc->stats_encode_time))
+    ffmpegenc->stats_encode_time =
+        (15 * ffmpegenc->stats_encode_time + time) / 16;
+  else
+    ffmpegenc->stats_encode_time = time;
+  GST_OBJECT_UNLOCK (ffmpegenc);
+}
 
-  picture->pts =
-      gst_ffmpeg_time_gst_to_ff (frame->pts /
-      ffmpegenc->context->ticks_per_frame, ffmpegenc->context->time_base);
+/* called with the object lock */
+static GstStructure *
+gst_ffmpegvidenc_stats_get (GstFFMpegVidEnc * ffmpegenc)
+{
+  GstFFMpegVidEncStatsEntry *first, *last;
+  guint n = g_queue_get_length (&ffmpegenc->stats_window);
+  guint64 bitrate = 0;
+
+  /* the span of the window, with the duration of the last packet */
+  if (n >= 2) {
+    GstClockTime span;
+
+    first = g_queue_peek_head (&ffmpegenc->stats_window);
+    last = g_queue_peek_tail (&ffmpegenc->stats_window);
+    span = last->time - first->time;
+    span += span / (n - 1);
+    if (span > 0)
+      bitrate = gst_util_uint64_scale (ffmpegenc->stats_window_bytes * 8,
+          GST_SECOND, span);
+  }
+
+  return gst_structure_new ("avenc-stats",
+      "frames", G_TYPE_UINT64, ffmpegenc->stats_frames,
+      "bitrate", G_TYPE_UINT64, bitrate,
+      "keyframe-interval", G_TYPE_UINT, ffmpegenc->stats_keyframe_interval,
+      "encode-time", G_TYPE_UINT64,
+      GST_CLOCK_TIME_IS_VALID (ffmpegenc->stats_encode_time) ?
+      ffmpegenc->stats_encode_time : (guint64) 0, NULL);
+}
+
+static GstFlowReturn
+gst_ffmpegvidenc_send_frame (GstFFMpegVidEnc * ffmpegenc,
+    GstVideoCodecFrame * frame)
+{
+  gint res;
+  GstFlowReturn ret = GST_FLOW_ERROR;
+  AVFrame *picture = NULL;
+  GstClockTime start;
 
-send_frame:
+  if (frame) {
+    picture = ffmpegenc->picture;
+    if (!gst_ffmpegvidenc_fill_picture (ffmpegenc, ffmpegenc->context, frame,
+            picture))
+      goto done;
+  }
+
+  start = gst_util_get_timestamp ();
   res = avcodec_send_frame (ffmpegenc->context, picture);
+  ffmpegenc->codec_time += gst_util_get_timestamp () - start;
 
   if (picture)
     av_frame_unref (picture);
@@ -636,37 +1286,60 @@ done:
   return ret;
 }
 
+static GstFlowReturn gst_ffmpegvidenc_handle_packet (GstFFMpegVidEnc *
+    ffmpegenc, AVPacket * pkt, gboolean send);
+
 static GstFlowReturn
 gst_ffmpegvidenc_receive_packet (GstFFMpegVidEnc * ffmpegenc,
     gboolean * got_packet, gboolean send)
 {
   AVPacket *pkt;
-  GstBuffer *outbuf;
-  GstVideoCodecFrame *frame;
   gint res;
   GstFlowReturn ret = GST_FLOW_OK;
+  GstClockTime start;
 
   *got_packet = FALSE;
 
-  pkt = g_slice_new0 (AVPacket);
+  pkt = gst_ffmpeg_free_list_alloc (ffmpegenc->packet_list);
 
+  start = gst_util_get_timestamp ();
   res = avcodec_receive_packet (ffmpegenc->context, pkt);
+  ffmpegenc->codec_time += gst_util_get_timestamp () - start;
 
   if (res == AVERROR (EAGAIN)) {
-    g_slice_free (AVPacket, pkt);
+    gst_ffmpeg_free_list_release (pkt);
     goto done;
   } else if (res == AVERROR_EOF) {
+    gst_ffmpeg_free_list_release (pkt);
     ret = GST_FLOW_EOS;
     goto done;
   } else if (res < 0) {
+    gst_ffmpeg_free_list_release (pkt);
     ret = GST_FLOW_ERROR;
     goto done;
   }
 
   *got_packet = TRUE;
 
+  ret = gst_ffmpegvidenc_handle_packet (ffmpegenc, pkt, send);
+
+done:
+  return ret;
+}
+
+/* outputs @pkt for the oldest pending frame, takes ownership of it */
+static GstFlowReturn
+gst_ffmpegvidenc_handle_packet (GstFFMpegVidEnc * ffmpegenc, AVPacket * pkt,
+    gboolean send)
+{
+  GstBuffer *outbuf;
+  GstVideoCodecFrame *frame;
+
   /* save stats info if there is some as well as a stats file */
-  if (ffmpegenc->file && ffmpegenc->context->stats_out)
+  if (ffmpegenc->multipass_begun && ffmpegenc->context->stats_out)
+    gst_ffmpeg_multipass_stats_append (ffmpegenc->multipass_id,
+        ffmpegenc->context->stats_out);
+  else if (ffmpegenc->file && ffmpegenc->context->stats_out)
     if (fprintf (ffmpegenc->file, "%s", ffmpegenc->context->stats_out) < 0)
       GST_ELEMENT_ERROR (ffmpegenc, RESOURCE, WRITE,
           (("Could not write to file \"%s\"."), ffmpegenc->filename),
@@ -679,6 +1352,8 @@ gst_ffmpegvidenc_receive_packet (GstFFMpegVidEnc * ffmpegenc,
     outbuf =
         gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY, pkt->data,
         pkt->size, 0, pkt->size, pkt, gst_ffmpegvidenc_free_avpacket);
+    gst_buffer_add_ffmpeg_encoder_stats_meta (outbuf, pkt,
+        ffmpegenc->context);
     frame->output_buffer = outbuf;
 
     if (pkt->flags & AV_PKT_FLAG_KEY)
@@ -696,20 +1371,342 @@ gst_ffmpegvidenc_receive_packet (GstFFMpegVidEnc * ffmpegenc,
   frame->pts =
       gst_ffmpeg_time_ff_to_gst (pkt->pts, ffmpegenc->context->time_base);
 
-  ret = gst_video_encoder_finish_frame (GST_VIDEO_ENCODER (ffmpegenc), frame);
+  if (send)
+    gst_ffmpegvidenc_stats_add_packet (ffmpegenc,
+        GST_CLOCK_TIME_IS_VALID (frame->dts) ? frame->dts : frame->pts,
+        pkt->size, pkt->flags & AV_PKT_FLAG_KEY);
+  else
+    gst_ffmpegvidenc_free_avpacket (pkt);
+
+  return gst_video_encoder_finish_frame (GST_VIDEO_ENCODER (ffmpegenc), frame);
+}
+
+/* called with the stream lock when we have been idle for a while */
+static void
+gst_ffmpegvidenc_trim (GstFFMpegVidEnc * ffmpegenc)
+{
+  GstVideoEncoder *encoder = GST_VIDEO_ENCODER (ffmpegenc);
+  GstFFMpegVidEncClass *oclass =
+      (GstFFMpegVidEncClass *) G_OBJECT_GET_CLASS (ffmpegenc);
+  GList *frames;
+
+  GST_DEBUG_OBJECT (ffmpegenc, "idle, releasing resources");
+
+  ffmpegenc->idle = TRUE;
+
+  gst_ffmpeg_free_list_trim (ffmpegenc->buffer_info_list);
+  gst_ffmpeg_free_list_trim (ffmpegenc->packet_list);
+  if (ffmpegenc->converter)
+    gst_ffmpeg_video_converter_trim (ffmpegenc->converter);
+
+  if (!ffmpegenc->idle_close_codec || !ffmpegenc->opened
+      || !ffmpegenc->input_state)
+    return;
+
+  /* a new session would restart the statistics, parallel encoding is for
+   * offline use only */
+  if (ffmpegenc->pass == AV_CODEC_FLAG_PASS1
+      || ffmpegenc->pass == AV_CODEC_FLAG_PASS2 || ffmpegenc->parallel_pool)
+    return;
+
+  /* push out the frames the codec still holds. When not PLAYING this could
+   * block on preroll, only close the codec if it holds nothing then */
+  frames = gst_video_encoder_get_frames (encoder);
+  if (frames != NULL) {
+    g_list_free_full (frames, (GDestroyNotify) gst_video_codec_frame_unref);
+    if (GST_STATE (ffmpegenc) != GST_STATE_PLAYING) {
+      GST_DEBUG_OBJECT (ffmpegenc, "frames pending, keeping codec open");
+      return;
+    }
+    gst_ffmpegvidenc_flush_buffers (ffmpegenc, TRUE);
+  }
+
+  GST_DEBUG_OBJECT (ffmpegenc, "closing codec");
+  gst_ffmpeg_avcodec_close (ffmpegenc->context);
+  ffmpegenc->opened = FALSE;
+  if (avcodec_get_context_defaults3 (ffmpegenc->context,
+          oclass->in_plugin) < 0)
+    GST_DEBUG_OBJECT (ffmpegenc, "Failed to set context defaults");
+  ffmpegenc->idle_closed = TRUE;
+}
+
+static gboolean
+gst_ffmpegvidenc_resume (GstFFMpegVidEnc * ffmpegenc)
+{
+  GstVideoCodecState *state;
+  gboolean ret;
+
+  ffmpegenc->idle = FALSE;
+
+  if (!ffmpegenc->idle_closed)
+    return TRUE;
+
+  GST_DEBUG_OBJECT (ffmpegenc, "reopening codec after idle period");
+  ffmpegenc->idle_closed = FALSE;
+
+  /* set_format replaces input_state with the state we pass */
+  state = gst_video_codec_state_ref (ffmpegenc->input_state);
+  ret = gst_ffmpegvidenc_set_format (GST_VIDEO_ENCODER (ffmpegenc), state);
+  gst_video_codec_state_unref (state);
 
-done:
   return ret;
 }
 
+/* whether the codec would start a new GOP with @frame anyway */
+static gboolean
+gst_ffmpegvidenc_is_gop_start (GstFFMpegVidEnc * ffmpegenc,
+    GstVideoCodecFrame * frame)
+{
+  gint gop_size = ffmpegenc->context->gop_size;
+
+  return GST_VIDEO_CODEC_FRAME_IS_FORCE_KEYFRAME (frame)
+      || ffmpegenc->frames_in_gop == 0 || gop_size <= 1
+      || ffmpegenc->frames_in_gop >= gop_size;
+}
+
+/* called with the stream lock before encoding @frame. The codecs take the
+ * quality from each frame, the other rate control settings are only read
+ * when opening them, they are reopened where a new GOP would start */
+static gboolean
+gst_ffmpegvidenc_update_rate_control (GstFFMpegVidEnc * ffmpegenc,
+    GstVideoCodecFrame * frame)
+{
+  GstVideoCodecState *state;
+  gboolean ret;
+
+  GST_OBJECT_LOCK (ffmpegenc);
+  if (ffmpegenc->rc_changed) {
+    if (gst_ffmpeg_cfg_update_rate_control (ffmpegenc->refcontext,
+            ffmpegenc->context))
+      ffmpegenc->rc_reopen = TRUE;
+    if (ffmpegenc->pass == AV_CODEC_FLAG_QSCALE)
+      ffmpegenc->context->global_quality =
+          FF_QP2LAMBDA * ffmpegenc->quantizer;
+    ffmpegenc->rc_changed = FALSE;
+  }
+  GST_OBJECT_UNLOCK (ffmpegenc);
+
+  if (!ffmpegenc->rc_reopen || !gst_ffmpegvidenc_is_gop_start (ffmpegenc,
+          frame))
+    return TRUE;
+
+  /* a new session would restart the statistics */
+  if (ffmpegenc->pass == AV_CODEC_FLAG_PASS1
+      || ffmpegenc->pass == AV_CODEC_FLAG_PASS2) {
+    ffmpegenc->rc_reopen = FALSE;
+    return TRUE;
+  }
+
+  GST_DEBUG_OBJECT (ffmpegenc, "reopening codec with the new rate control");
+
+  /* push out what the previous session holds, our frame is not in the codec
+   * yet */
+  gst_ffmpegvidenc_flush_buffers (ffmpegenc, TRUE);
+
+  /* set_format replaces input_state with the state we pass */
+  state = gst_video_codec_state_ref (ffmpegenc->input_state);
+  ret = gst_ffmpegvidenc_set_format (GST_VIDEO_ENCODER (ffmpegenc), state);
+  gst_video_codec_state_unref (state);
+
+  return ret;
+}
+
+/* options set for adaptive-speed, for each level above 0 the value that is
+ * used if the configured one is slower, -1 keeps the configured one */
+static const struct
+{
+  const gchar *name;
+  /* 0 means no limit instead of the fastest setting */
+  gboolean zero_unlimited;
+  gint64 levels[GST_FFMPEGVIDENC_N_SPEED_LEVELS];
+} speed_settings[] = {
+  {"mbd", FALSE, {0, 0, 0}},
+  {"trellis", FALSE, {0, 0, 0}},
+  {"qns", FALSE, {0, 0, 0}},
+  {"subq", FALSE, {4, 2, 1}},
+  {"refs", FALSE, {2, 1, 1}},
+  {"me_range", TRUE, {32, 16, 8}},
+  {"motion_est", FALSE, {-1, -1, 0}},
+};
+
+G_STATIC_ASSERT (G_N_ELEMENTS (speed_settings) <=
+    GST_FFMPEGVIDENC_MAX_SPEED_OPTIONS);
+
+/* frames to wait after changing the speed before changing it again */
+#define SPEED_HOLD_FRAMES 25
+/* frames with headroom before going back to slower settings */
+#define SPEED_RECOVER_FRAMES 250
+
+/* sets the speed options for @level, codecs without some of them are fine */
+static void
+gst_ffmpegvidenc_set_speed_level (GstFFMpegVidEnc * ffmpegenc, guint level)
+{
+  gint64 value, target;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (speed_settings); i++) {
+    value = ffmpegenc->speed_options[i];
+    if (value == G_MININT64)
+      continue;
+
+    target = level > 0 ? speed_settings[i].levels[level - 1] : -1;
+    if (target >= 0 && (target < value || (value == 0
+                && speed_settings[i].zero_unlimited)))
+      value = target;
+
+    av_opt_set_int (ffmpegenc->context, speed_settings[i].name, value,
+        AV_OPT_SEARCH_CHILDREN);
+  }
+
+  ffmpegenc->speed_level = level;
+}
+
+/* remembers the configured speed options of the context and applies the
+ * current level, called before opening the codec */
+static void
+gst_ffmpegvidenc_init_speed (GstFFMpegVidEnc * ffmpegenc)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (speed_settings); i++) {
+    if (av_opt_get_int (ffmpegenc->context, speed_settings[i].name,
+            AV_OPT_SEARCH_CHILDREN, &ffmpegenc->speed_options[i]) < 0)
+      ffmpegenc->speed_options[i] = G_MININT64;
+  }
+
+  if (ffmpegenc->speed_level > 0)
+    gst_ffmpegvidenc_set_speed_level (ffmpegenc, ffmpegenc->speed_level);
+}
+
+/* called with the stream lock before encoding @frame, measures how late the
+ * frame arrives compared to the earliest it ever did. The part that doesn't
+ * change is upstream latency, growing lateness means the encoder doesn't
+ * keep up */
+static void
+gst_ffmpegvidenc_adapt_speed (GstFFMpegVidEnc * ffmpegenc,
+    GstVideoCodecFrame * frame)
+{
+  GstVideoEncoder *encoder = GST_VIDEO_ENCODER (ffmpegenc);
+  GstVideoInfo *info = &ffmpegenc->input_state->info;
+  GstClockTime running_time, now, duration;
+  GstClockTimeDiff delay, lateness;
+  GstClock *clock;
+  guint level;
+
+  if (GST_STATE (ffmpegenc) != GST_STATE_PLAYING)
+    return;
+
+  running_time = gst_segment_to_running_time (&encoder->input_segment,
+      GST_FORMAT_TIME, frame->pts);
+  if (!GST_CLOCK_TIME_IS_VALID (running_time))
+    return;
+
+  clock = gst_element_get_clock (GST_ELEMENT_CAST (ffmpegenc));
+  if (!clock)
+    return;
+  now = gst_clock_get_time (clock) -
+      gst_element_get_base_time (GST_ELEMENT_CAST (ffmpegenc));
+  gst_object_unref (clock);
+
+  delay = GST_CLOCK_DIFF (running_time, now);
+  if (!GST_CLOCK_STIME_IS_VALID (ffmpegenc->min_delay)
+      || delay < ffmpegenc->min_delay)
+    ffmpegenc->min_delay = delay;
+  lateness = delay - ffmpegenc->min_delay;
+
+  if (GST_CLOCK_TIME_IS_VALID (frame->duration))
+    duration = frame->duration;
+  else if (GST_VIDEO_INFO_FPS_N (info) > 0)
+    duration = gst_util_uint64_scale_int (GST_SECOND,
+        GST_VIDEO_INFO_FPS_D (info), GST_VIDEO_INFO_FPS_N (info));
+  else
+    duration = 40 * GST_MSECOND;
+
+  if (ffmpegenc->speed_hold > 0) {
+    ffmpegenc->speed_hold--;
+    return;
+  }
+
+  level = ffmpegenc->speed_level;
+  if (lateness > 2 * duration) {
+    ffmpegenc->speed_headroom = 0;
+    if (level < GST_FFMPEGVIDENC_N_SPEED_LEVELS)
+      level++;
+  } else if (lateness < duration / 2) {
+    if (level > 0 && ++ffmpegenc->speed_headroom >= SPEED_RECOVER_FRAMES) {
+      ffmpegenc->speed_headroom = 0;
+      level--;
+    }
+  } else {
+    ffmpegenc->speed_headroom = 0;
+  }
+
+  if (level == ffmpegenc->speed_level)
+    return;
+
+  GST_INFO_OBJECT (ffmpegenc, "lateness %" GST_STIME_FORMAT
+      ", changing speed level from %u to %u", GST_STIME_ARGS (lateness),
+      ffmpegenc->speed_level, level);
+
+  gst_ffmpegvidenc_set_speed_level (ffmpegenc, level);
+  ffmpegenc->speed_hold = SPEED_HOLD_FRAMES;
+
+  gst_element_post_message (GST_ELEMENT_CAST (ffmpegenc),
+      gst_message_new_element (GST_OBJECT_CAST (ffmpegenc),
+          gst_structure_new ("avenc-speed", "level", G_TYPE_UINT, level,
+              "lateness", G_TYPE_INT64, lateness, NULL)));
+}
+
+/* called from the thread of the idle watch */
+static void
+gst_ffmpegvidenc_idle_cb (GstElement * element)
+{
+  GstFFMpegVidEnc *ffmpegenc = (GstFFMpegVidEnc *) element;
+  GstVideoEncoder *encoder = GST_VIDEO_ENCODER (ffmpegenc);
+
+  /* data is flowing or the element is stopping, try again on the next
+   * tick */
+  if (!g_rec_mutex_trylock (&encoder->stream_lock))
+    return;
+
+  if (!ffmpegenc->idle &&
+      gst_util_get_timestamp () - ffmpegenc->last_input_time >=
+      ffmpegenc->idle_timeout)
+    gst_ffmpegvidenc_trim (ffmpegenc);
+
+  GST_VIDEO_ENCODER_STREAM_UNLOCK (encoder);
+}
+
+/* called from the streaming thread or the codec thread with the stream lock,
+ * takes ownership of frame */
 static GstFlowReturn
-gst_ffmpegvidenc_handle_frame (GstVideoEncoder * encoder,
+gst_ffmpegvidenc_encode_frame (GstFFMpegVidEnc * ffmpegenc,
     GstVideoCodecFrame * frame)
 {
-  GstFFMpegVidEnc *ffmpegenc = (GstFFMpegVidEnc *) encoder;
+  GstVideoEncoder *encoder = GST_VIDEO_ENCODER (ffmpegenc);
   GstFlowReturn ret;
   gboolean got_packet;
 
+  ffmpegenc->last_input_time = gst_util_get_timestamp ();
+  if (G_UNLIKELY (ffmpegenc->idle) && !gst_ffmpegvidenc_resume (ffmpegenc)) {
+    gst_video_codec_frame_unref (frame);
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  if (G_UNLIKELY (ffmpegenc->rc_changed || ffmpegenc->rc_reopen)
+      && !gst_ffmpegvidenc_update_rate_control (ffmpegenc, frame)) {
+    gst_video_codec_frame_unref (frame);
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  if (ffmpegenc->adaptive_speed)
+    gst_ffmpegvidenc_adapt_speed (ffmpegenc, frame);
+
+  if (gst_ffmpegvidenc_is_gop_start (ffmpegenc, frame))
+    ffmpegenc->frames_in_gop = 0;
+  ffmpegenc->frames_in_gop++;
+
+  ffmpegenc->codec_time = 0;
   ret = gst_ffmpegvidenc_send_frame (ffmpegenc, frame);
 
   if (ret != GST_FLOW_OK)
@@ -723,6 +1720,8 @@ gst_ffmpegvidenc_handle_frame (GstVideoEncoder * encoder,
       break;
   } while (got_packet);
 
+  gst_ffmpegvidenc_stats_add_encode_time (ffmpegenc, ffmpegenc->codec_time);
+
 done:
   return ret;
 
@@ -741,18 +1740,417 @@ encode_fail:
   }
 }
 
+/* Parallel encoding: the input is cut in chunks of a GOP, or of a single
+ * frame for intra-only codecs, which are encoded as closed GOPs on their own
+ * contexts by the thread pool. The streaming thread outputs the packets of
+ * the finished chunks in input order */
+typedef struct
+{
+  GQueue frames;
+  GQueue packets;
+  gboolean failed;
+  gboolean done;
+} GstFFMpegVidEncChunk;
+
+static void
+gst_ffmpegvidenc_chunk_free (GstFFMpegVidEncChunk * chunk)
+{
+  GstVideoCodecFrame *frame;
+  AVPacket *pkt;
+
+  while ((frame = g_queue_pop_head (&chunk->frames)))
+    gst_video_codec_frame_unref (frame);
+  while ((pkt = g_queue_pop_head (&chunk->packets)))
+    gst_ffmpegvidenc_free_avpacket (pkt);
+  g_slice_free (GstFFMpegVidEncChunk, chunk);
+}
+
+/* a context set up like the main one. Encoders buffering frames are drained
+ * after every chunk and need a new one for the next */
+static AVCodecContext *
+gst_ffmpegvidenc_parallel_context_new (GstFFMpegVidEnc * ffmpegenc)
+{
+  GstFFMpegVidEncClass *oclass =
+      (GstFFMpegVidEncClass *) G_OBJECT_GET_CLASS (ffmpegenc);
+  AVCodecContext *main_context = ffmpegenc->context;
+  AVCodecContext *context;
+  AVCodecParameters *par;
+
+  context = avcodec_alloc_context3 (oclass->in_plugin);
+  par = avcodec_parameters_alloc ();
+  if (!context || !par)
+    goto failed;
+
+  GST_OBJECT_LOCK (ffmpegenc);
+  gst_ffmpeg_cfg_fill_context (G_OBJECT (ffmpegenc), context);
+  GST_OBJECT_UNLOCK (ffmpegenc);
+
+  if (avcodec_parameters_from_context (par, main_context) < 0
+      || avcodec_parameters_to_context (context, par) < 0)
+    goto failed;
+
+  /* the encoder makes its own */
+  av_freep (&context->extradata);
+  context->extradata_size = 0;
+
+  context->time_base = main_context->time_base;
+  context->ticks_per_frame = main_context->ticks_per_frame;
+  context->framerate = main_context->framerate;
+  context->flags = main_context->flags;
+  context->flags2 = main_context->flags2;
+  context->global_quality = main_context->global_quality;
+  /* the parallelism is across the contexts */
+  context->thread_count = 1;
+
+  if (gst_ffmpeg_avcodec_open (context, oclass->in_plugin) < 0)
+    goto failed;
+
+  avcodec_parameters_free (&par);
+
+  return context;
+
+failed:
+  {
+    avcodec_parameters_free (&par);
+    avcodec_free_context (&context);
+    return NULL;
+  }
+}
+
+static void
+gst_ffmpegvidenc_parallel_context_free (AVCodecContext * context)
+{
+  gst_ffmpeg_avcodec_close (context);
+  avcodec_free_context (&context);
+}
+
+/* moves the packets @context has ready to @chunk */
+static gint
+gst_ffmpegvidenc_parallel_receive (GstFFMpegVidEnc * ffmpegenc,
+    AVCodecContext * context, GstFFMpegVidEncChunk * chunk)
+{
+  AVPacket *pkt;
+  gint res;
+
+  while (TRUE) {
+    pkt = gst_ffmpeg_free_list_alloc (ffmpegenc->packet_list);
+    res = avcodec_receive_packet (context, pkt);
+    if (res < 0) {
+      gst_ffmpeg_free_list_release (pkt);
+      break;
+    }
+    g_queue_push_tail (&chunk->packets, pkt);
+  }
+
+  return res == AVERROR (EAGAIN) || res == AVERROR_EOF ? 0 : res;
+}
+
+static void
+gst_ffmpegvidenc_parallel_encode (gpointer data, gpointer user_data)
+{
+  GstFFMpegVidEncChunk *chunk = data;
+  GstFFMpegVidEnc *ffmpegenc = user_data;
+  AVCodecContext *context;
+  AVFrame *picture;
+  GList *l;
+  gint res = 0;
+
+  /* the pool never runs more chunks than there are contexts */
+  context = g_async_queue_pop (ffmpegenc->idle_contexts);
+  picture = av_frame_alloc ();
+
+  for (l = chunk->frames.head; l && res >= 0; l = l->next) {
+    if (!gst_ffmpegvidenc_fill_picture (ffmpegenc, context, l->data, picture)) {
+      res = AVERROR (EINVAL);
+      break;
+    }
+
+    /* every chunk is a closed GOP */
+    if (l == chunk->frames.head)
+      picture->pict_type = AV_PICTURE_TYPE_I;
+
+    res = avcodec_send_frame (context, picture);
+    av_frame_unref (picture);
+    if (res >= 0)
+      res = gst_ffmpegvidenc_parallel_receive (ffmpegenc, context, chunk);
+  }
+
+  av_frame_free (&picture);
+
+  if (context->codec->capabilities & AV_CODEC_CAP_DELAY) {
+    AVCodecContext *fresh;
+
+    if (res >= 0 && (res = avcodec_send_frame (context, NULL)) >= 0)
+      res = gst_ffmpegvidenc_parallel_receive (ffmpegenc, context, chunk);
+
+    /* a drained encoder takes no more frames, the next chunk on it fails if
+     * no new one can be opened */
+    if ((fresh = gst_ffmpegvidenc_parallel_context_new (ffmpegenc))) {
+      gst_ffmpegvidenc_parallel_context_free (context);
+      context = fresh;
+    }
+  }
+
+  g_async_queue_push (ffmpegenc->idle_contexts, context);
+
+  g_mutex_lock (&ffmpegenc->parallel_lock);
+  chunk->failed = res < 0;
+  chunk->done = TRUE;
+  g_cond_broadcast (&ffmpegenc->parallel_cond);
+  g_mutex_unlock (&ffmpegenc->parallel_lock);
+}
+
+/* with the stream lock, after the main context was opened. Encoding stays on
+ * the main context if the others can't be set up */
+static void
+gst_ffmpegvidenc_parallel_start (GstFFMpegVidEnc * ffmpegenc)
+{
+  GstFFMpegVidEncClass *oclass =
+      (GstFFMpegVidEncClass *) G_OBJECT_GET_CLASS (ffmpegenc);
+  const AVCodecDescriptor *desc;
+  AVCodecContext *context;
+  guint i, n_contexts = ffmpegenc->parallel_contexts;
+
+  if (n_contexts == 0)
+    n_contexts = MIN (g_get_num_processors (), MAX_PARALLEL_CONTEXTS);
+  if (n_contexts < 2)
+    return;
+
+  if (ffmpegenc->pass == AV_CODEC_FLAG_PASS1
+      || ffmpegenc->pass == AV_CODEC_FLAG_PASS2 || ffmpegenc->converter
+      || ffmpegenc->codec_thread
+      || gst_ffmpegvidenc_upstream_is_live (ffmpegenc)) {
+    GST_INFO_OBJECT (ffmpegenc, "not encoding on several contexts with "
+        "multipass, conversion, async-depth or live input");
+    return;
+  }
+
+  desc = avcodec_descriptor_get (oclass->in_plugin->id);
+  if (desc && (desc->props & AV_CODEC_PROP_INTRA_ONLY))
+    ffmpegenc->chunk_frames = 1;
+  else if (ffmpegenc->context->gop_size > 0)
+    ffmpegenc->chunk_frames = ffmpegenc->context->gop_size;
+  else
+    ffmpegenc->chunk_frames = 12;
+
+  ffmpegenc->idle_contexts = g_async_queue_new ();
+  for (i = 0; i < n_contexts; i++) {
+    if (!(context = gst_ffmpegvidenc_parallel_context_new (ffmpegenc)))
+      goto failed;
+    g_async_queue_push (ffmpegenc->idle_contexts, context);
+  }
+
+  ffmpegenc->parallel_pool =
+      g_thread_pool_new (gst_ffmpegvidenc_parallel_encode, ffmpegenc,
+      n_contexts, FALSE, NULL);
+  ffmpegenc->last_dts = G_MININT64;
+
+  GST_INFO_OBJECT (ffmpegenc, "encoding chunks of %u frames on %u contexts",
+      ffmpegenc->chunk_frames, n_contexts);
+
+  return;
+
+failed:
+  {
+    GST_WARNING_OBJECT (ffmpegenc, "failed to set up %u contexts, encoding "
+        "sequentially", n_contexts);
+    gst_ffmpegvidenc_parallel_stop (ffmpegenc);
+  }
+}
+
+/* waits for the running chunks and drops all of them */
+static void
+gst_ffmpegvidenc_parallel_stop (GstFFMpegVidEnc * ffmpegenc)
+{
+  GstFFMpegVidEncChunk *chunk;
+  AVCodecContext *context;
+
+  if (ffmpegenc->parallel_pool) {
+    g_thread_pool_free (ffmpegenc->parallel_pool, FALSE, TRUE);
+    ffmpegenc->parallel_pool = NULL;
+  }
+
+  while ((chunk = g_queue_pop_head (&ffmpegenc->parallel_jobs)))
+    gst_ffmpegvidenc_chunk_free (chunk);
+  if (ffmpegenc->parallel_chunk) {
+    gst_ffmpegvidenc_chunk_free (ffmpegenc->parallel_chunk);
+    ffmpegenc->parallel_chunk = NULL;
+  }
+
+  if (ffmpegenc->idle_contexts) {
+    while ((context = g_async_queue_try_pop (ffmpegenc->idle_contexts)))
+      gst_ffmpegvidenc_parallel_context_free (context);
+    g_async_queue_unref (ffmpegenc->idle_contexts);
+    ffmpegenc->idle_contexts = NULL;
+  }
+}
+
+/* Outputs the finished chunks at the head of the queue, waiting for them
+ * while more than max_jobs are queued. Waits for all with a max_jobs of 0.
+ * Without send, the chunks are dropped */
+static GstFlowReturn
+gst_ffmpegvidenc_parallel_output (GstFFMpegVidEnc * ffmpegenc,
+    guint max_jobs, gboolean send)
+{
+  GstVideoEncoder *encoder = GST_VIDEO_ENCODER (ffmpegenc);
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstVideoCodecFrame *frame, *pending;
+  GstFFMpegVidEncChunk *chunk;
+  AVPacket *pkt;
+
+  g_mutex_lock (&ffmpegenc->parallel_lock);
+  while ((chunk = g_queue_peek_head (&ffmpegenc->parallel_jobs))) {
+    if (!chunk->done) {
+      if (max_jobs > 0
+          && g_queue_get_length (&ffmpegenc->parallel_jobs) <= max_jobs)
+        break;
+      g_cond_wait (&ffmpegenc->parallel_cond, &ffmpegenc->parallel_lock);
+      continue;
+    }
+    g_queue_pop_head (&ffmpegenc->parallel_jobs);
+    g_mutex_unlock (&ffmpegenc->parallel_lock);
+
+    if (chunk->failed && ret == GST_FLOW_OK) {
+      GST_ELEMENT_ERROR (ffmpegenc, LIBRARY, ENCODE, (NULL),
+          ("failed to encode a chunk"));
+      ret = GST_FLOW_ERROR;
+    }
+
+    while ((pkt = g_queue_pop_head (&chunk->packets))) {
+      if (ret != GST_FLOW_OK) {
+        gst_ffmpegvidenc_free_avpacket (pkt);
+        continue;
+      }
+
+      /* each chunk starts its own timeline, keep DTS increasing across
+       * them */
+      if (pkt->dts != AV_NOPTS_VALUE) {
+        if (pkt->dts <= ffmpegenc->last_dts)
+          pkt->dts = ffmpegenc->last_dts + 1;
+        ffmpegenc->last_dts = pkt->dts;
+      }
+      ret = gst_ffmpegvidenc_handle_packet (ffmpegenc, pkt, send);
+    }
+
+    /* frames the codec didn't produce a packet for */
+    while ((frame = g_queue_pop_head (&chunk->frames))) {
+      pending = gst_video_encoder_get_frame (encoder,
+          frame->system_frame_number);
+      if (pending)
+        gst_video_encoder_finish_frame (encoder, pending);
+      gst_video_codec_frame_unref (frame);
+    }
+
+    gst_ffmpegvidenc_chunk_free (chunk);
+    g_mutex_lock (&ffmpegenc->parallel_lock);
+  }
+  g_mutex_unlock (&ffmpegenc->parallel_lock);
+
+  return ret;
+}
+
+static void
+gst_ffmpegvidenc_parallel_submit (GstFFMpegVidEnc * ffmpegenc)
+{
+  GstFFMpegVidEncChunk *chunk = ffmpegenc->parallel_chunk;
+
+  if (!chunk)
+    return;
+  ffmpegenc->parallel_chunk = NULL;
+
+  g_mutex_lock (&ffmpegenc->parallel_lock);
+  g_queue_push_tail (&ffmpegenc->parallel_jobs, chunk);
+  g_mutex_unlock (&ffmpegenc->parallel_lock);
+
+  g_thread_pool_push (ffmpegenc->parallel_pool, chunk, NULL);
+}
+
+/* encodes everything queued, without send the output is dropped */
+static GstFlowReturn
+gst_ffmpegvidenc_parallel_drain (GstFFMpegVidEnc * ffmpegenc, gboolean send)
+{
+  gst_ffmpegvidenc_parallel_submit (ffmpegenc);
+
+  return gst_ffmpegvidenc_parallel_output (ffmpegenc, 0, send);
+}
+
+static GstFlowReturn
+gst_ffmpegvidenc_parallel_handle_frame (GstFFMpegVidEnc * ffmpegenc,
+    GstVideoCodecFrame * frame)
+{
+  GstFFMpegVidEncChunk *chunk = ffmpegenc->parallel_chunk;
+
+  if (chunk && (GST_VIDEO_CODEC_FRAME_IS_FORCE_KEYFRAME (frame)
+          || chunk->frames.length >= ffmpegenc->chunk_frames)) {
+    gst_ffmpegvidenc_parallel_submit (ffmpegenc);
+    chunk = NULL;
+  }
+
+  if (!chunk) {
+    chunk = g_slice_new0 (GstFFMpegVidEncChunk);
+    g_queue_init (&chunk->frames);
+    g_queue_init (&chunk->packets);
+    ffmpegenc->parallel_chunk = chunk;
+  }
+  g_queue_push_tail (&chunk->frames, frame);
+
+  /* keep a second chunk per context queued while the first ones are output */
+  return gst_ffmpegvidenc_parallel_output (ffmpegenc,
+      2 * g_thread_pool_get_max_threads (ffmpegenc->parallel_pool), TRUE);
+}
+
+static GstFlowReturn
+gst_ffmpegvidenc_handle_frame (GstVideoEncoder * encoder,
+    GstVideoCodecFrame * frame)
+{
+  GstFFMpegVidEnc *ffmpegenc = (GstFFMpegVidEnc *) encoder;
+  GstFlowReturn ret;
+
+  if (ffmpegenc->parallel_pool)
+    return gst_ffmpegvidenc_parallel_handle_frame (ffmpegenc, frame);
+
+  if (!ffmpegenc->codec_thread)
+    return gst_ffmpegvidenc_encode_frame (ffmpegenc, frame);
+
+  /* encoding and pushing happens in the codec thread, we get the flow
+   * return of previous frames here */
+  ret = gst_ffmpeg_codec_thread_push (ffmpegenc->codec_thread, frame);
+  if (ret != GST_FLOW_OK) {
+    GST_DEBUG_OBJECT (ffmpegenc, "codec thread returned %s",
+        gst_flow_get_name (ret));
+    gst_video_encoder_finish_frame (encoder, frame);
+  }
+
+  return ret;
+}
+
 static GstFlowReturn
 gst_ffmpegvidenc_flush_buffers (GstFFMpegVidEnc * ffmpegenc, gboolean send)
 {
   GstFlowReturn ret = GST_FLOW_OK;
+  GstFlowReturn thread_ret = GST_FLOW_OK;
   gboolean got_packet;
 
   GST_DEBUG_OBJECT (ffmpegenc, "flushing buffers with sending %d", send);
 
+  /* let the codec thread handle what is queued first, what it failed with
+   * is reported after draining */
+  if (ffmpegenc->codec_thread) {
+    if (send)
+      thread_ret = gst_ffmpeg_codec_thread_wait (ffmpegenc->codec_thread);
+    else
+      gst_ffmpeg_codec_thread_flush (ffmpegenc->codec_thread);
+  }
+
   /* no need to empty codec if there is none */
   if (!ffmpegenc->opened)
     goto done;
 
+  if (ffmpegenc->parallel_pool) {
+    ret = gst_ffmpegvidenc_parallel_drain (ffmpegenc, send);
+    goto done;
+  }
+
   ret = gst_ffmpegvidenc_send_frame (ffmpegenc, NULL);
 
   if (ret != GST_FLOW_OK)
@@ -765,6 +2163,8 @@ gst_ffmpegvidenc_flush_buffers (GstFFMpegVidEnc * ffmpegenc, gboolean send)
   } while (got_packet);
 
 done:
+  if (ret == GST_FLOW_OK)
+    ret = thread_ret;
   return ret;
 }
 
@@ -777,6 +2177,18 @@ gst_ffmpegvidenc_set_property (GObject * object,
   ffmpegenc = (GstFFMpegVidEnc *) (object);
 
   if (ffmpegenc->opened) {
+    /* rate control changes are picked up between frames */
+    if (prop_id == PROP_QUANTIZER || gst_ffmpeg_cfg_is_rate_control (pspec)) {
+      GST_OBJECT_LOCK (ffmpegenc);
+      if (prop_id == PROP_QUANTIZER)
+        ffmpegenc->quantizer = g_value_get_float (value);
+      else
+        gst_ffmpeg_cfg_set_property (ffmpegenc->refcontext, value, pspec);
+      ffmpegenc->rc_changed = TRUE;
+      GST_OBJECT_UNLOCK (ffmpegenc);
+      return;
+    }
+
     GST_WARNING_OBJECT (ffmpegenc,
         "Can't change properties once decoder is setup !");
     return;
@@ -793,6 +2205,37 @@ gst_ffmpegvidenc_set_property (GObject * object,
       g_free (ffmpegenc->filename);
       ffmpegenc->filename = g_value_dup_string (value);
       break;
+    case PROP_IDLE_TIMEOUT:
+      ffmpegenc->idle_timeout = g_value_get_uint64 (value);
+      break;
+    case PROP_IDLE_CLOSE_CODEC:
+      ffmpegenc->idle_close_codec = g_value_get_boolean (value);
+      break;
+    case PROP_ASYNC_DEPTH:
+      ffmpegenc->async_depth = g_value_get_uint (value);
+      break;
+    case PROP_CONVERT:
+      ffmpegenc->convert = g_value_get_boolean (value);
+      break;
+    case PROP_ADAPTIVE_SPEED:
+      ffmpegenc->adaptive_speed = g_value_get_boolean (value);
+      break;
+    case PROP_LOW_LATENCY:
+      ffmpegenc->low_latency = g_value_get_boolean (value);
+      break;
+    case PROP_MAX_THREADS:
+      ffmpegenc->max_threads = g_value_get_int (value);
+      break;
+    case PROP_THREAD_TYPE:
+      ffmpegenc->thread_type = g_value_get_flags (value);
+      break;
+    case PROP_MULTIPASS_CACHE_ID:
+      g_free (ffmpegenc->multipass_id);
+      ffmpegenc->multipass_id = g_value_dup_string (value);
+      break;
+    case PROP_PARALLEL_CONTEXTS:
+      ffmpegenc->parallel_contexts = g_value_get_uint (value);
+      break;
     default:
       if (!gst_ffmpeg_cfg_set_property (ffmpegenc->refcontext, value, pspec))
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -818,6 +2261,41 @@ gst_ffmpegvidenc_get_property (GObject * object,
     case PROP_FILENAME:
       g_value_take_string (value, g_strdup (ffmpegenc->filename));
       break;
+    case PROP_IDLE_TIMEOUT:
+      g_value_set_uint64 (value, ffmpegenc->idle_timeout);
+      break;
+    case PROP_IDLE_CLOSE_CODEC:
+      g_value_set_boolean (value, ffmpegenc->idle_close_codec);
+      break;
+    case PROP_ASYNC_DEPTH:
+      g_value_set_uint (value, ffmpegenc->async_depth);
+      break;
+    case PROP_CONVERT:
+      g_value_set_boolean (value, ffmpegenc->convert);
+      break;
+    case PROP_ADAPTIVE_SPEED:
+      g_value_set_boolean (value, ffmpegenc->adaptive_speed);
+      break;
+    case PROP_LOW_LATENCY:
+      g_value_set_boolean (value, ffmpegenc->low_latency);
+      break;
+    case PROP_MAX_THREADS:
+      g_value_set_int (value, ffmpegenc->max_threads);
+      break;
+    case PROP_THREAD_TYPE:
+      g_value_set_flags (value, ffmpegenc->thread_type);
+      break;
+    case PROP_MULTIPASS_CACHE_ID:
+      g_value_set_string (value, ffmpegenc->multipass_id);
+      break;
+    case PROP_PARALLEL_CONTEXTS:
+      g_value_set_uint (value, ffmpegenc->parallel_contexts);
+      break;
+    case PROP_STATS:
+      GST_OBJECT_LOCK (ffmpegenc);
+      g_value_take_boxed (value, gst_ffmpegvidenc_stats_get (ffmpegenc));
+      GST_OBJECT_UNLOCK (ffmpegenc);
+      break;
     default:
       if (!gst_ffmpeg_cfg_get_property (ffmpegenc->refcontext, value, pspec))
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -830,9 +2308,24 @@ gst_ffmpegvidenc_flush (GstVideoEncoder * encoder)
 {
   GstFFMpegVidEnc *ffmpegenc = (GstFFMpegVidEnc *) encoder;
 
+  if (ffmpegenc->codec_thread)
+    gst_ffmpeg_codec_thread_flush (ffmpegenc->codec_thread);
+
+  if (ffmpegenc->parallel_pool) {
+    if (ffmpegenc->parallel_chunk) {
+      gst_ffmpegvidenc_chunk_free (ffmpegenc->parallel_chunk);
+      ffmpegenc->parallel_chunk = NULL;
+    }
+    gst_ffmpegvidenc_parallel_output (ffmpegenc, 0, FALSE);
+    /* the timestamps start over after a seek */
+    ffmpegenc->last_dts = G_MININT64;
+  }
+
   if (ffmpegenc->opened)
     avcodec_flush_buffers (ffmpegenc->context);
 
+  ffmpegenc->min_delay = GST_CLOCK_STIME_NONE;
+
   return TRUE;
 }
 
@@ -852,6 +2345,31 @@ gst_ffmpegvidenc_start (GstVideoEncoder * encoder)
 
   gst_video_encoder_set_min_pts (encoder, GST_SECOND * 60 * 60 * 1000);
 
+  ffmpegenc->multipass_begun = FALSE;
+  ffmpegenc->multipass_finished = FALSE;
+
+  gst_ffmpegvidenc_stats_reset (ffmpegenc);
+
+  ffmpegenc->speed_level = 0;
+  ffmpegenc->speed_hold = 0;
+  ffmpegenc->speed_headroom = 0;
+  ffmpegenc->min_delay = GST_CLOCK_STIME_NONE;
+
+  ffmpegenc->last_input_time = gst_util_get_timestamp ();
+  ffmpegenc->idle = FALSE;
+  ffmpegenc->idle_closed = FALSE;
+  if (ffmpegenc->idle_timeout > 0)
+    ffmpegenc->idle_watch = gst_ffmpeg_idle_watch_new (GST_ELEMENT (ffmpegenc),
+        MAX (ffmpegenc->idle_timeout / 2, GST_MSECOND),
+        gst_ffmpegvidenc_idle_cb);
+
+  if (ffmpegenc->async_depth > 0)
+    ffmpegenc->codec_thread =
+        gst_ffmpeg_codec_thread_new (GST_ELEMENT (ffmpegenc),
+        &encoder->stream_lock, ffmpegenc->async_depth,
+        (GstFFMpegCodecThreadFunc) gst_ffmpegvidenc_encode_frame,
+        (GDestroyNotify) gst_video_codec_frame_unref);
+
   return TRUE;
 }
 
@@ -860,10 +2378,44 @@ gst_ffmpegvidenc_stop (GstVideoEncoder * encoder)
 {
   GstFFMpegVidEnc *ffmpegenc = (GstFFMpegVidEnc *) encoder;
 
+  if (ffmpegenc->idle_watch) {
+    gst_ffmpeg_idle_watch_free (ffmpegenc->idle_watch);
+    ffmpegenc->idle_watch = NULL;
+  }
+  ffmpegenc->idle = FALSE;
+  ffmpegenc->idle_closed = FALSE;
+
+  /* called without the stream lock */
+  if (ffmpegenc->codec_thread) {
+    gst_ffmpeg_codec_thread_free (ffmpegenc->codec_thread);
+    ffmpegenc->codec_thread = NULL;
+  }
+
   gst_ffmpegvidenc_flush_buffers (ffmpegenc, FALSE);
+  gst_ffmpegvidenc_parallel_stop (ffmpegenc);
   gst_ffmpeg_avcodec_close (ffmpegenc->context);
   ffmpegenc->opened = FALSE;
 
+  /* only the end of the stream completes the statistics, a second pass
+   * must not pick up those of an aborted first one */
+  if (ffmpegenc->multipass_begun) {
+    if (!ffmpegenc->multipass_finished) {
+      GST_WARNING_OBJECT (ffmpegenc, "first pass stopped before the end of "
+          "the stream, dropping its statistics");
+      gst_ffmpeg_multipass_stats_remove (ffmpegenc->multipass_id);
+    }
+    ffmpegenc->multipass_begun = FALSE;
+    ffmpegenc->multipass_finished = FALSE;
+  } else if (ffmpegenc->multipass_id
+      && ffmpegenc->pass == AV_CODEC_FLAG_PASS2) {
+    gst_ffmpeg_multipass_stats_remove (ffmpegenc->multipass_id);
+  }
+
+  if (ffmpegenc->converter) {
+    gst_ffmpeg_video_converter_free (ffmpegenc->converter);
+    ffmpegenc->converter = NULL;
+  }
+
   if (ffmpegenc->input_state) {
     gst_video_codec_state_unref (ffmpegenc->input_state);
     ffmpegenc->input_state = NULL;
@@ -876,8 +2428,17 @@ static GstFlowReturn
 gst_ffmpegvidenc_finish (GstVideoEncoder * encoder)
 {
   GstFFMpegVidEnc *ffmpegenc = (GstFFMpegVidEnc *) encoder;
+  GstFlowReturn ret;
+
+  ret = gst_ffmpegvidenc_flush_buffers (ffmpegenc, TRUE);
 
-  return gst_ffmpegvidenc_flush_buffers (ffmpegenc, TRUE);
+  /* the second pass can start once the first one is drained */
+  if (ffmpegenc->multipass_begun && ret == GST_FLOW_OK) {
+    gst_ffmpeg_multipass_stats_end (ffmpegenc->multipass_id);
+    ffmpegenc->multipass_finished = TRUE;
+  }
+
+  return ret;
 }
 
 gboolean
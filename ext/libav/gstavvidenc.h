@@ -28,8 +28,14 @@
 #include <gst/video/video.h>
 #include <libavcodec/avcodec.h>
 
+#include "gstavutils.h"
+#include "gstavconvert.h"
+
 G_BEGIN_DECLS
 
+#define GST_FFMPEGVIDENC_N_SPEED_LEVELS 3
+#define GST_FFMPEGVIDENC_MAX_SPEED_OPTIONS 8
+
 typedef struct _GstFFMpegVidEnc GstFFMpegVidEnc;
 
 struct _GstFFMpegVidEnc
@@ -48,12 +54,79 @@ struct _GstFFMpegVidEnc
   /* statistics file */
   gchar *filename;
   FILE *file;
+  /* or in memory statistics, see multipass-cache-id */
+  gchar *multipass_id;
+  gboolean multipass_begun;
+  /* the first pass saw the end of the stream */
+  gboolean multipass_finished;
 
   /* cache */
   guint8 *working_buf;
   gsize working_buf_size;
 
   AVCodecContext *refcontext;
+
+  /* recycled per frame input bookkeeping and output packets */
+  GstFFMpegFreeList *buffer_info_list;
+  GstFFMpegFreeList *packet_list;
+
+  /* encoding in a separate thread, see async-depth */
+  guint async_depth;
+  GstFFMpegCodecThread *codec_thread;
+
+  /* idle trimming, protected by the stream lock */
+  GstClockTime idle_timeout;
+  gboolean idle_close_codec;
+  GstFFMpegIdleWatch *idle_watch;
+  GstClockTime last_input_time;
+  gboolean idle;
+  gboolean idle_closed;
+
+  /* rate control changes, rc_changed is protected by the object lock */
+  gboolean rc_changed;
+  gboolean rc_reopen;
+  gint frames_in_gop;
+
+  /* speed adaptation to lateness, protected by the stream lock */
+  gboolean adaptive_speed;
+  guint speed_level;
+  guint speed_hold;
+  guint speed_headroom;
+  GstClockTimeDiff min_delay;
+  /* configured values of the speed options, G_MININT64 if not there */
+  gint64 speed_options[GST_FFMPEGVIDENC_MAX_SPEED_OPTIONS];
+
+  gboolean low_latency;
+  gint max_threads;
+  gint thread_type;
+
+  /* encoding of chunks of GOPs on worker threads, see parallel-contexts.
+   * Chunks are queued in input order, the one being filled is
+   * parallel_chunk */
+  guint parallel_contexts;
+  GThreadPool *parallel_pool;
+  GAsyncQueue *idle_contexts;
+  GMutex parallel_lock;
+  GCond parallel_cond;
+  GQueue parallel_jobs;
+  gpointer parallel_chunk;
+  guint chunk_frames;
+  gint64 last_dts;
+
+  /* output statistics, see stats, protected by the object lock. The window
+   * holds the times and sizes of the last second of packets */
+  GQueue stats_window;
+  guint64 stats_window_bytes;
+  guint64 stats_frames;
+  guint64 stats_last_keyframe;
+  guint stats_keyframe_interval;
+  GstClockTime stats_encode_time;
+  /* spent in the codec on the frame being encoded */
+  GstClockTime codec_time;
+
+  /* conversion of the formats the codec doesn't take */
+  gboolean convert;
+  GstFFMpegVideoConverter *converter;
 };
 
 typedef struct _GstFFMpegVidEncClass GstFFMpegVidEncClass;
@@ -64,6 +137,8 @@ struct _GstFFMpegVidEncClass
 
   AVCodec *in_plugin;
   GstPadTemplate *srctempl, *sinktempl;
+  /* sink caps without conversion */
+  GstCaps *native_caps;
 };
 
 G_END_DECLS
@@ -0,0 +1,196 @@
+/* GStreamer unit tests for the parallel decoding of the libav audio decoders
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+
+#include <gst/gst.h>
+
+#define N_RUNS 5
+
+typedef struct
+{
+  guint parallel_contexts;
+  GChecksum *checksum;
+  GstClockTime last_pts;
+  gboolean in_order;
+  guint n_buffers;
+} DecodeResult;
+
+static void
+element_added_cb (GstBin * bin, GstBin * sub_bin, GstElement * element,
+    DecodeResult * result)
+{
+  GstElementFactory *factory = gst_element_get_factory (element);
+
+  if (factory && g_str_has_prefix (GST_OBJECT_NAME (factory), "avdec_")) {
+    GST_INFO_OBJECT (element, "using %u contexts", result->parallel_contexts);
+    g_object_set (element, "parallel-contexts", result->parallel_contexts,
+        NULL);
+  }
+}
+
+static void
+handoff_cb (GstElement * sink, GstBuffer * buf, GstPad * pad,
+    DecodeResult * result)
+{
+  GstMapInfo map;
+
+  if (GST_BUFFER_PTS_IS_VALID (buf)) {
+    if (GST_CLOCK_TIME_IS_VALID (result->last_pts)
+        && GST_BUFFER_PTS (buf) < result->last_pts)
+      result->in_order = FALSE;
+    result->last_pts = GST_BUFFER_PTS (buf);
+  }
+
+  gst_buffer_map (buf, &map, GST_MAP_READ);
+  g_checksum_update (result->checksum, map.data, map.size);
+  gst_buffer_unmap (buf, &map);
+  result->n_buffers++;
+}
+
+/* returns the checksum of the decoded samples and how long decoding took */
+static gchar *
+decode_file (const gchar * file, guint parallel_contexts, gint64 * elapsed)
+{
+  GstElement *pipeline, *src, *sink;
+  GstStateChangeReturn state_ret;
+  DecodeResult result = { parallel_contexts, NULL, GST_CLOCK_TIME_NONE,
+    TRUE, 0
+  };
+  GstMessage *msg;
+  GstBus *bus;
+  gchar *path, *checksum;
+  gint64 start;
+
+  pipeline = gst_parse_launch ("filesrc name=src ! decodebin ! "
+      "fakesink name=sink signal-handoffs=true sync=false", NULL);
+  fail_unless (pipeline != NULL, "Failed to create pipeline!");
+
+  result.checksum = g_checksum_new (G_CHECKSUM_MD5);
+  g_signal_connect (pipeline, "deep-element-added",
+      G_CALLBACK (element_added_cb), &result);
+
+  src = gst_bin_get_by_name (GST_BIN (pipeline), "src");
+  path = g_build_filename (GST_TEST_FILES_PATH, file, NULL);
+  GST_LOG ("reading file '%s'", path);
+  g_object_set (src, "location", path, NULL);
+  gst_object_unref (src);
+  g_free (path);
+
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  g_signal_connect (sink, "handoff", G_CALLBACK (handoff_cb), &result);
+  gst_object_unref (sink);
+
+  start = g_get_monotonic_time ();
+
+  state_ret = gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  fail_unless (state_ret != GST_STATE_CHANGE_FAILURE);
+
+  bus = gst_element_get_bus (pipeline);
+  msg = gst_bus_timed_pop_filtered (bus, 30 * GST_SECOND,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (msg != NULL);
+  fail_unless_equals_int (GST_MESSAGE_TYPE (msg), GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+
+  *elapsed = g_get_monotonic_time () - start;
+
+  fail_unless_equals_int (gst_element_set_state (pipeline, GST_STATE_NULL),
+      GST_STATE_CHANGE_SUCCESS);
+  gst_object_unref (pipeline);
+
+  fail_unless (result.n_buffers > 0);
+  fail_unless (result.in_order, "output of %s is out of order", file);
+
+  checksum = g_strdup (g_checksum_get_string (result.checksum));
+  g_checksum_free (result.checksum);
+
+  return checksum;
+}
+
+/* decodes the file sequentially and in parallel, the output must match.
+ * The timings are only logged, they depend on the machine */
+static void
+run_check_for_file (const gchar * file)
+{
+  gchar *sequential, *parallel;
+  gint64 sequential_time = 0, parallel_time = 0, elapsed;
+  gint i;
+
+  /* several runs, so that the jobs finish in different orders */
+  for (i = 0; i < N_RUNS; i++) {
+    sequential = decode_file (file, 1, &elapsed);
+    sequential_time += elapsed;
+    parallel = decode_file (file, 4, &elapsed);
+    parallel_time += elapsed;
+
+    fail_unless_equals_string (sequential, parallel);
+    g_free (sequential);
+    g_free (parallel);
+  }
+
+  GST_INFO ("%s: sequential %" G_GINT64_FORMAT " us, 4 contexts %"
+      G_GINT64_FORMAT " us", file, sequential_time / N_RUNS,
+      parallel_time / N_RUNS);
+}
+
+GST_START_TEST (test_parallel_ape)
+{
+  run_check_for_file ("586957.ape");
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_parallel_adpcm)
+{
+  run_check_for_file ("591809.wav");
+}
+
+GST_END_TEST;
+
+static gboolean
+have_element (const gchar * name)
+{
+  if (gst_registry_check_feature_version (gst_registry_get (), name,
+          GST_VERSION_MAJOR, GST_VERSION_MINOR, 0))
+    return TRUE;
+
+  GST_INFO ("%s not found, skipping the tests that need it", name);
+  return FALSE;
+}
+
+static Suite *
+avauddec_parallel_suite (void)
+{
+  Suite *s = suite_create ("avauddec_parallel");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_set_timeout (tc_chain, 120);
+  /* the files are demuxed and decoded by decodebin */
+  if (have_element ("decodebin")) {
+    tcase_add_test (tc_chain, test_parallel_ape);
+    if (have_element ("wavparse"))
+      tcase_add_test (tc_chain, test_parallel_adpcm);
+  }
+
+  return s;
+}
+
+GST_CHECK_MAIN (avauddec_parallel)
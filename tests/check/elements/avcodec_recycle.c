@@ -0,0 +1,207 @@
+/* GStreamer unit tests for the object recycling of the libav codec elements
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/check/gstharness.h>
+
+#include <gst/gst.h>
+
+#include <errno.h>
+#include <stdlib.h>
+
+#define WARMUP_BUFFERS 30
+#define STEADY_BUFFERS 100
+
+/* Heap allocations per frame that are left in steady state, none of them
+ * made by the per frame objects of the plugin, which are recycled:
+ *  - the codec frame of each base class and its list node
+ *  - the AVBufferRef and AVBuffer av_buffer_create() wraps around every
+ *    picture or sample buffer handed to libavcodec
+ *  - the AVBufferRef, AVBuffer and data of every packet libavcodec outputs
+ *  - the GstBuffer and GstMemory around every packet
+ *  - the queue node of the harness for every output buffer
+ * An object that is allocated per frame again shows up as one more. */
+#define VIDEO_ALLOCS_PER_FRAME (2 + 2 + 3 + 2 + 2 + 2 + 1)
+#define AUDIO_ALLOCS_PER_FRAME (2 + 3 + 2 + 1)
+
+#ifdef __GLIBC__
+/* counting allocator, replaces the one of the C library for the whole
+ * process so that GLib and libav allocations are seen alike */
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+extern void *__libc_memalign (size_t alignment, size_t size);
+
+static gint counting = 0;
+static gint n_allocs = 0;
+
+static inline void
+count_alloc (void)
+{
+  if (g_atomic_int_get (&counting))
+    g_atomic_int_inc (&n_allocs);
+}
+
+void *
+malloc (size_t size)
+{
+  count_alloc ();
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t n, size_t size)
+{
+  count_alloc ();
+  return __libc_calloc (n, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+  count_alloc ();
+  return __libc_realloc (ptr, size);
+}
+
+void *
+memalign (size_t alignment, size_t size)
+{
+  count_alloc ();
+  return __libc_memalign (alignment, size);
+}
+
+void *
+aligned_alloc (size_t alignment, size_t size)
+{
+  count_alloc ();
+  return __libc_memalign (alignment, size);
+}
+
+/* what av_malloc() uses */
+int
+posix_memalign (void **memptr, size_t alignment, size_t size)
+{
+  void *ptr;
+
+  count_alloc ();
+  ptr = __libc_memalign (alignment, size);
+  if (!ptr)
+    return ENOMEM;
+  *memptr = ptr;
+  return 0;
+}
+#endif
+
+/* pushes @n_buffers and returns how many heap allocations that took, the
+ * input buffers are created up front */
+static guint
+push_and_pull (GstHarness * h, gsize size, gint n_buffers,
+    GstClockTime * ts, GstClockTime duration)
+{
+  GstBuffer **bufs, *buf;
+  gint i;
+
+  bufs = g_new (GstBuffer *, n_buffers);
+  for (i = 0; i < n_buffers; i++) {
+    bufs[i] = gst_harness_create_buffer (h, size);
+    gst_buffer_memset (bufs[i], 0, i & 0xff, size);
+    GST_BUFFER_PTS (bufs[i]) = *ts;
+    GST_BUFFER_DURATION (bufs[i]) = duration;
+    *ts += duration;
+  }
+
+  g_atomic_int_set (&n_allocs, 0);
+  g_atomic_int_set (&counting, 1);
+  for (i = 0; i < n_buffers; i++) {
+    fail_unless_equals_int (gst_harness_push (h, bufs[i]), GST_FLOW_OK);
+
+    while ((buf = gst_harness_try_pull (h)))
+      gst_buffer_unref (buf);
+  }
+  g_atomic_int_set (&counting, 0);
+
+  g_free (bufs);
+
+  return g_atomic_int_get (&n_allocs);
+}
+
+GST_START_TEST (test_video_steady_state)
+{
+  GstHarness *h;
+  guint n_allocs;
+  GstClockTime ts = 0;
+  GstClockTime duration = gst_util_uint64_scale_int (GST_SECOND, 1, 25);
+
+  h = gst_harness_new_parse ("avenc_mpeg4 ! avdec_mpeg4");
+  gst_harness_set_src_caps_str (h,
+      "video/x-raw,format=I420,width=64,height=64,framerate=25/1");
+
+  push_and_pull (h, 64 * 64 * 3 / 2, WARMUP_BUFFERS, &ts, duration);
+  n_allocs = push_and_pull (h, 64 * 64 * 3 / 2, STEADY_BUFFERS, &ts,
+      duration);
+
+  GST_INFO ("%u allocations for %d frames", n_allocs, STEADY_BUFFERS);
+  fail_unless (n_allocs <= STEADY_BUFFERS * VIDEO_ALLOCS_PER_FRAME,
+      "%u allocations for %d frames", n_allocs, STEADY_BUFFERS);
+
+  gst_harness_teardown (h);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_audio_steady_state)
+{
+  GstHarness *h;
+  guint n_allocs;
+  GstClockTime ts = 0;
+  GstClockTime duration = gst_util_uint64_scale_int (GST_SECOND, 1536, 48000);
+
+  /* ac3 takes planar samples, so the input gets deinterleaved */
+  h = gst_harness_new ("avenc_ac3");
+  gst_harness_set_src_caps_str (h,
+      "audio/x-raw,format=F32LE,layout=interleaved,rate=48000,channels=2,"
+      "channel-mask=(bitmask)0x3");
+
+  push_and_pull (h, 1536 * 2 * 4, WARMUP_BUFFERS, &ts, duration);
+  n_allocs = push_and_pull (h, 1536 * 2 * 4, STEADY_BUFFERS, &ts, duration);
+
+  GST_INFO ("%u allocations for %d frames", n_allocs, STEADY_BUFFERS);
+  fail_unless (n_allocs <= STEADY_BUFFERS * AUDIO_ALLOCS_PER_FRAME,
+      "%u allocations for %d frames", n_allocs, STEADY_BUFFERS);
+
+  gst_harness_teardown (h);
+}
+
+GST_END_TEST;
+
+static Suite *
+avcodec_recycle_suite (void)
+{
+  Suite *s = suite_create ("avcodec_recycle");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+#ifdef __GLIBC__
+  tcase_add_test (tc_chain, test_video_steady_state);
+  tcase_add_test (tc_chain, test_audio_steady_state);
+#endif
+
+  return s;
+}
+
+GST_CHECK_MAIN (avcodec_recycle)
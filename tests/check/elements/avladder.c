@@ -0,0 +1,181 @@
+/* GStreamer unit tests for the libav ABR ladder encoder
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+
+#include <gst/gst.h>
+
+#define N_FRAMES 50
+#define N_RUNGS 3
+
+typedef struct
+{
+  guint n_buffers;
+  GArray *keyframes;
+  gint width, height;
+} RungResult;
+
+static void
+handoff_cb (GstElement * sink, GstBuffer * buf, GstPad * pad,
+    RungResult * result)
+{
+  /* the input timestamps come back, like from the avenc_ elements the
+   * packets have the encoder stats */
+  fail_unless_equals_uint64 (GST_BUFFER_PTS (buf),
+      result->n_buffers * GST_SECOND / 25);
+  fail_unless_equals_uint64 (GST_BUFFER_DURATION (buf), GST_SECOND / 25);
+  fail_unless (gst_buffer_get_meta (buf,
+          g_type_from_name ("GstFFMpegEncoderStatsMetaAPI")) != NULL);
+
+  if (!GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT))
+    g_array_append_val (result->keyframes, GST_BUFFER_PTS (buf));
+
+  if (result->n_buffers++ == 0) {
+    GstCaps *caps = gst_pad_get_current_caps (pad);
+    GstStructure *s = gst_caps_get_structure (caps, 0);
+    GstEvent *segment;
+
+    gst_structure_get_int (s, "width", &result->width);
+    gst_structure_get_int (s, "height", &result->height);
+    gst_caps_unref (caps);
+
+    /* held back until the rendition had its caps */
+    segment = gst_pad_get_sticky_event (pad, GST_EVENT_SEGMENT, 0);
+    fail_unless (segment != NULL);
+    gst_event_unref (segment);
+  }
+}
+
+/* all the renditions have their size and keyframes on the same frames */
+GST_START_TEST (test_ladder_aligned_keyframes)
+{
+  static const gint sizes[N_RUNGS][2] = { {320, 240}, {160, 120}, {80, 60} };
+  RungResult results[N_RUNGS];
+  GstElement *pipeline, *sink;
+  GstMessage *msg;
+  GstBus *bus;
+  gchar *name;
+  gint i, j;
+
+  pipeline = gst_parse_launch ("videotestsrc num-buffers=50 ! "
+      "video/x-raw,format=I420,width=320,height=240,framerate=25/1 ! "
+      "avladder name=l codec=mpeg4 keyframe-interval=10 "
+      "src_0::width=160 src_1::height=240 src_2::width=80 "
+      "l.src_0 ! fakesink name=s1 signal-handoffs=true "
+      "l.src_1 ! fakesink name=s0 signal-handoffs=true "
+      "l.src_2 ! fakesink name=s2 signal-handoffs=true", NULL);
+  fail_unless (pipeline != NULL, "Failed to create pipeline!");
+
+  for (i = 0; i < N_RUNGS; i++) {
+    results[i].n_buffers = 0;
+    results[i].keyframes = g_array_new (FALSE, FALSE, sizeof (GstClockTime));
+
+    name = g_strdup_printf ("s%d", i);
+    sink = gst_bin_get_by_name (GST_BIN (pipeline), name);
+    g_signal_connect (sink, "handoff", G_CALLBACK (handoff_cb), &results[i]);
+    gst_object_unref (sink);
+    g_free (name);
+  }
+
+  fail_unless (gst_element_set_state (pipeline, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE);
+
+  bus = gst_element_get_bus (pipeline);
+  msg = gst_bus_timed_pop_filtered (bus, 30 * GST_SECOND,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (msg != NULL);
+  fail_unless_equals_int (GST_MESSAGE_TYPE (msg), GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+
+  fail_unless_equals_int (gst_element_set_state (pipeline, GST_STATE_NULL),
+      GST_STATE_CHANGE_SUCCESS);
+  gst_object_unref (pipeline);
+
+  for (i = 0; i < N_RUNGS; i++) {
+    fail_unless_equals_int (results[i].n_buffers, N_FRAMES);
+    fail_unless_equals_int (results[i].width, sizes[i][0]);
+    fail_unless_equals_int (results[i].height, sizes[i][1]);
+    fail_unless_equals_int (results[i].keyframes->len, N_FRAMES / 10);
+
+    for (j = 0; j < results[i].keyframes->len; j++)
+      fail_unless_equals_uint64 (g_array_index (results[i].keyframes,
+              GstClockTime, j), g_array_index (results[0].keyframes,
+              GstClockTime, j));
+  }
+
+  for (i = 0; i < N_RUNGS; i++)
+    g_array_free (results[i].keyframes, TRUE);
+}
+
+GST_END_TEST;
+
+/* each rendition adds the latency of its encoder to the upstream one */
+GST_START_TEST (test_ladder_latency)
+{
+  GstElement *pipeline, *sink;
+  GstQuery *query;
+  GstClockTime min, max;
+  gboolean live;
+  GstPad *pad;
+
+  pipeline = gst_parse_launch ("videotestsrc is-live=true ! "
+      "video/x-raw,format=I420,width=320,height=240,framerate=25/1 ! "
+      "avladder name=l codec=mpeg4 src_0::width=160 "
+      "l.src_0 ! fakesink name=s0 sync=false", NULL);
+  fail_unless (pipeline != NULL, "Failed to create pipeline!");
+
+  fail_unless (gst_element_set_state (pipeline, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE);
+  fail_unless_equals_int (gst_element_get_state (pipeline, NULL, NULL,
+          GST_CLOCK_TIME_NONE), GST_STATE_CHANGE_SUCCESS);
+
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "s0");
+  pad = gst_element_get_static_pad (sink, "sink");
+  query = gst_query_new_latency ();
+  fail_unless (gst_pad_peer_query (pad, query));
+  gst_query_parse_latency (query, &live, &min, &max);
+  fail_unless (live);
+  /* at least the frame of the live source, the encoder without B-frames
+   * and with slice threads holds nothing back */
+  fail_unless (min >= GST_SECOND / 25);
+  gst_query_unref (query);
+  gst_object_unref (pad);
+  gst_object_unref (sink);
+
+  fail_unless_equals_int (gst_element_set_state (pipeline, GST_STATE_NULL),
+      GST_STATE_CHANGE_SUCCESS);
+  gst_object_unref (pipeline);
+}
+
+GST_END_TEST;
+
+static Suite *
+avladder_suite (void)
+{
+  Suite *s = suite_create ("avladder");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_ladder_aligned_keyframes);
+  tcase_add_test (tc_chain, test_ladder_latency);
+
+  return s;
+}
+
+GST_CHECK_MAIN (avladder)
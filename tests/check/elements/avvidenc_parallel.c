@@ -0,0 +1,163 @@
+/* GStreamer unit tests for the parallel encoding of the libav video encoders
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/check/gstharness.h>
+
+#include <gst/gst.h>
+
+#define N_FRAMES 60
+#define WIDTH 64
+#define HEIGHT 64
+
+/* returns all the packets the encoder made of N_FRAMES frames */
+static GPtrArray *
+encode (const gchar * launch, guint parallel_contexts)
+{
+  GstClockTime duration = gst_util_uint64_scale_int (GST_SECOND, 1, 25);
+  gsize size = WIDTH * HEIGHT * 3 / 2;
+  GPtrArray *packets;
+  GstElement *enc;
+  GstHarness *h;
+  GstBuffer *buf;
+  gint i;
+
+  h = gst_harness_new_parse (launch);
+  /* the encoder only uses several contexts for input that is not live */
+  gst_harness_set_live (h, FALSE);
+  enc = gst_harness_find_element (h, "enc");
+  g_object_set (enc, "parallel-contexts", parallel_contexts, NULL);
+  gst_object_unref (enc);
+
+  gst_harness_set_src_caps_str (h, "video/x-raw,format=I420,width=64,"
+      "height=64,framerate=25/1");
+
+  for (i = 0; i < N_FRAMES; i++) {
+    buf = gst_harness_create_buffer (h, size);
+    /* a gradient that moves, so that the frames differ */
+    gst_buffer_memset (buf, 0, i * 4, size / 2);
+    gst_buffer_memset (buf, size / 2, 255 - i * 4, size - size / 2);
+    GST_BUFFER_PTS (buf) = i * duration;
+    GST_BUFFER_DURATION (buf) = duration;
+    fail_unless_equals_int (gst_harness_push (h, buf), GST_FLOW_OK);
+  }
+  fail_unless (gst_harness_push_event (h, gst_event_new_eos ()));
+
+  packets = g_ptr_array_new_with_free_func ((GDestroyNotify) gst_buffer_unref);
+  while ((buf = gst_harness_try_pull (h)))
+    g_ptr_array_add (packets, buf);
+
+  gst_harness_teardown (h);
+
+  return packets;
+}
+
+/* the packets are in decoding order and none is decoded before shown */
+static void
+check_timestamps (GPtrArray * packets)
+{
+  GstClockTime last_dts = GST_CLOCK_TIME_NONE;
+  GstBuffer *buf;
+  guint i;
+
+  for (i = 0; i < packets->len; i++) {
+    buf = g_ptr_array_index (packets, i);
+
+    fail_unless (GST_BUFFER_DTS_IS_VALID (buf));
+    fail_unless (GST_BUFFER_PTS_IS_VALID (buf));
+    if (GST_CLOCK_TIME_IS_VALID (last_dts))
+      fail_unless (GST_BUFFER_DTS (buf) > last_dts,
+          "DTS of packet %u goes back", i);
+    fail_unless (GST_BUFFER_DTS (buf) <= GST_BUFFER_PTS (buf),
+        "packet %u is decoded after it is shown", i);
+    last_dts = GST_BUFFER_DTS (buf);
+  }
+}
+
+/* intra-only frames are independent, the output must not change */
+GST_START_TEST (test_parallel_mjpeg)
+{
+  GPtrArray *sequential, *parallel;
+  GstBuffer *seq_buf, *par_buf;
+  GstMapInfo map;
+  guint i;
+
+  sequential = encode ("avenc_mjpeg name=enc pass=quant quantizer=5", 1);
+  parallel = encode ("avenc_mjpeg name=enc pass=quant quantizer=5", 4);
+
+  fail_unless_equals_int (sequential->len, N_FRAMES);
+  fail_unless_equals_int (parallel->len, N_FRAMES);
+  check_timestamps (parallel);
+
+  for (i = 0; i < N_FRAMES; i++) {
+    seq_buf = g_ptr_array_index (sequential, i);
+    par_buf = g_ptr_array_index (parallel, i);
+
+    fail_unless_equals_uint64 (GST_BUFFER_PTS (seq_buf),
+        GST_BUFFER_PTS (par_buf));
+    fail_unless_equals_int (gst_buffer_get_size (seq_buf),
+        gst_buffer_get_size (par_buf));
+    gst_buffer_map (seq_buf, &map, GST_MAP_READ);
+    fail_unless (gst_buffer_memcmp (par_buf, 0, map.data, map.size) == 0,
+        "packet %u differs", i);
+    gst_buffer_unmap (seq_buf, &map);
+  }
+
+  g_ptr_array_unref (sequential);
+  g_ptr_array_unref (parallel);
+}
+
+GST_END_TEST;
+
+/* every chunk of gop-size frames starts with a keyframe */
+GST_START_TEST (test_parallel_mpeg4)
+{
+  GPtrArray *parallel;
+  guint i, n_keyframes = 0;
+
+  parallel = encode ("avenc_mpeg4 name=enc gop-size=10 max-bframes=2", 4);
+
+  fail_unless_equals_int (parallel->len, N_FRAMES);
+  check_timestamps (parallel);
+
+  for (i = 0; i < parallel->len; i++) {
+    if (!GST_BUFFER_FLAG_IS_SET (g_ptr_array_index (parallel, i),
+            GST_BUFFER_FLAG_DELTA_UNIT))
+      n_keyframes++;
+  }
+  fail_unless_equals_int (n_keyframes, N_FRAMES / 10);
+
+  g_ptr_array_unref (parallel);
+}
+
+GST_END_TEST;
+
+static Suite *
+avvidenc_parallel_suite (void)
+{
+  Suite *s = suite_create ("avvidenc_parallel");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_parallel_mjpeg);
+  tcase_add_test (tc_chain, test_parallel_mpeg4);
+
+  return s;
+}
+
+GST_CHECK_MAIN (avvidenc_parallel)
@@ -0,0 +1,144 @@
+/* GStreamer unit tests for the output statistics of the libav video encoders
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <math.h>
+
+#include <gst/check/gstcheck.h>
+#include <gst/check/gstharness.h>
+
+#include <gst/gst.h>
+
+#include "../../../ext/libav/gstavmeta.h"
+
+#define N_FRAMES 30
+#define WIDTH 64
+#define HEIGHT 64
+
+/* encodes with the given encoder, checking the meta of every packet, and
+ * returns the stats of the encoder */
+static GstStructure *
+encode (const gchar * launch, gboolean psnr)
+{
+  GstClockTime duration = gst_util_uint64_scale_int (GST_SECOND, 1, 25);
+  gsize size = WIDTH * HEIGHT * 3 / 2;
+  GstFFMpegEncoderStatsMeta *meta;
+  GstStructure *stats;
+  GstElement *enc;
+  GstHarness *h;
+  GstBuffer *buf;
+  GType api;
+  guint i, n_buffers = 0;
+
+  h = gst_harness_new_parse (launch);
+  gst_harness_set_src_caps_str (h,
+      "video/x-raw,format=I420,width=64,height=64,framerate=25/1");
+
+  for (i = 0; i < N_FRAMES; i++) {
+    buf = gst_harness_create_buffer (h, size);
+    gst_buffer_memset (buf, 0, (i * 4) & 0xff, size);
+    GST_BUFFER_PTS (buf) = i * duration;
+    GST_BUFFER_DURATION (buf) = duration;
+    fail_unless_equals_int (gst_harness_push (h, buf), GST_FLOW_OK);
+  }
+  fail_unless (gst_harness_push_event (h, gst_event_new_eos ()));
+
+  api = g_type_from_name ("GstFFMpegEncoderStatsMetaAPI");
+  fail_unless (api != 0);
+
+  /* the MPEG-4 encoder always exports its quality stats */
+  while ((buf = gst_harness_try_pull (h))) {
+    meta = (GstFFMpegEncoderStatsMeta *) gst_buffer_get_meta (buf, api);
+    fail_unless (meta != NULL);
+
+    fail_unless_equals_int (meta->pict_type == AV_PICTURE_TYPE_I,
+        !GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT));
+    fail_unless (meta->quality > 0);
+    fail_unless_equals_uint64 (meta->size, gst_buffer_get_size (buf));
+
+    if (psnr) {
+      fail_unless (meta->n_planes >= 3);
+      for (i = 0; i < 3; i++)
+        fail_unless (isfinite (meta->psnr[i]) && meta->psnr[i] > 0.0,
+            "PSNR of plane %u is %f", i, meta->psnr[i]);
+    }
+
+    gst_buffer_unref (buf);
+    n_buffers++;
+  }
+  fail_unless_equals_int (n_buffers, N_FRAMES);
+
+  enc = gst_harness_find_element (h, "enc");
+  g_object_get (enc, "stats", &stats, NULL);
+  gst_object_unref (enc);
+
+  gst_harness_teardown (h);
+
+  return stats;
+}
+
+/* every packet has its meta, the stats property sums them up */
+GST_START_TEST (test_stats_mpeg4)
+{
+  GstStructure *stats;
+  guint64 frames, bitrate, encode_time;
+  guint interval;
+
+  stats = encode ("avenc_mpeg4 name=enc gop-size=10", FALSE);
+
+  fail_unless (gst_structure_has_name (stats, "avenc-stats"));
+  fail_unless (gst_structure_get_uint64 (stats, "frames", &frames));
+  fail_unless (gst_structure_get_uint64 (stats, "bitrate", &bitrate));
+  fail_unless (gst_structure_get_uint (stats, "keyframe-interval",
+          &interval));
+  fail_unless (gst_structure_get_uint64 (stats, "encode-time",
+          &encode_time));
+  fail_unless_equals_uint64 (frames, N_FRAMES);
+  fail_unless (bitrate > 0);
+  fail_unless_equals_int (interval, 10);
+  fail_unless (encode_time > 0);
+  fail_unless (encode_time < GST_SECOND);
+  gst_structure_free (stats);
+}
+
+GST_END_TEST;
+
+/* with the psnr flag the errors of the planes come with the packets */
+GST_START_TEST (test_stats_mpeg4_psnr)
+{
+  GstStructure *stats;
+
+  stats = encode ("avenc_mpeg4 name=enc gop-size=10 flags=psnr", TRUE);
+  gst_structure_free (stats);
+}
+
+GST_END_TEST;
+
+static Suite *
+avvidenc_stats_suite (void)
+{
+  Suite *s = suite_create ("avvidenc_stats");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_stats_mpeg4);
+  tcase_add_test (tc_chain, test_stats_mpeg4_psnr);
+
+  return s;
+}
+
+GST_CHECK_MAIN (avvidenc_stats)